@@ -0,0 +1,46 @@
+#pragma once
+
+#include <limits>
+
+#include "plane.hpp"
+#include "sphere.hpp"
+#include "triangle.hpp"
+#include "vec3f.hpp"
+
+namespace geometry {
+
+// Axis aligned bounding box
+// default constructed box is empty (min > max) so merging into it just works
+struct AABB {
+  AABB();
+  AABB(math::Vec3f min, math::Vec3f max);
+
+  math::Vec3f min;
+  math::Vec3f max;
+};
+
+AABB merge(AABB const &a, AABB const &b);
+AABB merge(AABB const &box, math::Vec3f const &point);
+
+math::Vec3f centroid(AABB const &box);
+math::Vec3f extent(AABB const &box);
+float surfaceArea(AABB const &box);
+
+bool isEmpty(AABB const &box);
+bool isFinite(AABB const &box);
+
+// component of v along axis 0 (x), 1 (y) or 2 (z)
+float axisComponent(math::Vec3f const &v, int axis);
+
+AABB bounds(Sphere const &sphere);
+AABB bounds(Triangle const &triangle);
+AABB bounds(Plane const &plane); // infinite
+
+// slab test against [tMin, tMax] of the ray, invDirection is 1 / ray
+// direction; tNear is the entry distance of the ray into the box
+bool intersect(AABB const &box,                 //
+               math::Vec3f const &origin,       //
+               math::Vec3f const &invDirection, //
+               float tMin, float tMax, float &tNear);
+
+} // namespace geometry
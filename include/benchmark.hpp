@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+// Micro benchmarks of the hot paths, selected with "benchmark <name>" in
+// parameters.txt instead of rendering
+namespace benchmark {
+
+// runs the named benchmark and prints its timings
+// returns false if there is no benchmark with that name
+bool run(std::string const &name);
+
+} // namespace benchmark
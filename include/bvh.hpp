@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "aabb.hpp"
+#include "ray.hpp"
+#include "ray_intersect.hpp"
+#include "thread_pool.hpp"
+
+namespace geometry {
+
+// Flattened binary BVH node (32 bytes)
+// nodes are stored depth first, so the left child of an interior node is
+// always the next node and only the right child needs an index
+struct BVHNode {
+  AABB bounds;
+  uint32_t offset = 0; // leaf: first primitive index, interior: right child
+  uint32_t count = 0;  // number of primitives, 0 for interior nodes
+
+  bool isLeaf() const { return count > 0; }
+};
+
+class BVH {
+public:
+  std::vector<BVHNode> nodes;
+  // leaves reference ranges of this array, which maps back to the primitive
+  // index used when building
+  std::vector<uint32_t> primitiveIndices;
+
+  bool isEmpty() const { return nodes.empty(); }
+  AABB bounds() const;
+};
+
+struct BVHBuildOptions {
+  uint32_t maxLeafSize = 4;
+  // primitives a leaf intersects at once (e.g. SIMD width), the surface area
+  // heuristic charges one intersection per group
+  uint32_t leafGroupSize = 1;
+  // buildLinearBVH only: passes of treelet restructuring over the tree, each
+  // one lowers its surface area heuristic cost a little more
+  uint32_t treeletRounds = 0;
+};
+
+// Binned surface area heuristic build over the bounds of each primitive
+BVH buildBVH(std::vector<AABB> const &primitiveBounds,
+             BVHBuildOptions const &options = BVHBuildOptions());
+
+// Linear BVH build on the threads of the pool, for millions of primitives
+// the centroids are sorted by their 30 bit Morton code and the tree is the
+// radix tree over the sorted codes (every node splits where the codes first
+// differ); much faster to build than buildBVH but a worse tree, which
+// options.treeletRounds partly makes up for
+// subtrees of up to options.maxLeafSize primitives become leaves and the
+// nodes are laid out as buildBVH lays them out
+BVH buildLinearBVH(std::vector<AABB> const &primitiveBounds,
+                   concurrency::ThreadPool &threadPool,
+                   BVHBuildOptions const &options = BVHBuildOptions());
+
+// Surface area heuristic cost of the tree relative to the area of its root,
+// with the costs the builders use; lower is better, refitting moved
+// primitives makes it grow
+float surfaceAreaCost(BVH const &bvh,
+                      BVHBuildOptions const &options = BVHBuildOptions());
+
+// Updates the bounds of every node for primitives that moved, keeping the
+// tree as it is; primitiveBounds are indexed as when building
+// the nodes are laid out depth first, so a subtree is a range of the array
+// that is refit on its own: ranges go to the threads of the pool, then the
+// few nodes above them are refit last
+void refit(BVH &bvh, std::vector<AABB> const &primitiveBounds,
+           concurrency::ThreadPool &threadPool);
+
+// Closest hit traversal, children are visited near to far
+// intersectLeaf(offset, count, closest) tests the leaf's primitives and
+// updates closest, its rayDepth is used to cull the remaining nodes
+// only nodes overlapping the ray interval are visited and closest starts with
+// the ray's tMax as rayDepth, which is what is returned on a miss
+// root restricts the search to the subtree below that node
+template <typename LeafIntersect>
+Hit closestHit(BVH const &bvh, Ray const &ray, LeafIntersect intersectLeaf,
+               uint32_t root = 0);
+
+// Any hit traversal for occlusion queries, stops as soon as
+// occludedLeaf(offset, count) returns true for a leaf; children are visited
+// in no particular order
+template <typename LeafOccluded>
+bool anyHit(BVH const &bvh, Ray const &ray, LeafOccluded occludedLeaf,
+            uint32_t root = 0);
+
+} // namespace geometry
+
+#include "bvh.tpp"
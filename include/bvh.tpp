@@ -0,0 +1,108 @@
+namespace geometry {
+
+template <typename LeafIntersect>
+Hit closestHit(BVH const &bvh, Ray const &ray, LeafIntersect intersectLeaf,
+               uint32_t root) {
+  Hit closest;
+  closest.rayDepth = ray.tMax;
+
+  if (bvh.isEmpty())
+    return closest;
+
+  math::Vec3f invDirection(1.f / ray.direction.x, //
+                           1.f / ray.direction.y, //
+                           1.f / ray.direction.z);
+
+  struct Entry {
+    uint32_t node;
+    float tNear;
+  };
+
+  // depth is bounded by the builder, 64 is plenty
+  Entry stack[64];
+  int top = 0;
+
+  float tNear;
+  if (!intersect(bvh.nodes[root].bounds, ray.origin, invDirection, ray.tMin,
+                 closest.rayDepth, tNear))
+    return closest;
+
+  stack[top++] = {root, tNear};
+
+  while (top > 0) {
+    Entry entry = stack[--top];
+    if (entry.tNear > closest.rayDepth)
+      continue;
+
+    BVHNode const &node = bvh.nodes[entry.node];
+
+    if (node.isLeaf()) {
+      intersectLeaf(node.offset, node.count, closest);
+      continue;
+    }
+
+    uint32_t left = entry.node + 1;
+    uint32_t right = node.offset;
+
+    float tLeft, tRight;
+    bool hitLeft = intersect(bvh.nodes[left].bounds, ray.origin, invDirection,
+                             ray.tMin, closest.rayDepth, tLeft);
+    bool hitRight = intersect(bvh.nodes[right].bounds, ray.origin,
+                              invDirection, ray.tMin, closest.rayDepth, tRight);
+
+    // push far child first so the near one is popped first
+    if (hitLeft && hitRight) {
+      if (tLeft < tRight) {
+        stack[top++] = {right, tRight};
+        stack[top++] = {left, tLeft};
+      } else {
+        stack[top++] = {left, tLeft};
+        stack[top++] = {right, tRight};
+      }
+    } else if (hitLeft) {
+      stack[top++] = {left, tLeft};
+    } else if (hitRight) {
+      stack[top++] = {right, tRight};
+    }
+  }
+
+  return closest;
+}
+
+template <typename LeafOccluded>
+bool anyHit(BVH const &bvh, Ray const &ray, LeafOccluded occludedLeaf,
+            uint32_t root) {
+  if (bvh.isEmpty())
+    return false;
+
+  math::Vec3f invDirection(1.f / ray.direction.x, //
+                           1.f / ray.direction.y, //
+                           1.f / ray.direction.z);
+
+  uint32_t stack[64];
+  int top = 0;
+  stack[top++] = root;
+
+  while (top > 0) {
+    uint32_t nodeIndex = stack[--top];
+    BVHNode const &node = bvh.nodes[nodeIndex];
+
+    float tNear;
+    if (!intersect(node.bounds, ray.origin, invDirection, ray.tMin, ray.tMax,
+                   tNear))
+      continue;
+
+    if (node.isLeaf()) {
+      if (occludedLeaf(node.offset, node.count))
+        return true;
+      continue;
+    }
+
+    stack[top++] = node.offset;
+    stack[top++] = nodeIndex + 1;
+  }
+
+  return false;
+}
+
+} // namespace geometry
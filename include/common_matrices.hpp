@@ -57,4 +57,21 @@ math::Mat3f mat3(Mat4f const &m);
 	
 math::Mat4f mat4(Mat3f const &m);
 
+// inverse of an affine transform (linear part plus translation)
+math::Mat4f affineInverse(Mat4f const &m);
+
+// m * (p, 1)
+inline math::Vec3f transformPoint(Mat4f const &m, math::Vec3f const &p) {
+  return {m(0, 0) * p.x + m(0, 1) * p.y + m(0, 2) * p.z + m(0, 3), //
+          m(1, 0) * p.x + m(1, 1) * p.y + m(1, 2) * p.z + m(1, 3), //
+          m(2, 0) * p.x + m(2, 1) * p.y + m(2, 2) * p.z + m(2, 3)};
+}
+
+// m * (v, 0)
+inline math::Vec3f transformVector(Mat4f const &m, math::Vec3f const &v) {
+  return {m(0, 0) * v.x + m(0, 1) * v.y + m(0, 2) * v.z, //
+          m(1, 0) * v.x + m(1, 1) * v.y + m(1, 2) * v.z, //
+          m(2, 0) * v.x + m(2, 1) * v.y + m(2, 2) * v.z};
+}
+
 } // namespace math
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "grid2.hpp"
+#include "image.hpp"
+#include "thread_pool.hpp"
+#include "vec3f.hpp"
+
+namespace raster {
+
+using Bytes = std::vector<unsigned char>;
+
+// 8 bit pixels with 1 to 4 channels, rows stored bottom up as the screen is
+// (row 0 is the bottom of the image)
+// formats that store floats take the linear radiance instead if there is one
+struct ImageView {
+  unsigned char const *pixels = nullptr;
+  math::Vec3f const *radiance = nullptr; // optional, 3 channel images only
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint8_t channels = 0;
+
+  unsigned char const *row(uint32_t y) const {
+    return pixels + size_t(y) * width * channels;
+  }
+};
+
+ImageView view(geometry::Grid2<RGB> const &screen);
+ImageView view(geometry::Grid2<RGB> const &screen,
+               geometry::Grid2<math::Vec3f> const &radiance);
+ImageView view(Image const &image);
+
+// Encodes an image in bands of rows, rows [band * bandHeight, (band + 1) *
+// bandHeight) of the view; bands are encoded independently of each other,
+// possibly at the same time on different threads, so only the band's own rows
+// are read and they may be encoded while others are still being rendered
+class ImageEncoder {
+public:
+  virtual ~ImageEncoder() = default;
+
+  // whether the file starts with the top row of the image, and with it the
+  // last band
+  virtual bool topDown() const { return true; }
+
+  // appends the start of the file to out, false if the format can't store
+  // the image (e.g. its number of channels)
+  virtual bool begin(ImageView const &image, uint32_t bandHeight,
+                     Bytes &out) = 0;
+
+  // appends the file's bytes for band to out
+  virtual void encode(uint32_t band, Bytes &out) = 0;
+
+  // appends the end of the file to out, once all bands are written
+  virtual void finish(Bytes &out) = 0;
+};
+
+// deflate compressed, rows filtered as PNG encoders usually do
+std::unique_ptr<ImageEncoder> makePNGEncoder();
+// binary P5 / P6, 1 or 3 channels
+std::unique_ptr<ImageEncoder> makePPMEncoder();
+// 32 bit float Portable Float Map, bottom up, 1 or 3 channels; the radiance
+// if the view has it, else the 8 bit pixels scaled to [0, 1]
+std::unique_ptr<ImageEncoder> makePFMEncoder();
+// the pixels as they are, top row first, no header
+std::unique_ptr<ImageEncoder> makeRawEncoder();
+
+// by the extension of path (.png, .ppm, .pfm, .raw), nullptr for others
+std::unique_ptr<ImageEncoder> makeEncoderFor(std::string const &path);
+
+// Output stage of a render: the renderer marks regions of the image as
+// finished and every band is encoded on the thread that finishes it, so
+// output overlaps rendering; encoded bands are written to the file as soon
+// as all bands before them in the file are
+class ImageOutput {
+public:
+  // runs on the rows [firstRow, lastRow) of a band once they are done and
+  // before they are encoded, e.g. to tonemap them into the 8 bit pixels
+  using Prepare = std::function<void(uint32_t firstRow, uint32_t lastRow)>;
+
+  ImageOutput(std::unique_ptr<ImageEncoder> encoder, ImageView const &image,
+              uint32_t bandHeight, Prepare prepare = Prepare());
+
+  ImageOutput(ImageOutput const &) = delete;
+  ImageOutput &operator=(ImageOutput const &) = delete;
+
+  // false if the file can't be opened or the encoder can't store the image
+  bool open(std::string const &path);
+
+  // pixels [x0, x1) x [y0, y1) won't change any more, may be called from any
+  // thread; every pixel must be marked exactly once
+  void markDone(int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+
+  // writes the end of the file once all pixels are done, false if anything
+  // couldn't be written
+  bool close();
+
+private:
+  void write(uint32_t band, Bytes bytes);
+
+  std::unique_ptr<ImageEncoder> m_encoder;
+  ImageView m_image;
+  Prepare m_prepare;
+  bool m_open = false;
+  uint32_t m_bandHeight;
+  uint32_t m_bandCount;
+
+  // pixels still to be done per band
+  std::unique_ptr<std::atomic<int64_t>[]> m_remaining;
+
+  std::mutex m_mutex;
+  std::ofstream m_file;
+  std::vector<Bytes> m_encoded; // bands waiting for the ones before them
+  std::vector<bool> m_ready;
+  uint32_t m_written = 0; // bands written, in file order
+};
+
+// the whole image at once, bands encoded on the threads of the pool
+bool writeImage(std::string const &path, ImageView const &image,
+                std::unique_ptr<ImageEncoder> encoder,
+                concurrency::ThreadPool &threadPool);
+
+} // namespace raster
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace io {
+
+// Read only memory mapping of a whole file
+// pages are loaded by the OS as they are touched, so several threads can read
+// different parts of a large file without copying it into memory first
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(MappedFile const &) = delete;
+  MappedFile &operator=(MappedFile const &) = delete;
+
+  // maps the file at path, replacing any previous mapping
+  // returns false if it can't be opened or mapped
+  bool open(std::string const &path);
+  void close();
+
+  bool isOpen() const { return m_open; }
+
+  // nullptr for empty files
+  char const *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  char const *m_data = nullptr;
+  size_t m_size = 0;
+  bool m_open = false;
+#ifdef _WIN32
+  void *m_file = nullptr;
+  void *m_mapping = nullptr;
+#endif
+};
+
+} // namespace io
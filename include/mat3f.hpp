@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <initializer_list>
 #include <iosfwd>
 
@@ -39,7 +41,7 @@ public:
   Mat3f::array9f::const_iterator begin() const;
   Mat3f::array9f::const_iterator end() const;
 
-  static int rowMajorIndex(int row, int column);
+  static constexpr int rowMajorIndex(int row, int column);
   static Mat3f identity();
 
 private:
@@ -60,4 +62,157 @@ Mat3f operator*(Mat3f const &lhs, float s);
 
 std::ostream &operator<<(std::ostream &out, Mat3f const &mat);
 
+/*
+ * Inline definitions, see vec3f.hpp
+ */
+
+inline Mat3f::Mat3f(float fillValue) { m_values.fill(fillValue); }
+
+inline Mat3f::Mat3f(Mat3f::array9f values) : m_values(values) {}
+
+inline Mat3f::Mat3f(std::initializer_list<float> list) {
+  assert(list.size() == NUMBER_ELEMENTS);
+  std::copy_n(list.begin(), NUMBER_ELEMENTS, m_values.begin());
+}
+
+inline void Mat3f::fill(float t) { m_values.fill(t); }
+
+inline float &Mat3f::operator()(int row, int column) {
+  return m_values[rowMajorIndex(row, column)];
+}
+
+inline float &Mat3f::operator[](int element) { return m_values[element]; }
+
+inline float &Mat3f::at(int row, int column) {
+  return m_values.at(rowMajorIndex(row, column));
+}
+
+inline float &Mat3f::at(int element) { return m_values.at(element); }
+
+inline float *Mat3f::data() { return m_values.data(); }
+
+inline float Mat3f::operator()(int row, int column) const {
+  return m_values[rowMajorIndex(row, column)];
+}
+
+inline float Mat3f::operator[](int element) const {
+  return m_values[element];
+}
+
+inline float Mat3f::at(int row, int column) const {
+  return m_values.at(rowMajorIndex(row, column));
+}
+
+inline float Mat3f::at(int element) const { return m_values.at(element); }
+
+inline float const *Mat3f::data() const { return m_values.data(); }
+
+inline Mat3f::array9f::iterator Mat3f::begin() { return m_values.begin(); }
+
+inline Mat3f::array9f::iterator Mat3f::end() { return m_values.end(); }
+
+inline Mat3f::array9f::const_iterator Mat3f::begin() const {
+  return m_values.begin();
+}
+
+inline Mat3f::array9f::const_iterator Mat3f::end() const {
+  return m_values.end();
+}
+
+constexpr int Mat3f::rowMajorIndex(int row, int column) {
+  return row * DIMENSION + column;
+}
+
+inline Mat3f Mat3f::identity() {
+  return {1.f, 0.f, 0.f, //
+          0.f, 1.f, 0.f, //
+          0.f, 0.f, 1.f};
+}
+
+inline Mat3f transposed(Mat3f mat) {
+  using std::swap;
+  //	0	1	2
+  // --------------
+  // 0|	0	1	2
+  // 1| 3	4	5
+  // 2| 6	7	8
+
+  swap(mat[1], mat[3]);
+  swap(mat[2], mat[6]);
+  swap(mat[5], mat[7]);
+
+  return mat;
+}
+
+inline float determinant(Mat3f const &m) {
+  return m(0, 0) * (m(1, 1) * m(2, 2) - m(2, 1) * m(1, 2)) - //
+         m(0, 1) * (m(1, 0) * m(2, 2) - m(1, 2) * m(2, 0)) + //
+         m(0, 2) * (m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0));
+}
+
+inline Mat3f inverse(Mat3f const &m) {
+  Mat3f mInv;
+
+  auto det = determinant(m);
+  auto invDet = 1.f / det;
+
+  mInv(0, 0) = (m(1, 1) * m(2, 2) - m(2, 1) * m(1, 2)) * invDet;
+  mInv(0, 1) = (m(0, 2) * m(2, 1) - m(0, 1) * m(2, 2)) * invDet;
+  mInv(0, 2) = (m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1)) * invDet;
+  mInv(1, 0) = (m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2)) * invDet;
+  mInv(1, 1) = (m(0, 0) * m(2, 2) - m(0, 2) * m(2, 0)) * invDet;
+  mInv(1, 2) = (m(1, 0) * m(0, 2) - m(0, 0) * m(1, 2)) * invDet;
+  mInv(2, 0) = (m(1, 0) * m(2, 1) - m(2, 0) * m(1, 1)) * invDet;
+  mInv(2, 1) = (m(2, 0) * m(0, 1) - m(0, 0) * m(2, 1)) * invDet;
+  mInv(2, 2) = (m(0, 0) * m(1, 1) - m(1, 0) * m(0, 1)) * invDet;
+
+  return mInv;
+}
+
+inline Mat3f fromColumns(Vec3f const &c0, Vec3f const &c1, Vec3f const &c2) {
+  return Mat3f{c0.x, c1.x, c2.x, //
+               c0.y, c1.y, c2.y, //
+               c0.z, c1.z, c2.z};
+}
+
+inline Mat3f operator+(Mat3f const &lhs, Mat3f const &rhs) {
+  Mat3f result;
+  for (int i = 0; i < Mat3f::NUMBER_ELEMENTS; ++i)
+    result[i] = lhs[i] + rhs[i];
+  return result;
+}
+
+inline Mat3f operator-(Mat3f const &lhs, Mat3f const &rhs) {
+  Mat3f result;
+  for (int i = 0; i < Mat3f::NUMBER_ELEMENTS; ++i)
+    result[i] = lhs[i] - rhs[i];
+  return result;
+}
+
+inline Mat3f operator*(Mat3f const &lhs, Mat3f const &rhs) {
+  Mat3f result;
+
+  float element = 0.f;
+  for (int i = 0; i < Mat3f::DIMENSION; ++i) {
+    for (int j = 0; j < Mat3f::DIMENSION; ++j) {
+      element = 0.f;
+      for (int k = 0; k < Mat3f::DIMENSION; ++k) {
+        element += lhs(i, k) * rhs(k, j);
+      }
+      result(i, j) = element;
+    }
+  }
+
+  return result;
+}
+
+inline Mat3f operator*(float s, Mat3f const &rhs) {
+  Mat3f result;
+  for (int i = 0; i < Mat3f::NUMBER_ELEMENTS; ++i)
+    result[i] = s * rhs[i];
+  return result;
+}
+
+inline Mat3f operator*(Mat3f const &lhs, float s) { return s * lhs; }
+
 } // namespace math
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <initializer_list>
 #include <iosfwd>
 
@@ -37,7 +39,7 @@ public:
   Mat4f::array16f::const_iterator begin() const;
   Mat4f::array16f::const_iterator end() const;
 
-  static int rowMajorIndex(int row, int column);
+  static constexpr int rowMajorIndex(int row, int column);
   static Mat4f identity();
 
 private:
@@ -54,4 +56,131 @@ Mat4f operator*(Mat4f const &lhs, float s);
 
 std::ostream &operator<<(std::ostream &out, Mat4f const &mat);
 
+/*
+ * Inline definitions, see vec3f.hpp
+ */
+
+inline Mat4f::Mat4f(float fillValue) { m_values.fill(fillValue); }
+
+inline Mat4f::Mat4f(Mat4f::array16f values) : m_values(values) {}
+
+inline Mat4f::Mat4f(std::initializer_list<float> list) {
+  assert(list.size() == NUMBER_ELEMENTS);
+  std::copy_n(list.begin(), NUMBER_ELEMENTS, m_values.begin());
+}
+
+inline void Mat4f::fill(float t) { m_values.fill(t); }
+
+inline float &Mat4f::operator()(int row, int column) {
+  return m_values[rowMajorIndex(row, column)];
+}
+
+inline float &Mat4f::operator[](int element) { return m_values[element]; }
+
+inline float &Mat4f::at(int row, int column) {
+  return m_values.at(rowMajorIndex(row, column));
+}
+
+inline float &Mat4f::at(int element) { return m_values.at(element); }
+
+inline float *Mat4f::data() { return m_values.data(); }
+
+inline float Mat4f::operator()(int row, int column) const {
+  return m_values[rowMajorIndex(row, column)];
+}
+
+inline float Mat4f::operator[](int element) const {
+  return m_values[element];
+}
+
+inline float Mat4f::at(int row, int column) const {
+  return m_values.at(rowMajorIndex(row, column));
+}
+
+inline float Mat4f::at(int element) const { return m_values.at(element); }
+
+inline float const *Mat4f::data() const { return m_values.data(); }
+
+inline Mat4f::array16f::iterator Mat4f::begin() { return m_values.begin(); }
+
+inline Mat4f::array16f::iterator Mat4f::end() { return m_values.end(); }
+
+inline Mat4f::array16f::const_iterator Mat4f::begin() const {
+  return m_values.begin();
+}
+
+inline Mat4f::array16f::const_iterator Mat4f::end() const {
+  return m_values.end();
+}
+
+constexpr int Mat4f::rowMajorIndex(int row, int column) {
+  return row * DIMENSION + column;
+}
+
+inline Mat4f Mat4f::identity() {
+  return {1.f, 0.f, 0.f, 0.f, // row 0
+          0.f, 1.f, 0.f, 0.f, // row 1
+          0.f, 0.f, 1.f, 0.f, // row 2
+          0.f, 0.f, 0.f, 1.f};
+}
+
+inline Mat4f transposed(Mat4f mat) {
+  using std::swap;
+  //		0		1		2		3
+  // ----------------
+  // 0|	0		1		2		3
+  // 1| 4		5		6		7
+  // 2| 8		9		10	11
+  // 3| 12	13	14	15
+
+  swap(mat[1], mat[4]);
+  swap(mat[2], mat[8]);
+  swap(mat[3], mat[12]);
+  swap(mat[6], mat[9]);
+  swap(mat[7], mat[13]);
+  swap(mat[11], mat[14]);
+
+  return mat;
+}
+
+inline Mat4f operator+(Mat4f const &lhs, Mat4f const &rhs) {
+  Mat4f result;
+  for (int i = 0; i < Mat4f::NUMBER_ELEMENTS; ++i)
+    result[i] = lhs[i] + rhs[i];
+  return result;
+}
+
+inline Mat4f operator-(Mat4f const &lhs, Mat4f const &rhs) {
+  Mat4f result;
+  for (int i = 0; i < Mat4f::NUMBER_ELEMENTS; ++i)
+    result[i] = lhs[i] - rhs[i];
+  return result;
+}
+
+inline Mat4f operator*(Mat4f const &lhs, Mat4f const &rhs) {
+  Mat4f result;
+
+  float element = 0.f;
+  for (int i = 0; i < Mat4f::DIMENSION; ++i) {
+    for (int j = 0; j < Mat4f::DIMENSION; ++j) {
+      element = 0.f;
+      for (int k = 0; k < Mat4f::DIMENSION; ++k) {
+        element += lhs(i, k) * rhs(k, j);
+      }
+      result(i, j) = element;
+    }
+  }
+
+  return result;
+}
+
+inline Mat4f operator*(float s, Mat4f const &rhs) {
+  Mat4f result;
+  for (int i = 0; i < Mat4f::NUMBER_ELEMENTS; ++i)
+    result[i] = s * rhs[i];
+  return result;
+}
+
+inline Mat4f operator*(Mat4f const &lhs, float s) { return s * lhs; }
+
 } // namespace math
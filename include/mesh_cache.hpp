@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "mesh_instance.hpp"
+#include "thread_pool.hpp"
+
+namespace geometry {
+
+// Binary cache of a TriangleMesh: the OBJ data, its BVH and the precomputed
+// triangles, written after the first load of an OBJ file and memory mapped by
+// the following ones instead of parsing the text and building the BVH again
+// the file is a header followed by the arrays exactly as they are laid out in
+// memory, so reading it is one copy per array; it is tagged with a format
+// version, the sizes of the stored types and the hash of the OBJ's contents,
+// and is rebuilt whenever any of them doesn't match
+
+// 64 bit hash of a file's contents, hashed in chunks on the threads of the
+// pool; returns false if the file can't be read
+bool hashFileContents(std::string const &path,
+                      concurrency::ThreadPool &threadPool, uint64_t &hash);
+
+// nullptr if the file is missing, unreadable, damaged (e.g. indices out of
+// range) or doesn't match contentHash or this build's format
+std::shared_ptr<TriangleMesh> readMeshCache(std::string const &path,
+                                            uint64_t contentHash);
+
+bool writeMeshCache(std::string const &path, TriangleMesh const &mesh,
+                    uint64_t contentHash);
+
+// where the cache of an OBJ file is kept, next to it
+std::string meshCachePath(std::string const &objPath);
+
+// the mesh of an OBJ file from its cache if that is up to date, otherwise
+// loaded from the OBJ file and cached for the next time; nullptr if neither
+// can be read
+std::shared_ptr<TriangleMesh>
+loadTriangleMesh(std::string const &objPath,
+                 concurrency::ThreadPool &threadPool);
+
+} // namespace geometry
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "aabb.hpp"
+#include "bvh.hpp"
+#include "mat4f.hpp"
+#include "obj_mesh.hpp"
+#include "ray.hpp"
+#include "ray_intersect.hpp"
+#include "thread_pool.hpp"
+
+namespace geometry {
+
+// Mesh geometry together with its bottom level BVH over the triangles
+// one copy is shared between all instances of the mesh
+struct TriangleMesh {
+  OBJMesh mesh;
+  BVH bvh;
+  // in bvh.primitiveIndices order so leaves read them contiguously
+  std::vector<PrecomputedTriangle> precomputed;
+};
+
+// the owner may deform the mesh in place (see refitTriangleMesh), instances
+// only get to read it
+std::shared_ptr<TriangleMesh> makeTriangleMesh(OBJMesh mesh);
+
+// Updates precomputed and the bounds of the BVH once mesh.mesh has been
+// deformed in place (vertices moved, same triangles); the instances follow
+// after refitScene
+void refitTriangleMesh(TriangleMesh &mesh, concurrency::ThreadPool &threadPool);
+
+Triangle triangleAt(OBJMesh const &mesh, uint32_t index);
+
+// A placement of a mesh in the world
+struct MeshInstance {
+  std::shared_ptr<TriangleMesh const> mesh;
+  math::Mat4f toWorld;
+  math::Mat4f toObject; // inverse of toWorld
+  math::Vec3f colour = {0.8f, 0.8f, 0.8f};
+};
+
+MeshInstance makeMeshInstance(std::shared_ptr<TriangleMesh const> mesh,
+                              math::Mat4f const &toWorld,
+                              math::Vec3f const &colour);
+
+AABB bounds(MeshInstance const &instance); // world space
+
+// Top level BVH over the world bounds of the instances
+struct MeshInstances {
+  std::vector<MeshInstance> instances;
+  BVH bvh;
+};
+
+MeshInstances buildMeshInstances(std::vector<MeshInstance> instances);
+
+struct InstanceHit {
+  explicit operator bool() const;
+
+  Hit hit;
+  uint32_t instance = 0;
+  uint32_t triangle = 0;
+};
+
+// closest hit in the ray interval
+InstanceHit intersect(Ray const &ray, MeshInstances const &meshes);
+
+// whether any triangle is hit in the ray interval
+// instance and slot are set to the first one found, slot indexes the mesh's
+// precomputed triangles
+bool occluded(Ray const &ray, MeshInstances const &meshes, uint32_t &instance,
+              uint32_t &slot);
+
+// the same test against a single triangle, e.g. the last occluder
+bool occludedByTriangle(Ray const &ray, MeshInstances const &meshes,
+                        uint32_t instance, uint32_t slot);
+
+// world space geometric normal of the hit triangle
+math::Vec3f normalAt(InstanceHit const &hit, MeshInstances const &meshes);
+
+} // namespace geometry
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+namespace geometry {
+
+// Morton (Z-order) codes: the bits of three coordinates interleaved, so
+// points close in space tend to be close in the order of their codes
+
+// the low 10 bits of x spread out to every third bit
+inline uint32_t spreadBits(uint32_t x) {
+  x &= 0x3ffu;
+  x = (x | (x << 16)) & 0x030000ffu;
+  x = (x | (x << 8)) & 0x0300f00fu;
+  x = (x | (x << 4)) & 0x030c30c3u;
+  x = (x | (x << 2)) & 0x09249249u;
+  return x;
+}
+
+// 30 bit code of a cell of a 1024^3 grid, x, y and z in [0, 1023]
+inline uint32_t mortonCode(uint32_t x, uint32_t y, uint32_t z) {
+  return (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+}
+
+} // namespace geometry
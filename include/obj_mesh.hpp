@@ -3,6 +3,7 @@
 #include <vector>
 #include <array>
 
+#include "thread_pool.hpp"
 #include "triangle.hpp"
 #include "vec2f.hpp"
 #include "vec3f.hpp"
@@ -12,6 +13,9 @@
 
 namespace geometry {
 
+// texture coordinate or normal index of a face vertex that doesn't have one
+constexpr unsigned int missingIndex = ~0u;
+
 struct Indices {
 
   std::array<unsigned int, 3> id;
@@ -41,14 +45,42 @@ struct OBJMesh {
   Normals normals;
 };
 
+// Weighting of the face normals averaged into a vertex normal
+// ANGLE weights a face by its angle at the vertex, which doesn't depend on
+// how the surface around the vertex is split into triangles; AREA weights it
+// by its area
+enum class NormalWeighting { ANGLE, AREA };
+
+// unit normals of the faces, zero for degenerate ones
+// faces are processed in parallel on the threads of the pool, the overloads
+// without a pool use one of hardware threads
+Normals calculateTriangleNormals(IndicesTriangles const &indexTriangles,
+                                 Vertices const &vertices,
+                                 concurrency::ThreadPool &threadPool);
+
 Normals calculateTriangleNormals(IndicesTriangles const &indexTriangles,
                                  Vertices const &vertices);
 
-Normals calculateVertexNormals(IndicesTriangles const &indexTriangles,
-                               Vertices const &vertices);
+// unit normals of the vertices, the weighted average of the normals of the
+// faces around them; zero for vertices without faces
+// the result doesn't depend on the number of threads
+Normals calculateVertexNormals(
+    IndicesTriangles const &indexTriangles, Vertices const &vertices,
+    Normals const &triangleNormals, concurrency::ThreadPool &threadPool,
+    NormalWeighting weighting = NormalWeighting::ANGLE);
+
+Normals calculateVertexNormals(
+    IndicesTriangles const &indexTriangles, Vertices const &vertices,
+    concurrency::ThreadPool &threadPool,
+    NormalWeighting weighting = NormalWeighting::ANGLE);
+
+Normals calculateVertexNormals(
+    IndicesTriangles const &indexTriangles, Vertices const &vertices,
+    NormalWeighting weighting = NormalWeighting::ANGLE);
 
-Normals calculateVertexNormals(IndicesTriangles const &indexTriangles,
-                               Vertices const &vertices,
-                               Normals const &triangleNormals);
+Normals calculateVertexNormals(
+    IndicesTriangles const &indexTriangles, Vertices const &vertices,
+    Normals const &triangleNormals,
+    NormalWeighting weighting = NormalWeighting::ANGLE);
 
 } // namespace geometry
@@ -5,12 +5,20 @@
 #include <vector>
 
 #include "obj_mesh.hpp"
+#include "thread_pool.hpp"
 #include "triangle.hpp"
 #include "vec3f.hpp"
 #include "vec2f.hpp"
 
 namespace geometry {
 
+// Triangulated meshes only; faces may use negative (relative) indices
+// the file is memory mapped and parsed in chunks on the threads of the pool,
+// the load time and throughput are logged
+bool loadOBJMeshFromFile(std::string const &filePath, geometry::OBJMesh &mesh,
+                         concurrency::ThreadPool &threadPool);
+
+// the same on a pool of hardware threads
 bool loadOBJMeshFromFile(std::string const &filePath, geometry::OBJMesh &mesh);
 
 } // namespace geometry
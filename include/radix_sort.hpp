@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace concurrency {
+
+// Sorts keys in ascending order and moves values[i] along with keys[i]
+// least significant radix sort, a byte per pass; each pass splits the keys
+// into blocks over the threads: every block counts its digits, a prefix sum
+// over (digit, block) gives each block where its keys go, then every block
+// scatters its own keys there. Stable, and passes over a byte that is the
+// same in every key are skipped
+void radixSort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values,
+               ThreadPool &threadPool);
+
+} // namespace concurrency
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+#include "simd.hpp"
+
+// Stateless counter based random numbers
+// every value is a pure function of (pixel, sample, dimension), so an image
+// comes out the same no matter how many threads render it or in which order
+// the tiles are traced
+namespace sampling {
+
+// what a random number is used for, keeps the streams independent
+enum Dimension : uint32_t {
+  DITHER = 0,
+  PIXEL_X = 1, // position of a sample in its pixel
+  PIXEL_Y = 2,
+  ROULETTE = 3, // + the bounce, keep last
+};
+
+// integer hash with good avalanche (lowbias32 by C. Wellons)
+inline uint32_t hash(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+inline uint32_t randomBits(uint32_t pixel, uint32_t sample,
+                           uint32_t dimension) {
+  return hash(pixel ^ hash(sample ^ hash(dimension)));
+}
+
+// uniform in [0, 1)
+inline float random01(uint32_t pixel, uint32_t sample, uint32_t dimension) {
+  // top 24 bits fill the float mantissa exactly
+  return (randomBits(pixel, sample, dimension) >> 8) * (1.f / 16777216.f);
+}
+
+// uniform in [a, b)
+inline float randomRange(float a, float b, uint32_t pixel, uint32_t sample,
+                         uint32_t dimension) {
+  return a + (b - a) * random01(pixel, sample, dimension);
+}
+
+#ifdef RAYTRACING_SIMD
+
+// the same for simd::laneCount pixels at once, bit for bit
+
+inline simd::Int hash(simd::Int x) {
+  x = x ^ (x >> 16);
+  x = x * simd::broadcast(0x7feb352du);
+  x = x ^ (x >> 15);
+  x = x * simd::broadcast(0x846ca68bu);
+  x = x ^ (x >> 16);
+  return x;
+}
+
+inline simd::Float random01(simd::Int pixel, uint32_t sample,
+                            uint32_t dimension) {
+  simd::Int stream = simd::broadcast(hash(sample ^ hash(dimension)));
+  simd::Int bits = hash(pixel ^ stream);
+  return simd::toFloat(bits >> 8) * simd::broadcast(1.f / 16777216.f);
+}
+
+inline simd::Float randomRange(float a, float b, simd::Int pixel,
+                               uint32_t sample, uint32_t dimension) {
+  return simd::broadcast(a) +
+         simd::broadcast(b - a) * random01(pixel, sample, dimension);
+}
+
+#endif
+
+} // namespace sampling
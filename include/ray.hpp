@@ -1,16 +1,28 @@
 #pragma once
 
+#include <limits>
+
 #include "vec3f.hpp"
 
 namespace geometry {
 
+// tMin of rays leaving a surface (shadows, reflections), rounding in the hit
+// point would otherwise let them hit that surface again
+constexpr float surfaceEpsilon = 1e-4f;
+
 class Ray {
 public:
   Ray() = default;
-  Ray(math::Vec3f origin, math::Vec3f direction);
+  Ray(math::Vec3f origin, math::Vec3f direction, float tMin = 0.f,
+      float tMax = std::numeric_limits<float>::max());
 
   math::Vec3f origin;
   math::Vec3f direction;
+
+  // only hits with tMin < t < tMax count, e.g. tMax is the distance to the
+  // light for shadow rays; tMin is never negative
+  float tMin = 0.f;
+  float tMax = std::numeric_limits<float>::max();
 };
 
 math::Vec3f pointOnLne(math::Vec3f const &origin,    //
@@ -19,4 +31,7 @@ math::Vec3f pointOnLne(math::Vec3f const &origin,    //
 
 math::Vec3f evaluate(Ray const &ray, float t);
 
+// whether t lies in the interval of the ray
+bool inInterval(Ray const &ray, float t);
+
 } // namespace
@@ -15,10 +15,29 @@ struct Hit {
 
   bool didIntersect = false;
   float rayDepth = std::numeric_limits<float>::max();
+  // barycentric coordinates of b and c for triangle hits
+  float u = 0.f;
+  float v = 0.f;
 };
 
+// Triangle data precomputed once at scene build time so the intersection
+// test does not need to rebuild the edges for every ray
+struct PrecomputedTriangle {
+  math::Vec3f a;
+  math::Vec3f edgeAB; // b - a
+  math::Vec3f edgeAC; // c - a
+};
+
+PrecomputedTriangle precompute(Triangle const &triangle);
+
+// All tests only report hits inside the interval of the ray, (tMin, tMax)
+
+// nearer of the two roots that lies in the ray interval
 Hit intersect(Ray const &ray, Sphere const &sphere);
 
+// Moller-Trumbore, fills in the barycentrics of the hit
+Hit intersect(Ray const &ray, PrecomputedTriangle const &triangle);
+
 Hit intersect(Ray const &ray, Triangle const &triangle);
 
 Hit intersect(Ray const &ray, Plane const &plane);
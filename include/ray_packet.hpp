@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ray.hpp"
+#include "scene.hpp"
+
+namespace raytracing {
+
+// largest number of rays traced together
+constexpr uint32_t maxPacketSize = 16;
+
+// Coherent rays (e.g. primary rays of neighbouring pixels, or their shadow
+// rays towards one light) traced together through the BVHs, one SIMD lane per
+// ray; stored as a structure of arrays, each ray with its own interval
+struct RayPacket {
+  float originX[maxPacketSize];
+  float originY[maxPacketSize];
+  float originZ[maxPacketSize];
+  float directionX[maxPacketSize];
+  float directionY[maxPacketSize];
+  float directionZ[maxPacketSize];
+  float tMin[maxPacketSize];
+  float tMax[maxPacketSize];
+  uint32_t size = 0;
+};
+
+// adds a ray to a packet holding less than maxPacketSize rays
+void append(RayPacket &packet, geometry::Ray const &ray);
+
+geometry::Ray rayAt(RayPacket const &packet, uint32_t index);
+
+// hits[i] is what intersect(rayAt(packet, i), scene) returns
+// nodes hit by only a few rays of the packet are traversed by those rays one
+// at a time, so diverging packets don't drag along idle lanes
+void intersect(RayPacket const &packet, Scene const &scene, SceneHit *hits);
+
+// occluded[i] is what occluded(rayAt(packet, i), scene) returns, each ray
+// drops out of the traversal at its first hit
+void occluded(RayPacket const &packet, Scene const &scene, bool *occluded,
+              OcclusionCache &cache);
+
+} // namespace raytracing
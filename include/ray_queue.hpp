@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ray.hpp"
+#include "ray_packet.hpp"
+#include "scene.hpp"
+
+namespace raytracing {
+
+// A stream of rays waiting for the same query, e.g. all primary rays of a
+// tile or all shadow rays of one bounce, as a structure of arrays
+// the renderer keeps what belongs to each ray (its pixel, throughput, ...) in
+// arrays of its own, in the same order
+struct RayQueue {
+  std::vector<float> originX;
+  std::vector<float> originY;
+  std::vector<float> originZ;
+  std::vector<float> directionX;
+  std::vector<float> directionY;
+  std::vector<float> directionZ;
+  std::vector<float> tMin;
+  std::vector<float> tMax;
+
+  uint32_t size() const { return uint32_t(originX.size()); }
+  bool empty() const { return originX.empty(); }
+
+  // keeps the memory for the next wave
+  void clear();
+  void reserve(uint32_t count);
+};
+
+void append(RayQueue &queue, geometry::Ray const &ray);
+
+geometry::Ray rayAt(RayQueue const &queue, uint32_t index);
+
+// the rays [first, first + count) of a queue as a packet, count is at most
+// maxPacketSize
+void load(RayPacket &packet, RayQueue const &queue, uint32_t first,
+          uint32_t count);
+
+// Batch queries over a whole queue, consecutive rays are traced together in
+// packets of packetSize (4, 8 or 16), 0 traces them one by one
+
+// hits is resized to the queue, hits[i] is what
+// intersect(rayAt(queue, i), scene) returns
+void intersect(RayQueue const &queue, Scene const &scene,
+               std::vector<SceneHit> &hits, uint32_t packetSize);
+
+// occluded is resized to the queue, occluded[i] is what
+// occluded(rayAt(queue, i), scene) returns
+void occluded(RayQueue const &queue, Scene const &scene,
+              std::vector<bool> &occluded, OcclusionCache &cache,
+              uint32_t packetSize);
+
+// Coherence sort: rays are ordered by the octant of their direction, then
+// by the Morton code of their origin in the bounds of all origins, so rays
+// that start close to each other and point the same way end up next to each
+// other, in packets that traverse the BVH the same way
+// the buffers are kept from sort to sort so their memory is reused
+struct RaySort {
+  std::vector<uint16_t> keys;  // octant and Morton code of every ray
+  std::vector<uint32_t> order; // order[i] is where the ray now at i was
+  std::vector<uint32_t> scratch;
+  RayQueue sorted;
+};
+
+void sortByCoherence(RayQueue &queue, RaySort &sort);
+
+// values[i] = values[sort.order[i]] for data kept alongside a sorted queue
+template <typename T>
+void permute(std::vector<T> &values, RaySort const &sort,
+             std::vector<T> &scratch) {
+  scratch.resize(values.size());
+  for (uint32_t i = 0; i < uint32_t(values.size()); ++i)
+    scratch[i] = values[sort.order[i]];
+  values.swap(scratch);
+}
+
+} // namespace raytracing
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "bvh.hpp"
+#include "mat4f.hpp"
+#include "mesh_instance.hpp"
+#include "plane.hpp"
+#include "ray.hpp"
+#include "ray_intersect.hpp"
+#include "sphere.hpp"
+#include "thread_pool.hpp"
+#include "triangle.hpp"
+#include "uniform_grid.hpp"
+#include "vec3f.hpp"
+#include "wide_bvh.hpp"
+
+namespace raytracing {
+
+// What a scene is made of, one array per primitive type
+struct SceneDescription {
+  std::vector<geometry::Sphere> spheres;
+  std::vector<geometry::Triangle> triangles;
+  std::vector<geometry::Plane> planes;
+  std::vector<geometry::MeshInstance> meshInstances;
+};
+
+// Spheres as a structure of arrays
+// the float arrays may be padded for SIMD loads, colour never is
+struct Spheres {
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> radius;
+  std::vector<math::Vec3f> colour;
+
+  uint32_t size() const { return uint32_t(colour.size()); }
+};
+
+// Precomputed triangles (see PrecomputedTriangle) as a structure of arrays
+// the float arrays may be padded for SIMD loads, colour never is
+struct Triangles {
+  std::vector<float> ax, ay, az;    // vertex a
+  std::vector<float> abx, aby, abz; // edge b - a
+  std::vector<float> acx, acy, acz; // edge c - a
+  std::vector<math::Vec3f> normal;  // unit geometric normal
+  std::vector<math::Vec3f> colour;
+
+  uint32_t size() const { return uint32_t(colour.size()); }
+};
+
+// How the sphere and triangle BVHs of a scene are built
+enum class BVHBuilder : uint8_t {
+  SAH,    // buildBVH, the better tree
+  LINEAR, // buildLinearBVH, much faster for millions of primitives
+};
+
+// What single rays (intersect and occluded) traverse to find the spheres and
+// triangles; all of them are built over the slots of the BVHs, and packets
+// always traverse the BVHs
+enum class Accelerator : uint8_t {
+  BVH,
+  WIDE_BVH,       // the BVHs collapsed to WideBVHs
+  GRID,           // UniformGrids
+  TWO_LEVEL_GRID, // TwoLevelGrids
+};
+
+struct SceneBuildOptions {
+  BVHBuilder builder = BVHBuilder::SAH;
+  uint32_t treeletRounds = 0; // LINEAR only, see BVHBuildOptions
+  Accelerator accelerator = Accelerator::BVH;
+  geometry::GridBuildOptions grid; // GRID and TWO_LEVEL_GRID only
+};
+
+enum class PrimitiveType : uint8_t { NONE, SPHERE, TRIANGLE, PLANE, MESH };
+
+// Primitives are stored by type in contiguous arrays and intersected in
+// tight loops per type, no virtual calls
+// spheres and triangles each have a BVH and are stored in its leaf order, so
+// a leaf is a contiguous range of the arrays; the BVH's primitiveIndices map
+// a slot back to the index in the SceneDescription
+// planes are unbounded and tested one by one
+struct Scene {
+  Spheres spheres;
+  geometry::BVH sphereBVH;
+  Triangles triangles;
+  geometry::BVH triangleBVH;
+  // only the ones of buildOptions.accelerator are built
+  geometry::WideBVH sphereWideBVH;
+  geometry::WideBVH triangleWideBVH;
+  geometry::UniformGrid sphereGrid;
+  geometry::UniformGrid triangleGrid;
+  geometry::TwoLevelGrid sphereTwoLevelGrid;
+  geometry::TwoLevelGrid triangleTwoLevelGrid;
+  std::vector<geometry::Plane> planes;
+  geometry::MeshInstances meshes;
+
+  // slot of every sphere and triangle of the SceneDescription
+  std::vector<uint32_t> sphereSlots;
+  std::vector<uint32_t> triangleSlots;
+
+  // how the BVHs were built and their surfaceAreaCost then, see refitScene
+  SceneBuildOptions buildOptions;
+  float sphereBVHCost = 0.f;
+  float triangleBVHCost = 0.f;
+};
+
+Scene buildScene(SceneDescription description);
+// LINEAR builds on the threads of the pool
+Scene buildScene(SceneDescription description,
+                 SceneBuildOptions const &buildOptions,
+                 concurrency::ThreadPool &threadPool);
+
+// In place updates for animation, the number of primitives stays the same
+// index is the primitive's index in the SceneDescription; the BVHs only
+// follow once refitScene has run
+void updateSphere(Scene &scene, uint32_t index, geometry::Sphere const &sphere);
+void updateTriangle(Scene &scene, uint32_t index,
+                    geometry::Triangle const &triangle);
+void updateMeshInstance(Scene &scene, uint32_t index,
+                        math::Mat4f const &toWorld);
+
+// Refits the BVHs to the updated primitives on the threads of the pool
+// refitting keeps the tree, which gets worse the further the primitives move
+// from where they were when it was built: a sphere or triangle BVH whose
+// surfaceAreaCost has grown past rebuildThreshold times its cost when built
+// is rebuilt instead (and the arrays reordered to its leaves); grids are
+// always built again
+// meshes deformed in place need refitTriangleMesh before
+void refitScene(Scene &scene, concurrency::ThreadPool &threadPool,
+                float rebuildThreshold = 1.5f);
+
+// Hit record of a scene query
+// while searching the intersectors only keep the depth, barycentrics and
+// which primitive was hit; point and normal are evaluated once for the final
+// closest hit (see evaluateSurface)
+struct SceneHit {
+  explicit operator bool() const;
+
+  geometry::Hit hit; // u and v are set for TRIANGLE and MESH hits
+  PrimitiveType type = PrimitiveType::NONE;
+  uint32_t primitive = 0; // slot in the array of its type, triangle of the
+                          // mesh for MESH hits
+  uint32_t instance = 0;  // mesh instance for MESH hits
+
+  math::Vec3f point;  // world space
+  math::Vec3f normal; // unit geometric normal, world space
+};
+
+// closest hit in the ray interval, with point and normal evaluated
+SceneHit intersect(geometry::Ray const &ray, Scene const &scene);
+
+// the part of intersect after the sphere and triangle BVHs, closest is only
+// updated for nearer hits
+void intersectPlanesAndMeshes(geometry::Ray const &ray, Scene const &scene,
+                              SceneHit &closest);
+
+// fills in point and normal of a hit of ray found by the intersectors
+void evaluateSurface(SceneHit &hit, geometry::Ray const &ray,
+                     Scene const &scene);
+
+// The primitive that blocked the last occlusion query, tried first by the
+// next one since neighbouring shadow rays tend to be blocked by the same
+// primitive; one per thread
+struct OcclusionCache {
+  PrimitiveType type = PrimitiveType::NONE;
+  uint32_t index = 0;    // slot in the array of its type, instance for meshes
+  uint32_t triangle = 0; // slot in the mesh's precomputed triangles
+};
+
+// whether anything is hit in the ray interval, e.g. up to the light for
+// shadow rays; stops at the first hit found
+bool occluded(geometry::Ray const &ray, Scene const &scene,
+              OcclusionCache &cache);
+bool occluded(geometry::Ray const &ray, Scene const &scene);
+
+// only tests the primitive in cache
+bool occludedByCached(geometry::Ray const &ray, Scene const &scene,
+                      OcclusionCache const &cache);
+
+// the part of occluded after the sphere and triangle BVHs
+bool occludedByPlanesOrMeshes(geometry::Ray const &ray, Scene const &scene,
+                              OcclusionCache &cache);
+
+math::Vec3f colourAt(SceneHit const &hit, Scene const &scene);
+
+// closest hit among slots [first, first + count) of one type, in
+// (ray.tMin, closest.rayDepth); closest starts out with the ray's tMax as
+// rayDepth (as closestHit does)
+// closest and closestIndex are only updated for nearer hits
+void intersectSpheres(Spheres const &spheres, uint32_t first, uint32_t count,
+                      geometry::Ray const &ray, geometry::Hit &closest,
+                      uint32_t &closestIndex);
+
+void intersectTriangles(Triangles const &triangles, uint32_t first,
+                        uint32_t count, geometry::Ray const &ray,
+                        geometry::Hit &closest, uint32_t &closestIndex);
+
+} // namespace raytracing
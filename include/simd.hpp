@@ -0,0 +1,198 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Thin wrappers around the SIMD registers so kernels are written once for
+// both widths, operators can't be overloaded on the raw register types
+// RAYTRACING_SIMD is defined when a vector instruction set is available
+namespace simd {
+
+// floats per register: 8 with AVX2, 4 with SSE2 and 1 (plain scalar loops)
+// on anything else
+#if defined(__AVX2__)
+#define RAYTRACING_SIMD
+constexpr uint32_t laneCount = 8;
+#elif defined(__SSE2__) || defined(_M_X64)
+#define RAYTRACING_SIMD
+constexpr uint32_t laneCount = 4;
+#else
+constexpr uint32_t laneCount = 1;
+#endif
+
+// Comparisons return a mask with all bits of a lane set where they hold.
+// min and max follow std::min and std::max, including which argument is
+// returned for NaN, so kernels give the same results as the scalar code.
+// Integer arithmetic wraps around as it does on uint32_t and >> shifts in
+// zeros; toFloat reads lanes as signed, truncate rounds towards zero.
+
+#if defined(__AVX2__)
+
+struct Float {
+  __m256 v;
+};
+struct Int {
+  __m256i v;
+};
+
+inline Float load(float const *p) { return {_mm256_loadu_ps(p)}; }
+inline Float broadcast(float f) { return {_mm256_set1_ps(f)}; }
+inline Float operator+(Float a, Float b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline Float operator-(Float a, Float b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline Float operator*(Float a, Float b) { return {_mm256_mul_ps(a.v, b.v)}; }
+inline Float operator/(Float a, Float b) { return {_mm256_div_ps(a.v, b.v)}; }
+inline Float sqrt(Float a) { return {_mm256_sqrt_ps(a.v)}; }
+inline Float min(Float a, Float b) { return {_mm256_min_ps(b.v, a.v)}; }
+inline Float max(Float a, Float b) { return {_mm256_max_ps(b.v, a.v)}; }
+inline Float operator&(Float a, Float b) { return {_mm256_and_ps(a.v, b.v)}; }
+inline Float operator|(Float a, Float b) { return {_mm256_or_ps(a.v, b.v)}; }
+inline Float operator<(Float a, Float b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)};
+}
+inline Float operator>(Float a, Float b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)};
+}
+inline Float operator<=(Float a, Float b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)};
+}
+inline Float operator>=(Float a, Float b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)};
+}
+inline Float operator!=(Float a, Float b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_OQ)};
+}
+inline Float select(Float mask, Float a, Float b) {
+  return {_mm256_blendv_ps(b.v, a.v, mask.v)};
+}
+inline Int select(Float mask, Int a, Int b) {
+  return {_mm256_castps_si256(_mm256_blendv_ps(
+      _mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), mask.v))};
+}
+// one bit per lane, lane 0 in the lowest bit
+inline uint32_t bits(Float mask) { return _mm256_movemask_ps(mask.v); }
+
+inline Int broadcast(uint32_t i) { return {_mm256_set1_epi32(int(i))}; }
+inline Int laneIndices(uint32_t base) {
+  return {_mm256_add_epi32(_mm256_set1_epi32(int(base)),
+                           _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))};
+}
+// lanes below remaining are active
+inline Float activeLanes(uint32_t remaining) {
+  return {_mm256_castsi256_ps(
+      _mm256_cmpgt_epi32(_mm256_set1_epi32(int(remaining)),
+                         _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)))};
+}
+inline Int load(uint32_t const *p) {
+  return {_mm256_loadu_si256(reinterpret_cast<__m256i const *>(p))};
+}
+// laneCount bytes, zero extended
+inline Int loadBytes(uint8_t const *p) {
+  return {_mm256_cvtepu8_epi32(
+      _mm_loadl_epi64(reinterpret_cast<__m128i const *>(p)))};
+}
+inline void store(float *p, Float a) { _mm256_storeu_ps(p, a.v); }
+inline void store(uint32_t *p, Int a) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), a.v);
+}
+inline Int operator+(Int a, Int b) { return {_mm256_add_epi32(a.v, b.v)}; }
+inline Int operator*(Int a, Int b) { return {_mm256_mullo_epi32(a.v, b.v)}; }
+inline Int operator^(Int a, Int b) { return {_mm256_xor_si256(a.v, b.v)}; }
+inline Int operator>>(Int a, int n) { return {_mm256_srli_epi32(a.v, n)}; }
+inline Float toFloat(Int a) { return {_mm256_cvtepi32_ps(a.v)}; }
+inline Int truncate(Float a) { return {_mm256_cvttps_epi32(a.v)}; }
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+struct Float {
+  __m128 v;
+};
+struct Int {
+  __m128i v;
+};
+
+inline Float load(float const *p) { return {_mm_loadu_ps(p)}; }
+inline Float broadcast(float f) { return {_mm_set1_ps(f)}; }
+inline Float operator+(Float a, Float b) { return {_mm_add_ps(a.v, b.v)}; }
+inline Float operator-(Float a, Float b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline Float operator*(Float a, Float b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline Float operator/(Float a, Float b) { return {_mm_div_ps(a.v, b.v)}; }
+inline Float sqrt(Float a) { return {_mm_sqrt_ps(a.v)}; }
+inline Float min(Float a, Float b) { return {_mm_min_ps(b.v, a.v)}; }
+inline Float max(Float a, Float b) { return {_mm_max_ps(b.v, a.v)}; }
+inline Float operator&(Float a, Float b) { return {_mm_and_ps(a.v, b.v)}; }
+inline Float operator|(Float a, Float b) { return {_mm_or_ps(a.v, b.v)}; }
+inline Float operator<(Float a, Float b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline Float operator>(Float a, Float b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline Float operator<=(Float a, Float b) { return {_mm_cmple_ps(a.v, b.v)}; }
+inline Float operator>=(Float a, Float b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline Float operator!=(Float a, Float b) {
+  // ordered not equal, false for NaN like the AVX2 version
+  return {_mm_and_ps(_mm_cmpneq_ps(a.v, b.v), _mm_cmpord_ps(a.v, b.v))};
+}
+// SSE2 has no blend instruction
+inline Float select(Float mask, Float a, Float b) {
+  return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+}
+inline Int select(Float mask, Int a, Int b) {
+  __m128i m = _mm_castps_si128(mask.v);
+  return {_mm_or_si128(_mm_and_si128(m, a.v), _mm_andnot_si128(m, b.v))};
+}
+// one bit per lane, lane 0 in the lowest bit
+inline uint32_t bits(Float mask) { return _mm_movemask_ps(mask.v); }
+
+inline Int broadcast(uint32_t i) { return {_mm_set1_epi32(int(i))}; }
+inline Int laneIndices(uint32_t base) {
+  return {_mm_add_epi32(_mm_set1_epi32(int(base)), _mm_setr_epi32(0, 1, 2, 3))};
+}
+// lanes below remaining are active
+inline Float activeLanes(uint32_t remaining) {
+  return {_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(int(remaining)),
+                                           _mm_setr_epi32(0, 1, 2, 3)))};
+}
+inline Int load(uint32_t const *p) {
+  return {_mm_loadu_si128(reinterpret_cast<__m128i const *>(p))};
+}
+// laneCount bytes, zero extended
+inline Int loadBytes(uint8_t const *p) {
+  int32_t bytes;
+  std::memcpy(&bytes, p, sizeof bytes);
+  __m128i zero = _mm_setzero_si128();
+  __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+  return {_mm_unpacklo_epi16(words, zero)};
+}
+inline void store(float *p, Float a) { _mm_storeu_ps(p, a.v); }
+inline void store(uint32_t *p, Int a) {
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(p), a.v);
+}
+inline Int operator+(Int a, Int b) { return {_mm_add_epi32(a.v, b.v)}; }
+// SSE2 only multiplies the even lanes, into 64 bits
+inline Int operator*(Int a, Int b) {
+  __m128i even = _mm_mul_epu32(a.v, b.v);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+  return {_mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                             _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)))};
+}
+inline Int operator^(Int a, Int b) { return {_mm_xor_si128(a.v, b.v)}; }
+inline Int operator>>(Int a, int n) { return {_mm_srli_epi32(a.v, n)}; }
+inline Float toFloat(Int a) { return {_mm_cvtepi32_ps(a.v)}; }
+inline Int truncate(Float a) { return {_mm_cvttps_epi32(a.v)}; }
+
+#endif
+
+#ifdef RAYTRACING_SIMD
+
+inline bool any(Float mask) { return bits(mask) != 0; }
+inline uint32_t count(Float mask) {
+  return uint32_t(std::bitset<laneCount>(bits(mask)).count());
+}
+
+#endif
+
+} // namespace simd
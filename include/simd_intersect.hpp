@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ray.hpp"
+#include "ray_intersect.hpp"
+#include "scene.hpp"
+#include "simd.hpp"
+
+namespace raytracing {
+
+// Same contract as intersectSpheres/intersectTriangles, laneCount primitives
+// per step. A full register is loaded from every slot, so the float arrays
+// must be padded by laneCount - 1 entries past the last primitive (see
+// padForSIMD).
+void intersectSpheresSIMD(Spheres const &spheres, uint32_t first,
+                          uint32_t count, geometry::Ray const &ray,
+                          geometry::Hit &closest, uint32_t &closestIndex);
+
+void intersectTrianglesSIMD(Triangles const &triangles, uint32_t first,
+                            uint32_t count, geometry::Ray const &ray,
+                            geometry::Hit &closest, uint32_t &closestIndex);
+
+// whether any of slots [first, first + count) is hit in the ray interval,
+// occluder is set to the first such slot found
+bool occludedSpheresSIMD(Spheres const &spheres, uint32_t first,
+                         uint32_t count, geometry::Ray const &ray,
+                         uint32_t &occluder);
+
+bool occludedTrianglesSIMD(Triangles const &triangles, uint32_t first,
+                           uint32_t count, geometry::Ray const &ray,
+                           uint32_t &occluder);
+
+// appends the padding the SIMD kernels read past the end
+void padForSIMD(Spheres &spheres);
+void padForSIMD(Triangles &triangles);
+
+} // namespace raytracing
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace concurrency {
+
+// number of hardware threads, at least 1
+unsigned hardwareThreads();
+
+// Fixed size pool of workers with one task queue per worker
+// a worker takes tasks from the front of its own queue and, once that is
+// empty, steals from the back of the others, so uneven tasks balance out
+class ThreadPool {
+public:
+  using Task = std::function<void(uint32_t index, unsigned worker)>;
+
+  // the calling thread is worker 0, threadCount - 1 threads are started
+  explicit ThreadPool(unsigned threadCount = hardwareThreads());
+  ~ThreadPool();
+
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool &operator=(ThreadPool const &) = delete;
+
+  unsigned threadCount() const;
+
+  // runs task(index, worker) for every index in [0, count)
+  // blocks until all of them are done
+  void parallelFor(uint32_t count, Task const &task);
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<uint32_t> tasks;
+  };
+
+  bool pop(unsigned worker, uint32_t &index);
+  bool steal(unsigned worker, uint32_t &index);
+  void runTasks(unsigned worker);
+  void workerLoop(unsigned worker);
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_threads;
+
+  Task const *m_task = nullptr;
+  std::atomic<uint32_t> m_remaining;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  uint64_t m_generation = 0;
+  bool m_stop = false;
+};
+
+} // namespace concurrency
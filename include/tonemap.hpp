@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include "grid2.hpp"
+#include "image.hpp"
+#include "thread_pool.hpp"
+#include "vec3f.hpp"
+
+namespace raster {
+
+enum class ToneMapCurve : uint8_t {
+  CLAMP,    // linear, everything above 1 saturates
+  REINHARD, // c / (1 + c)
+  ACES      // filmic fit of the ACES reference transform (K. Narkowicz)
+};
+
+struct ToneMapping {
+  float exposure = 1.f; // scales the radiance before the curve
+  ToneMapCurve curve = ToneMapCurve::CLAMP;
+  // adds up to half an 8 bit step of noise, removes the banding of smooth
+  // gradients
+  bool dither = true;
+};
+
+// Post process of the HDR radiance of a render into 8 bit RGB: exposure,
+// tone curve, dither and quantization, simd::laneCount pixels at a time
+// rows [firstRow, lastRow) of radiance into the same rows of screen, which
+// must be the same size
+void toneMap(geometry::Grid2<math::Vec3f> const &radiance,
+             geometry::Grid2<RGB> &screen, ToneMapping const &toneMapping,
+             int32_t firstRow, int32_t lastRow);
+
+// the whole image, rows split between the threads of the pool
+void toneMap(geometry::Grid2<math::Vec3f> const &radiance,
+             geometry::Grid2<RGB> &screen, ToneMapping const &toneMapping,
+             concurrency::ThreadPool &threadPool);
+
+} // namespace raster
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "aabb.hpp"
+#include "ray.hpp"
+#include "ray_intersect.hpp"
+#include "vec3f.hpp"
+
+namespace geometry {
+
+// Cells of a grid over a box, x fastest, then y, then z
+struct GridShape {
+  AABB bounds;
+  math::Vec3f cellSize;
+  math::Vec3f invCellSize;
+  int32_t resolution[3]; // cells per axis
+
+  uint32_t cellCount() const;
+  uint32_t cellIndex(int32_t x, int32_t y, int32_t z) const;
+  // cell along axis that coordinate lies in, clamped to the grid
+  int32_t cellOf(float coordinate, int axis) const;
+};
+
+// Primitives [first, first + count) of the bounds a grid was built over
+struct GridRange {
+  uint32_t first;
+  uint32_t count;
+};
+
+// How many cells per primitive a grid gets
+struct GridBuildOptions {
+  float density = 1.f;
+  // top level cells of a TwoLevelGrid, the cells refining them get density
+  float topDensity = 1.f / 16.f;
+};
+
+// Uniform grid over the bounds of primitives; every cell lists the
+// primitives whose bounds overlap it, as ranges of consecutive indices so
+// they are intersected with the same leaf callbacks as a BVH's leaves
+// builds in linear time, and traverses quickly as long as the primitives are
+// spread evenly; a primitive overlapping several cells is tested in each
+class UniformGrid {
+public:
+  GridShape shape;
+  // ranges of cell i are ranges[cellStart[i], cellStart[i + 1])
+  std::vector<uint32_t> cellStart;
+  std::vector<GridRange> ranges;
+
+  bool isEmpty() const { return cellStart.empty(); }
+  AABB bounds() const { return shape.bounds; }
+};
+
+// Coarse uniform grid whose cells are refined by uniform grids of their own,
+// each with a resolution for the primitives in it, so clusters of
+// primitives do not crowd a few cells
+class TwoLevelGrid {
+public:
+  GridShape shape;
+  // top level cell i is refined by cellShapes[i], whose cells are
+  // [firstCell[i], firstCell[i + 1]) of cellStart
+  std::vector<GridShape> cellShapes;
+  std::vector<uint32_t> firstCell;
+  std::vector<uint32_t> cellStart;
+  std::vector<GridRange> ranges;
+
+  bool isEmpty() const { return cellStart.empty(); }
+  AABB bounds() const { return shape.bounds; }
+};
+
+// primitives are indices into primitiveBounds
+UniformGrid buildUniformGrid(std::vector<AABB> const &primitiveBounds,
+                             GridBuildOptions const &options = {});
+TwoLevelGrid buildTwoLevelGrid(std::vector<AABB> const &primitiveBounds,
+                               GridBuildOptions const &options = {});
+
+// the part [tEnter, tExit] of [tMin, tMax] in which the ray is inside the
+// box of shape; invDirection is 1 / ray direction
+bool clip(GridShape const &shape, Ray const &ray,
+          math::Vec3f const &invDirection, float tMin, float tMax,
+          float &tEnter, float &tExit);
+
+// 3D-DDA: visits the cells of shape the ray passes through between tEnter and
+// tExit near to far, as visit(cell, tCellEnter, tCellExit), while visit
+// returns true; [tEnter, tExit] has to lie within the grid (see clip)
+template <typename Visit>
+void walkCells(GridShape const &shape, Ray const &ray,
+               math::Vec3f const &invDirection, float tEnter, float tExit,
+               Visit visit);
+
+// Closest hit and any hit traversal, the same as for BVH with the same leaf
+// callbacks (see closestHit and anyHit in bvh.hpp); the closest hit stops
+// at the first cell that ends behind the closest hit found
+template <typename LeafIntersect>
+Hit closestHit(UniformGrid const &grid, Ray const &ray,
+               LeafIntersect intersectLeaf);
+template <typename LeafIntersect>
+Hit closestHit(TwoLevelGrid const &grid, Ray const &ray,
+               LeafIntersect intersectLeaf);
+
+template <typename LeafOccluded>
+bool anyHit(UniformGrid const &grid, Ray const &ray,
+            LeafOccluded occludedLeaf);
+template <typename LeafOccluded>
+bool anyHit(TwoLevelGrid const &grid, Ray const &ray,
+            LeafOccluded occludedLeaf);
+
+} // namespace geometry
+
+#include "uniform_grid.tpp"
@@ -0,0 +1,190 @@
+namespace geometry {
+
+template <typename Visit>
+void walkCells(GridShape const &shape, Ray const &ray,
+               math::Vec3f const &invDirection, float tEnter, float tExit,
+               Visit visit) {
+  float const infinity = std::numeric_limits<float>::infinity();
+  math::Vec3f const start = evaluate(ray, tEnter);
+
+  int32_t const stride[3] = {1, shape.resolution[0],
+                             shape.resolution[0] * shape.resolution[1]};
+  int32_t cell[3], step[3], end[3];
+  float tNext[3], tDelta[3]; // next cell boundary per axis, and between two
+  for (int axis = 0; axis < 3; ++axis) {
+    float direction = axisComponent(ray.direction, axis);
+    float inv = axisComponent(invDirection, axis);
+    float min = axisComponent(shape.bounds.min, axis);
+    float origin = axisComponent(ray.origin, axis);
+    float size = axisComponent(shape.cellSize, axis);
+
+    cell[axis] = shape.cellOf(axisComponent(start, axis), axis);
+    if (direction > 0.f) {
+      step[axis] = 1;
+      end[axis] = shape.resolution[axis];
+      tNext[axis] = (min + float(cell[axis] + 1) * size - origin) * inv;
+      tDelta[axis] = size * inv;
+    } else if (direction < 0.f) {
+      step[axis] = -1;
+      end[axis] = -1;
+      tNext[axis] = (min + float(cell[axis]) * size - origin) * inv;
+      tDelta[axis] = -size * inv;
+    } else {
+      step[axis] = 0;
+      end[axis] = -1;
+      tNext[axis] = infinity;
+      tDelta[axis] = infinity;
+    }
+  }
+
+  // the index follows the cell along
+  auto index = int32_t(shape.cellIndex(cell[0], cell[1], cell[2]));
+  for (;;) {
+    int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2)
+                                   : (tNext[1] < tNext[2] ? 1 : 2);
+    float tCellExit = std::min(tNext[axis], tExit);
+    if (!visit(uint32_t(index), tEnter, tCellExit) || tCellExit >= tExit)
+      return;
+
+    cell[axis] += step[axis];
+    if (cell[axis] == end[axis])
+      return;
+    index += step[axis] * stride[axis];
+    tEnter = tCellExit;
+    tNext[axis] += tDelta[axis];
+  }
+}
+
+template <typename LeafIntersect>
+Hit closestHit(UniformGrid const &grid, Ray const &ray,
+               LeafIntersect intersectLeaf) {
+  Hit closest;
+  closest.rayDepth = ray.tMax;
+
+  math::Vec3f invDirection(1.f / ray.direction.x, //
+                           1.f / ray.direction.y, //
+                           1.f / ray.direction.z);
+
+  float tEnter, tExit;
+  if (grid.isEmpty() || !clip(grid.shape, ray, invDirection, ray.tMin,
+                              ray.tMax, tEnter, tExit))
+    return closest;
+
+  walkCells(grid.shape, ray, invDirection, tEnter, tExit,
+            [&](uint32_t cell, float, float tCellExit) {
+              for (uint32_t i = grid.cellStart[cell];
+                   i < grid.cellStart[cell + 1]; ++i)
+                intersectLeaf(grid.ranges[i].first, grid.ranges[i].count,
+                              closest);
+              // hits in later cells are further away
+              return closest.rayDepth > tCellExit;
+            });
+
+  return closest;
+}
+
+template <typename LeafIntersect>
+Hit closestHit(TwoLevelGrid const &grid, Ray const &ray,
+               LeafIntersect intersectLeaf) {
+  Hit closest;
+  closest.rayDepth = ray.tMax;
+
+  math::Vec3f invDirection(1.f / ray.direction.x, //
+                           1.f / ray.direction.y, //
+                           1.f / ray.direction.z);
+
+  float tEnter, tExit;
+  if (grid.isEmpty() || !clip(grid.shape, ray, invDirection, ray.tMin,
+                              ray.tMax, tEnter, tExit))
+    return closest;
+
+  walkCells(
+      grid.shape, ray, invDirection, tEnter, tExit,
+      [&](uint32_t topCell, float tTopEnter, float tTopExit) {
+        uint32_t const first = grid.firstCell[topCell];
+        uint32_t const last = grid.firstCell[topCell + 1];
+        if (grid.cellStart[first] == grid.cellStart[last])
+          return true;
+
+        auto intersectCell = [&](uint32_t cell, float, float tCellExit) {
+          for (uint32_t i = grid.cellStart[first + cell];
+               i < grid.cellStart[first + cell + 1]; ++i)
+            intersectLeaf(grid.ranges[i].first, grid.ranges[i].count,
+                          closest);
+          return closest.rayDepth > tCellExit;
+        };
+
+        // a cell that is not refined needs no walk
+        if (last - first == 1)
+          return intersectCell(0, tTopEnter, tTopExit);
+        walkCells(grid.cellShapes[topCell], ray, invDirection, tTopEnter,
+                  tTopExit, intersectCell);
+        return closest.rayDepth > tTopExit;
+      });
+
+  return closest;
+}
+
+template <typename LeafOccluded>
+bool anyHit(UniformGrid const &grid, Ray const &ray,
+            LeafOccluded occludedLeaf) {
+  math::Vec3f invDirection(1.f / ray.direction.x, //
+                           1.f / ray.direction.y, //
+                           1.f / ray.direction.z);
+
+  float tEnter, tExit;
+  if (grid.isEmpty() || !clip(grid.shape, ray, invDirection, ray.tMin,
+                              ray.tMax, tEnter, tExit))
+    return false;
+
+  bool hit = false;
+  walkCells(grid.shape, ray, invDirection, tEnter, tExit,
+            [&](uint32_t cell, float, float) {
+              for (uint32_t i = grid.cellStart[cell];
+                   i < grid.cellStart[cell + 1] && !hit; ++i)
+                hit = occludedLeaf(grid.ranges[i].first, grid.ranges[i].count);
+              return !hit;
+            });
+
+  return hit;
+}
+
+template <typename LeafOccluded>
+bool anyHit(TwoLevelGrid const &grid, Ray const &ray,
+            LeafOccluded occludedLeaf) {
+  math::Vec3f invDirection(1.f / ray.direction.x, //
+                           1.f / ray.direction.y, //
+                           1.f / ray.direction.z);
+
+  float tEnter, tExit;
+  if (grid.isEmpty() || !clip(grid.shape, ray, invDirection, ray.tMin,
+                              ray.tMax, tEnter, tExit))
+    return false;
+
+  bool hit = false;
+  walkCells(
+      grid.shape, ray, invDirection, tEnter, tExit,
+      [&](uint32_t topCell, float tTopEnter, float tTopExit) {
+        uint32_t const first = grid.firstCell[topCell];
+        uint32_t const last = grid.firstCell[topCell + 1];
+        if (grid.cellStart[first] == grid.cellStart[last])
+          return true;
+
+        auto occludedCell = [&](uint32_t cell, float, float) {
+          for (uint32_t i = grid.cellStart[first + cell];
+               i < grid.cellStart[first + cell + 1] && !hit; ++i)
+            hit = occludedLeaf(grid.ranges[i].first, grid.ranges[i].count);
+          return !hit;
+        };
+
+        if (last - first == 1)
+          return occludedCell(0, tTopEnter, tTopExit);
+        walkCells(grid.cellShapes[topCell], ray, invDirection, tTopEnter,
+                  tTopExit, occludedCell);
+        return !hit;
+      });
+
+  return hit;
+}
+
+} // namespace geometry
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cmath>
 #include <iosfwd>
 
 namespace math {
@@ -10,7 +11,7 @@ struct Vec2f {
   float y = 0.f;
 
   Vec2f() = default;
-  Vec2f(float x, float y);
+  constexpr Vec2f(float x, float y);
 
   /*
    * Mutating member functions
@@ -31,26 +32,121 @@ struct Vec2f {
 };
 
 // Free function declarations
-Vec2f operator+(Vec2f const &a, Vec2f const &b);
-Vec2f operator-(Vec2f const &a, Vec2f const &b);
-Vec2f operator*(float s, Vec2f v);
-Vec2f operator*(Vec2f v, float s);
-Vec2f operator/(Vec2f v, float s);
-Vec2f operator-(Vec2f v);
+constexpr Vec2f operator+(Vec2f const &a, Vec2f const &b);
+constexpr Vec2f operator-(Vec2f const &a, Vec2f const &b);
+constexpr Vec2f operator*(float s, Vec2f const &v);
+constexpr Vec2f operator*(Vec2f const &v, float s);
+constexpr Vec2f operator/(Vec2f const &v, float s);
+constexpr Vec2f operator-(Vec2f const &v);
 
-float operator*(Vec2f const &a, Vec2f const &b);
-float dot(Vec2f const &a, Vec2f const &b);
+constexpr float operator*(Vec2f const &a, Vec2f const &b);
+constexpr float dot(Vec2f const &a, Vec2f const &b);
 
 float norm(Vec2f const &v);
-float normSquared(Vec2f const &v);
+constexpr float normSquared(Vec2f const &v);
 Vec2f normalized(Vec2f v);
 
 // Linear interpolation from a to b by t
-Vec2f lerp(Vec2f const &a, Vec2f const &b, float t);
+constexpr Vec2f lerp(Vec2f const &a, Vec2f const &b, float t);
 float distance(Vec2f const &a, Vec2f const &b);
-float distanceSquared(Vec2f const &a, Vec2f const &b);
+constexpr float distanceSquared(Vec2f const &a, Vec2f const &b);
 
 std::istream &operator>>(std::istream &in, Vec2f &v);
 std::ostream &operator<<(std::ostream &out, Vec2f const &v);
 
+/*
+ * Inline definitions, see vec3f.hpp
+ */
+
+constexpr Vec2f::Vec2f(float x, float y) : x(x), y(y) {}
+
+inline Vec2f &Vec2f::operator+=(Vec2f const &rhs) {
+  return *this = *this + rhs;
+}
+inline Vec2f &Vec2f::operator-=(Vec2f const &rhs) {
+  return *this = *this - rhs;
+}
+
+inline Vec2f &Vec2f::operator*=(float rhs) { return *this = *this * rhs; }
+
+inline Vec2f &Vec2f::operator/=(float rhs) { return *this = *this / rhs; }
+
+inline Vec2f &Vec2f::normalize() {
+  float l = norm(*this);
+  return (*this) /= l;
+}
+
+inline void Vec2f::zero() { *this = Vec2f(); }
+
+inline float const *Vec2f::data() const {
+  return &x; // warning!!!!! this is quite dangerous
+}
+
+inline float *Vec2f::data() {
+  return &x; // warning!!!!! this is quite dangerous
+}
+
+/*
+ * Vector-Vector Addition/ Subtraction
+ */
+constexpr Vec2f operator+(Vec2f const &a, Vec2f const &b) {
+  return Vec2f(a.x + b.x, a.y + b.y);
+}
+constexpr Vec2f operator-(Vec2f const &a, Vec2f const &b) {
+  return Vec2f(a.x - b.x, a.y - b.y);
+}
+
+/*
+ * Scalar-Vector Multiplication/Division
+ */
+constexpr Vec2f operator*(float s, Vec2f const &v) {
+  return Vec2f(v.x * s, v.y * s);
+}
+constexpr Vec2f operator*(Vec2f const &v, float s) { return s * v; }
+
+constexpr Vec2f operator/(Vec2f const &v, float s) {
+  return Vec2f(v.x / s, v.y / s);
+}
+
+/*
+ * Negation of vector
+ * -v = (-1.f) * v
+ */
+constexpr Vec2f operator-(Vec2f const &v) { return Vec2f(-v.x, -v.y); }
+
+/*
+ * Vector-Vector (inner/dot) product
+ */
+constexpr float operator*(Vec2f const &a, Vec2f const &b) {
+  return a.x * b.x + a.y * b.y;
+}
+constexpr float dot(Vec2f const &a, Vec2f const &b) { return a * b; }
+
+/*
+ * Vector norm (length)
+ */
+inline float norm(Vec2f const &v) { return std::sqrt(v * v); }
+constexpr float normSquared(Vec2f const &v) { return v * v; }
+
+/*
+ * Normalized Vector
+ */
+inline Vec2f normalized(Vec2f v) {
+  float l = norm(v);
+  return v /= l;
+}
+
+inline float distance(Vec2f const &a, Vec2f const &b) { return norm(a - b); }
+
+constexpr float distanceSquared(Vec2f const &a, Vec2f const &b) {
+  return normSquared(a - b);
+}
+
+/*
+ * Linear interpolation
+ */
+constexpr Vec2f lerp(Vec2f const &a, Vec2f const &b, float t) {
+  return (1.f - t) * a + t * b;
+}
+
 } // namespace math
@@ -1,17 +1,39 @@
 #pragma once
 
+#include <cmath>
 #include <iosfwd>
 
+#ifdef MATH_SIMD
+#include <emmintrin.h>
+#endif
+
+// The arithmetic is defined inline at the end of this file so it can be
+// inlined into the intersection and shading loops. Building with MATH_SIMD
+// pads Vec3f to 16 bytes and does the componentwise operations with SSE,
+// otherwise they are plain constexpr functions.
+#ifdef MATH_SIMD
+#define MATH_CONSTEXPR inline
+#else
+#define MATH_CONSTEXPR constexpr
+#endif
+
 namespace math {
 
 // struct declaration
+#ifdef MATH_SIMD
+struct alignas(16) Vec3f {
+#else
 struct Vec3f {
+#endif
   float x = 0.f;
   float y = 0.f;
   float z = 0.f;
+#ifdef MATH_SIMD
+  float padding = 0.f; // fills the SSE register, not part of the vector
+#endif
 
   Vec3f() = default;
-  Vec3f(float x, float y, float z);
+  constexpr Vec3f(float x, float y, float z);
 
   /*
    * Mutating member functions
@@ -32,21 +54,21 @@ struct Vec3f {
 };
 
 // Free function declarations
-Vec3f operator+(Vec3f const &a, Vec3f const &b);
-Vec3f operator-(Vec3f const &a, Vec3f const &b);
-Vec3f operator*(float s, Vec3f v);
-Vec3f operator*(Vec3f v, float s);
-Vec3f operator/(Vec3f v, float s);
-Vec3f operator-(Vec3f v);
+MATH_CONSTEXPR Vec3f operator+(Vec3f const &a, Vec3f const &b);
+MATH_CONSTEXPR Vec3f operator-(Vec3f const &a, Vec3f const &b);
+MATH_CONSTEXPR Vec3f operator*(float s, Vec3f const &v);
+MATH_CONSTEXPR Vec3f operator*(Vec3f const &v, float s);
+MATH_CONSTEXPR Vec3f operator/(Vec3f const &v, float s);
+MATH_CONSTEXPR Vec3f operator-(Vec3f const &v);
 
-float operator*(Vec3f const &a, Vec3f const &b);
-float dot(Vec3f const &a, Vec3f const &b);
+constexpr float operator*(Vec3f const &a, Vec3f const &b);
+constexpr float dot(Vec3f const &a, Vec3f const &b);
 
-Vec3f operator^(Vec3f const &a, Vec3f const &b);
-Vec3f cross(Vec3f const &a, Vec3f const &b);
+constexpr Vec3f operator^(Vec3f const &a, Vec3f const &b);
+constexpr Vec3f cross(Vec3f const &a, Vec3f const &b);
 
 float norm(Vec3f const &v);
-float normSquared(Vec3f const &v);
+constexpr float normSquared(Vec3f const &v);
 Vec3f normalized(Vec3f v);
 
 Vec3f rotateAroundAxis(Vec3f v, Vec3f axis, float angleDegrees);
@@ -54,13 +76,157 @@ Vec3f rotateAroundAxis(Vec3f v, Vec3f axis, float angleDegrees);
 Vec3f rotateAroundNormalizedAxis(Vec3f v, Vec3f const &axis, float angleDegrees);
 
 // Linear interpolation from a to b by t
-Vec3f lerp(Vec3f const &a, Vec3f const &b, float t);
+MATH_CONSTEXPR Vec3f lerp(Vec3f const &a, Vec3f const &b, float t);
 float distance(Vec3f const &a, Vec3f const &b);
-float distanceSquared(Vec3f const &a, Vec3f const &b);
+MATH_CONSTEXPR float distanceSquared(Vec3f const &a, Vec3f const &b);
 
-Vec3f invert(Vec3f v);
+MATH_CONSTEXPR Vec3f invert(Vec3f const &v);
 
 std::istream &operator>>(std::istream &in, Vec3f &v);
 std::ostream &operator<<(std::ostream &out, Vec3f const &v);
 
+/*
+ * Inline definitions
+ */
+
+#ifdef MATH_SIMD
+namespace detail {
+inline __m128 load(Vec3f const &v) { return _mm_load_ps(&v.x); }
+inline Vec3f store(__m128 r) {
+  Vec3f v;
+  _mm_store_ps(&v.x, r);
+  return v;
+}
+} // namespace detail
+#endif
+
+constexpr Vec3f::Vec3f(float x, float y, float z) : x(x), y(y), z(z) {}
+
+inline Vec3f &Vec3f::operator+=(Vec3f const &rhs) {
+  return *this = *this + rhs;
+}
+inline Vec3f &Vec3f::operator-=(Vec3f const &rhs) {
+  return *this = *this - rhs;
+}
+
+inline Vec3f &Vec3f::operator*=(float rhs) { return *this = *this * rhs; }
+
+inline Vec3f &Vec3f::operator/=(float rhs) { return *this = *this / rhs; }
+
+inline Vec3f &Vec3f::normalize() {
+  float l = norm(*this);
+  return (*this) /= l;
+}
+
+inline void Vec3f::zero() { *this = Vec3f(); }
+
+inline float const *Vec3f::data() const {
+  return &x; // warning!!!!! this is quite dangerous
+}
+
+inline float *Vec3f::data() {
+  return &x; // warning!!!!! this is quite dangerous
+}
+
+/*
+ * Vector-Vector Addition/ Subtraction
+ */
+MATH_CONSTEXPR Vec3f operator+(Vec3f const &a, Vec3f const &b) {
+#ifdef MATH_SIMD
+  return detail::store(_mm_add_ps(detail::load(a), detail::load(b)));
+#else
+  return Vec3f(a.x + b.x, a.y + b.y, a.z + b.z);
+#endif
+}
+MATH_CONSTEXPR Vec3f operator-(Vec3f const &a, Vec3f const &b) {
+#ifdef MATH_SIMD
+  return detail::store(_mm_sub_ps(detail::load(a), detail::load(b)));
+#else
+  return Vec3f(a.x - b.x, a.y - b.y, a.z - b.z);
+#endif
+}
+
+/*
+ * Scalar-Vector Multiplication/Division
+ */
+MATH_CONSTEXPR Vec3f operator*(float s, Vec3f const &v) {
+#ifdef MATH_SIMD
+  return detail::store(_mm_mul_ps(detail::load(v), _mm_set1_ps(s)));
+#else
+  return Vec3f(v.x * s, v.y * s, v.z * s);
+#endif
+}
+MATH_CONSTEXPR Vec3f operator*(Vec3f const &v, float s) { return s * v; }
+
+MATH_CONSTEXPR Vec3f operator/(Vec3f const &v, float s) {
+#ifdef MATH_SIMD
+  return detail::store(_mm_div_ps(detail::load(v), _mm_set1_ps(s)));
+#else
+  return Vec3f(v.x / s, v.y / s, v.z / s);
+#endif
+}
+
+/*
+ * Negation of vector
+ * -v = (-1.f) * v
+ */
+MATH_CONSTEXPR Vec3f operator-(Vec3f const &v) {
+#ifdef MATH_SIMD
+  return detail::store(_mm_xor_ps(detail::load(v), _mm_set1_ps(-0.f)));
+#else
+  return Vec3f(-v.x, -v.y, -v.z);
+#endif
+}
+
+/*
+ * Vector-Vector (inner/dot) product
+ * a horizontal SSE sum would change the order of the additions, so it stays
+ * scalar in both builds
+ */
+constexpr float operator*(Vec3f const &a, Vec3f const &b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+constexpr float dot(Vec3f const &a, Vec3f const &b) { return a * b; }
+
+/*
+ * Vector-Vector cross product
+ */
+constexpr Vec3f operator^(Vec3f const &a, Vec3f const &b) {
+  return Vec3f(a.y * b.z - a.z * b.y, //
+               a.z * b.x - a.x * b.z, //
+               a.x * b.y - a.y * b.x);
+}
+constexpr Vec3f cross(Vec3f const &a, Vec3f const &b) { return a ^ b; }
+
+/*
+ * Vector norm (length)
+ */
+inline float norm(Vec3f const &v) { return std::sqrt(normSquared(v)); }
+constexpr float normSquared(Vec3f const &v) {
+  return v.x * v.x + v.y * v.y + v.z * v.z;
+}
+
+/*
+ * Normalized Vector
+ */
+inline Vec3f normalized(Vec3f v) {
+  float l = norm(v);
+  return v /= l;
+}
+
+inline float distance(Vec3f const &a, Vec3f const &b) { return norm(a - b); }
+
+MATH_CONSTEXPR float distanceSquared(Vec3f const &a, Vec3f const &b) {
+  return normSquared(a - b);
+}
+
+/*
+ * Linear interpolation
+ */
+MATH_CONSTEXPR Vec3f lerp(Vec3f const &a, Vec3f const &b, float t) {
+  return (1.f - t) * a + t * b;
+}
+
+MATH_CONSTEXPR Vec3f invert(Vec3f const &v) { return v * -1.f; }
+
 } // namespace math
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "aabb.hpp"
+#include "bvh.hpp"
+#include "ray.hpp"
+#include "ray_intersect.hpp"
+#include "simd.hpp"
+#include "vec3f.hpp"
+
+namespace geometry {
+
+// children of a wide node, one register of them: 4 with SSE2, 8 with AVX2
+constexpr uint32_t wideBVHWidth = simd::laneCount > 1 ? simd::laneCount : 4;
+
+// Node of a WideBVH (52 bytes for 4 children, 80 for 8)
+// the boxes of the children are stored as 8 bit coordinates on a grid over
+// the node's bounds, rounded outwards so they still contain the children;
+// the grid steps are powers of two, so decoding them is exact
+// the children that are nodes follow each other in the array from
+// firstChild, and the primitives of the children that are leaves follow each
+// other in primitiveIndices from firstPrimitive, in the order of the children
+struct WideBVHNode {
+  math::Vec3f origin;   // minimum corner of the node's bounds
+  uint8_t exponent[3];  // grid step per axis, the biased exponent of a float
+  uint8_t childCount;   // children in [0, childCount) are used
+  uint32_t firstChild;
+  uint32_t firstPrimitive;
+  uint8_t count[wideBVHWidth]; // primitives of a leaf, 0 for a node
+  uint8_t lo[3][wideBVHWidth]; // per axis, then per child
+  uint8_t hi[3][wideBVHWidth];
+
+  AABB childBounds(uint32_t i) const;
+};
+
+// BVH collapsed to wideBVHWidth children per node, so one SIMD test
+// intersects a ray with all children of a node, with a fraction of the nodes
+// and about a third of the memory
+// leaves are the leaves of the BVH it was collapsed from, over the same
+// primitiveIndices
+class WideBVH {
+public:
+  std::vector<WideBVHNode> nodes;
+  std::vector<uint32_t> primitiveIndices;
+  AABB rootBounds;
+
+  bool isEmpty() const { return nodes.empty(); }
+  AABB bounds() const { return rootBounds; }
+};
+
+// every node takes the children of its BVH node, then repeatedly the
+// children of its largest interior child in place of it until it has
+// wideBVHWidth of them; leaves of more than 255 primitives are split
+// the leaves of bvh are moved so those of a wide node are next to each
+// other: primitives laid out in leaf order are laid out after collapsing
+WideBVH collapse(BVH &bvh);
+
+// updates the grids of the nodes for primitives that moved, see refit for BVH
+void refit(WideBVH &bvh, std::vector<AABB> const &primitiveBounds);
+
+// the children of node hit by the ray in [tMin, tMax], a bit per child, and
+// where the ray enters each of them
+uint32_t intersectChildren(WideBVHNode const &node, math::Vec3f const &origin,
+                           math::Vec3f const &invDirection, float tMin,
+                           float tMax, float *tNear);
+
+// Closest hit and any hit traversal, the same as for BVH with the same leaf
+// callbacks (see closestHit and anyHit in bvh.hpp)
+template <typename LeafIntersect>
+Hit closestHit(WideBVH const &bvh, Ray const &ray,
+               LeafIntersect intersectLeaf);
+
+template <typename LeafOccluded>
+bool anyHit(WideBVH const &bvh, Ray const &ray, LeafOccluded occludedLeaf);
+
+} // namespace geometry
+
+#include "wide_bvh.tpp"
@@ -0,0 +1,104 @@
+namespace geometry {
+
+template <typename LeafIntersect>
+Hit closestHit(WideBVH const &bvh, Ray const &ray,
+               LeafIntersect intersectLeaf) {
+  Hit closest;
+  closest.rayDepth = ray.tMax;
+
+  if (bvh.isEmpty())
+    return closest;
+
+  math::Vec3f invDirection(1.f / ray.direction.x, //
+                           1.f / ray.direction.y, //
+                           1.f / ray.direction.z);
+
+  struct Entry {
+    uint32_t node;
+    float tNear;
+  };
+
+  // every level adds at most wideBVHWidth - 1 entries and the depth is
+  // bounded by the BVH it was collapsed from
+  Entry stack[64 * wideBVHWidth];
+  int top = 0;
+  stack[top++] = {0, ray.tMin};
+
+  while (top > 0) {
+    Entry entry = stack[--top];
+    if (entry.tNear > closest.rayDepth)
+      continue;
+
+    WideBVHNode const &node = bvh.nodes[entry.node];
+    float tNear[wideBVHWidth];
+    uint32_t hits = intersectChildren(node, ray.origin, invDirection, ray.tMin,
+                                      closest.rayDepth, tNear);
+
+    // leaves are intersected right away, which shortens the ray for the
+    // nodes; those are pushed far to near, so the nearest is popped first
+    int const first = top;
+    uint32_t nextChild = node.firstChild;
+    uint32_t nextPrimitive = node.firstPrimitive;
+    for (uint32_t i = 0; i < node.childCount; ++i) {
+      uint32_t count = node.count[i];
+      if (count > 0) {
+        if (hits & (1u << i))
+          intersectLeaf(nextPrimitive, count, closest);
+        nextPrimitive += count;
+        continue;
+      }
+
+      Entry child = {nextChild++, tNear[i]};
+      if (!(hits & (1u << i)))
+        continue;
+
+      int slot = top++;
+      for (; slot > first && stack[slot - 1].tNear < child.tNear; --slot)
+        stack[slot] = stack[slot - 1];
+      stack[slot] = child;
+    }
+  }
+
+  return closest;
+}
+
+template <typename LeafOccluded>
+bool anyHit(WideBVH const &bvh, Ray const &ray, LeafOccluded occludedLeaf) {
+  if (bvh.isEmpty())
+    return false;
+
+  math::Vec3f invDirection(1.f / ray.direction.x, //
+                           1.f / ray.direction.y, //
+                           1.f / ray.direction.z);
+
+  uint32_t stack[64 * wideBVHWidth];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    WideBVHNode const &node = bvh.nodes[stack[--top]];
+
+    float tNear[wideBVHWidth];
+    uint32_t hits = intersectChildren(node, ray.origin, invDirection, ray.tMin,
+                                      ray.tMax, tNear);
+
+    uint32_t nextChild = node.firstChild;
+    uint32_t nextPrimitive = node.firstPrimitive;
+    for (uint32_t i = 0; i < node.childCount; ++i) {
+      uint32_t count = node.count[i];
+      if (count == 0) {
+        if (hits & (1u << i))
+          stack[top++] = nextChild;
+        ++nextChild;
+      } else {
+        if ((hits & (1u << i)) && occludedLeaf(nextPrimitive, count))
+          return true;
+        nextPrimitive += count;
+      }
+    }
+  }
+
+  return false;
+}
+
+} // namespace geometry
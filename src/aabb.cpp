@@ -0,0 +1,95 @@
+#include "aabb.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace geometry {
+
+namespace {
+constexpr float infinity = std::numeric_limits<float>::infinity();
+
+math::Vec3f minimum(math::Vec3f const &a, math::Vec3f const &b) {
+  return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+}
+
+math::Vec3f maximum(math::Vec3f const &a, math::Vec3f const &b) {
+  return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+}
+} // namespace
+
+AABB::AABB()
+    : min(infinity, infinity, infinity),
+      max(-infinity, -infinity, -infinity) {}
+
+AABB::AABB(math::Vec3f min, math::Vec3f max) : min(min), max(max) {}
+
+AABB merge(AABB const &a, AABB const &b) {
+  return {minimum(a.min, b.min), maximum(a.max, b.max)};
+}
+
+AABB merge(AABB const &box, math::Vec3f const &point) {
+  return {minimum(box.min, point), maximum(box.max, point)};
+}
+
+math::Vec3f centroid(AABB const &box) { return 0.5f * (box.min + box.max); }
+
+math::Vec3f extent(AABB const &box) { return box.max - box.min; }
+
+float surfaceArea(AABB const &box) {
+  if (isEmpty(box))
+    return 0.f;
+
+  auto d = extent(box);
+  return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+bool isEmpty(AABB const &box) {
+  return box.min.x > box.max.x || box.min.y > box.max.y ||
+         box.min.z > box.max.z;
+}
+
+bool isFinite(AABB const &box) {
+  return std::isfinite(box.min.x) && std::isfinite(box.min.y) &&
+         std::isfinite(box.min.z) && std::isfinite(box.max.x) &&
+         std::isfinite(box.max.y) && std::isfinite(box.max.z);
+}
+
+float axisComponent(math::Vec3f const &v, int axis) {
+  return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+AABB bounds(Sphere const &sphere) {
+  math::Vec3f r(sphere.radius, sphere.radius, sphere.radius);
+  return {sphere.origin - r, sphere.origin + r};
+}
+
+AABB bounds(Triangle const &triangle) {
+  return merge(AABB(triangle.a(), triangle.a()),
+               merge(AABB(triangle.b(), triangle.b()), triangle.c()));
+}
+
+AABB bounds(Plane const &) {
+  return {math::Vec3f(-infinity, -infinity, -infinity),
+          math::Vec3f(infinity, infinity, infinity)};
+}
+
+bool intersect(AABB const &box, math::Vec3f const &origin,
+               math::Vec3f const &invDirection, float tMin, float tMax,
+               float &tNear) {
+  float t0x = (box.min.x - origin.x) * invDirection.x;
+  float t1x = (box.max.x - origin.x) * invDirection.x;
+  float t0y = (box.min.y - origin.y) * invDirection.y;
+  float t1y = (box.max.y - origin.y) * invDirection.y;
+  float t0z = (box.min.z - origin.z) * invDirection.z;
+  float t1z = (box.max.z - origin.z) * invDirection.z;
+
+  float tEnter = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)),
+                          std::max(std::min(t0z, t1z), tMin));
+  float tExit = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)),
+                         std::min(std::max(t0z, t1z), tMax));
+
+  tNear = tEnter;
+  return tEnter <= tExit;
+}
+
+} // namespace geometry
@@ -0,0 +1,1628 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "common_matrices.hpp"
+#include "mat3f.hpp"
+#include "mesh_cache.hpp"
+#include "obj_mesh_file_io.hpp"
+#include "random.hpp"
+#include "ray.hpp"
+#include "ray_intersect.hpp"
+#include "ray_packet.hpp"
+#include "ray_queue.hpp"
+#include "scene.hpp"
+#include "simd_intersect.hpp"
+#include "timer.hpp"
+#include "tonemap.hpp"
+#include "triangle.hpp"
+#include "uniform_grid.hpp"
+#include "wide_bvh.hpp"
+
+using namespace math;
+using namespace geometry;
+using namespace raytracing;
+
+// keeps the reference math below out of line, the way it was compiled when
+// it lived in its own translation unit
+#if defined(_MSC_VER)
+#define BENCHMARK_NOINLINE __declspec(noinline)
+#else
+#define BENCHMARK_NOINLINE __attribute__((noinline))
+#endif
+
+namespace benchmark {
+
+namespace {
+
+using nanoseconds_t = std::chrono::nanoseconds;
+
+// result of running a kernel over every ray/primitive pair
+struct Result {
+  uint64_t nanoseconds = 0;
+  uint64_t tests = 0;
+  uint64_t hits = 0;
+  double depthSum = 0.0; // keeps the work observable
+};
+
+void report(char const *name, Result const &result) {
+  double nsPerTest = double(result.nanoseconds) / double(result.tests);
+  std::cout << "  " << name << ": " << nsPerTest << " ns/test, "
+            << 1e3 / nsPerTest << " Mtests/s, " << result.hits << " hits\n";
+}
+
+template <typename Primitive, typename Kernel>
+Result timeIntersections(std::vector<Ray> const &rays,
+                         std::vector<Primitive> const &primitives,
+                         Kernel kernel) {
+  Result result;
+  temporal::Timer timer(true);
+
+  for (auto const &ray : rays) {
+    for (auto const &primitive : primitives) {
+      auto hit = kernel(ray, primitive);
+      if (hit) {
+        ++result.hits;
+        result.depthSum += hit.rayDepth;
+      }
+    }
+  }
+
+  result.nanoseconds = timer.elapsed<nanoseconds_t>();
+  result.tests = uint64_t(rays.size()) * primitives.size();
+  return result;
+}
+
+// random rays from around the origin towards a box of random triangles
+std::vector<Ray> randomRays(size_t count, std::mt19937 &gen) {
+  std::uniform_real_distribution<float> offset(-1.f, 1.f);
+  std::vector<Ray> rays;
+  rays.reserve(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    Vec3f origin(offset(gen), offset(gen), 10.f + offset(gen));
+    Vec3f target(5.f * offset(gen), 5.f * offset(gen), 5.f * offset(gen));
+    rays.emplace_back(origin, normalized(target - origin));
+  }
+  return rays;
+}
+
+std::vector<Triangle> randomTriangles(size_t count, std::mt19937 &gen) {
+  std::uniform_real_distribution<float> position(-5.f, 5.f);
+  std::uniform_real_distribution<float> offset(-1.f, 1.f);
+  std::vector<Triangle> triangles;
+  triangles.reserve(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    Vec3f a(position(gen), position(gen), position(gen));
+    triangles.emplace_back(a, a + Vec3f(offset(gen), offset(gen), offset(gen)),
+                           a + Vec3f(offset(gen), offset(gen), offset(gen)));
+  }
+  return triangles;
+}
+
+// the original triangle test, solving for t, beta and gamma with Cramer's
+// rule, kept as the reference for the precomputed kernel
+Hit intersectCramer(Ray const &ray, Triangle const &triangle) {
+  Hit hit;
+
+  Mat3f A = Mat3f{triangle.a().x - triangle.b().x, triangle.a().x - triangle.c().x, ray.direction.x,
+                  triangle.a().y - triangle.b().y, triangle.a().y - triangle.c().y, ray.direction.y,
+                  triangle.a().z - triangle.b().z, triangle.a().z - triangle.c().z, ray.direction.z};
+  float determinantA = determinant(A);
+
+  Mat3f gammaMatrix = Mat3f{triangle.a().x - triangle.b().x, triangle.a().x - ray.origin.x, ray.direction.x,
+                            triangle.a().y - triangle.b().y, triangle.a().y - ray.origin.y, ray.direction.y,
+                            triangle.a().z - triangle.b().z, triangle.a().z - ray.origin.z, ray.direction.z};
+  float gamma = determinant(gammaMatrix) / determinantA;
+
+  Mat3f betaMatrix = Mat3f{triangle.a().x - ray.origin.x, triangle.a().x - triangle.c().x, ray.direction.x,
+                           triangle.a().y - ray.origin.y, triangle.a().y - triangle.c().y, ray.direction.y,
+                           triangle.a().z - ray.origin.z, triangle.a().z - triangle.c().z, ray.direction.z};
+  float beta = determinant(betaMatrix) / determinantA;
+
+  Mat3f tMatrix = Mat3f{triangle.a().x - triangle.b().x, triangle.a().x - triangle.c().x, triangle.a().x - ray.origin.x,
+                        triangle.a().y - triangle.b().y, triangle.a().y - triangle.c().y, triangle.a().y - ray.origin.y,
+                        triangle.a().z - triangle.b().z, triangle.a().z - triangle.c().z, triangle.a().z - ray.origin.z};
+  float tResult = determinant(tMatrix) / determinantA;
+
+  if (!inInterval(ray, tResult))
+    return hit;
+  if (gamma < 0 || gamma > 1)
+    return hit;
+  if (beta < 0 || beta > (1 - gamma))
+    return hit;
+
+  hit.didIntersect = true;
+  hit.rayDepth = tResult;
+  return hit;
+}
+
+void triangleIntersection() {
+  std::mt19937 gen(0);
+  auto rays = randomRays(1 << 10, gen);
+  auto triangles = randomTriangles(1 << 12, gen);
+
+  std::vector<PrecomputedTriangle> precomputed;
+  precomputed.reserve(triangles.size());
+  for (auto const &t : triangles)
+    precomputed.push_back(precompute(t));
+
+  std::cout << "triangle intersection, " << rays.size() << " rays x "
+            << triangles.size() << " triangles\n";
+
+  report("cramer (Mat3f determinants)",
+         timeIntersections(rays, triangles,
+                           [](Ray const &r, Triangle const &t) {
+                             return intersectCramer(r, t);
+                           }));
+  report("moller-trumbore (edges per test)",
+         timeIntersections(rays, triangles,
+                           [](Ray const &r, Triangle const &t) {
+                             return intersect(r, t);
+                           }));
+  report("moller-trumbore (precomputed)",
+         timeIntersections(rays, precomputed,
+                           [](Ray const &r, PrecomputedTriangle const &t) {
+                             return intersect(r, t);
+                           }));
+}
+
+std::vector<Sphere> randomSpheres(size_t count, std::mt19937 &gen) {
+  std::uniform_real_distribution<float> position(-5.f, 5.f);
+  std::uniform_real_distribution<float> radius(0.05f, 0.5f);
+  std::vector<Sphere> spheres;
+  spheres.reserve(count);
+
+  for (size_t i = 0; i < count; ++i)
+    spheres.emplace_back(Vec3f(position(gen), position(gen), position(gen)),
+                         radius(gen));
+  return spheres;
+}
+
+// the original polymorphic surfaces castRay looped over, one heap
+// allocation and three virtual calls per surface, kept as the reference
+// for the type sorted Scene storage
+struct Surface {
+  virtual ~Surface() = default;
+  virtual Hit intersectSelf(Ray const &ray) const = 0;
+  virtual Vec3f normalAtSelf(Vec3f const &p) const = 0;
+  virtual Vec3f colour() const = 0;
+};
+
+Vec3f normalAt(Vec3f const &p, Sphere const &s) {
+  return normalized((p - s.origin) / s.radius);
+}
+
+Vec3f normalAt(Vec3f const &, Triangle const &t) { return normal(t); }
+
+template <class T> struct Intersect_ : public Surface {
+  explicit Intersect_(T const &t) : m_self(t) {}
+
+  Hit intersectSelf(Ray const &ray) const { return intersect(ray, m_self); }
+  Vec3f normalAtSelf(Vec3f const &p) const { return normalAt(p, m_self); }
+  Vec3f colour() const { return m_self.colour; }
+
+  T m_self;
+};
+
+template <typename T> std::unique_ptr<Surface> makeIntersectable(T t) {
+  return std::unique_ptr<Surface>(new Intersect_<T>(t));
+}
+
+// flat loops over every primitive, so the layout and dispatch are measured
+// rather than the acceleration structure
+void surfaceStorage() {
+  std::mt19937 gen(0);
+  auto rays = randomRays(1 << 12, gen);
+  auto spheres = randomSpheres(1 << 10, gen);
+  auto triangles = randomTriangles(1 << 10, gen);
+
+  std::vector<std::unique_ptr<Surface>> surfaces;
+  SceneDescription description;
+  // interleaved like a scene file would list them
+  for (size_t i = 0; i < spheres.size(); ++i) {
+    surfaces.push_back(makeIntersectable(spheres[i]));
+    surfaces.push_back(makeIntersectable(triangles[i]));
+    description.spheres.push_back(spheres[i]);
+    description.triangles.push_back(triangles[i]);
+  }
+  auto scene = buildScene(description);
+
+  std::cout << "surface storage, " << rays.size() << " rays x "
+            << surfaces.size() << " primitives (flat loops)\n";
+
+  Result virtualResult;
+  Vec3f shading;
+  temporal::Timer timer(true);
+  for (auto const &ray : rays) {
+    Hit closest;
+    Surface const *surface = nullptr;
+    for (auto const &s : surfaces) {
+      auto hit = s->intersectSelf(ray);
+      if (hit && hit.rayDepth < closest.rayDepth) {
+        closest = hit;
+        surface = s.get();
+      }
+    }
+    if (surface != nullptr) {
+      ++virtualResult.hits;
+      virtualResult.depthSum += closest.rayDepth;
+      auto p = evaluate(ray, closest.rayDepth);
+      shading += surface->normalAtSelf(p) + surface->colour();
+    }
+  }
+  virtualResult.nanoseconds = timer.elapsed<nanoseconds_t>();
+  virtualResult.tests = uint64_t(rays.size()) * surfaces.size();
+
+  Result sceneResult;
+  timer.reset();
+  for (auto const &ray : rays) {
+    SceneHit closest;
+    uint32_t index = 0;
+    intersectSpheres(scene.spheres, 0, scene.spheres.size(), ray,
+                     closest.hit, index);
+    if (closest) {
+      closest.type = PrimitiveType::SPHERE;
+      closest.primitive = index;
+    }
+    auto sphereDepth = closest.hit.rayDepth;
+    intersectTriangles(scene.triangles, 0, scene.triangles.size(), ray,
+                       closest.hit, index);
+    if (closest.hit.rayDepth < sphereDepth) {
+      closest.type = PrimitiveType::TRIANGLE;
+      closest.primitive = index;
+    }
+    if (closest) {
+      ++sceneResult.hits;
+      sceneResult.depthSum += closest.hit.rayDepth;
+      evaluateSurface(closest, ray, scene);
+      shading += closest.normal + colourAt(closest, scene);
+    }
+  }
+  sceneResult.nanoseconds = timer.elapsed<nanoseconds_t>();
+  sceneResult.tests = uint64_t(rays.size()) * surfaces.size();
+
+  report("Surface hierarchy (virtual calls)", virtualResult);
+  report("Scene (per type arrays)", sceneResult);
+  std::cout << "  checksum " << shading << '\n';
+}
+
+// one ray against every primitive, scalar loops against laneCount wide ones
+void simdKernels() {
+  std::mt19937 gen(0);
+  auto rays = randomRays(1 << 12, gen);
+
+  SceneDescription description;
+  description.spheres = randomSpheres(1 << 10, gen);
+  description.triangles = randomTriangles(1 << 10, gen);
+  auto scene = buildScene(description);
+
+  std::cout << "SIMD kernels (" << simd::laneCount << " lanes), "
+            << rays.size() << " rays x " << scene.spheres.size()
+            << " spheres / " << scene.triangles.size() << " triangles\n";
+
+  using Kernel = void (*)(Spheres const &, uint32_t, uint32_t, Ray const &,
+                          Hit &, uint32_t &);
+  auto timeSpheres = [&](Kernel kernel) {
+    Result result;
+    temporal::Timer timer(true);
+    for (auto const &ray : rays) {
+      Hit closest;
+      uint32_t index = 0;
+      kernel(scene.spheres, 0, scene.spheres.size(), ray, closest, index);
+      if (closest) {
+        ++result.hits;
+        result.depthSum += closest.rayDepth + index;
+      }
+    }
+    result.nanoseconds = timer.elapsed<nanoseconds_t>();
+    result.tests = uint64_t(rays.size()) * scene.spheres.size();
+    return result;
+  };
+
+  using TriangleKernel = void (*)(Triangles const &, uint32_t, uint32_t,
+                                  Ray const &, Hit &, uint32_t &);
+  auto timeTriangles = [&](TriangleKernel kernel) {
+    Result result;
+    temporal::Timer timer(true);
+    for (auto const &ray : rays) {
+      Hit closest;
+      uint32_t index = 0;
+      kernel(scene.triangles, 0, scene.triangles.size(), ray, closest, index);
+      if (closest) {
+        ++result.hits;
+        result.depthSum += closest.rayDepth + index;
+      }
+    }
+    result.nanoseconds = timer.elapsed<nanoseconds_t>();
+    result.tests = uint64_t(rays.size()) * scene.triangles.size();
+    return result;
+  };
+
+  auto scalarSpheres = timeSpheres(intersectSpheres);
+  auto simdSpheres = timeSpheres(intersectSpheresSIMD);
+  auto scalarTriangles = timeTriangles(intersectTriangles);
+  auto simdTriangles = timeTriangles(intersectTrianglesSIMD);
+
+  report("spheres scalar", scalarSpheres);
+  report("spheres SIMD", simdSpheres);
+  report("triangles scalar", scalarTriangles);
+  report("triangles SIMD", simdTriangles);
+
+  if (scalarSpheres.depthSum != simdSpheres.depthSum ||
+      scalarTriangles.depthSum != simdTriangles.depthSum)
+    std::cout << "  [Warning] SIMD and scalar closest hits differ\n";
+}
+
+// primary rays of a pinhole camera, in rows of width, and the shadow rays of
+// their hits towards a point light, traced one by one and as packets of
+// neighbouring pixels
+void rayPackets() {
+  std::mt19937 gen(0);
+  SceneDescription description;
+  description.spheres = randomSpheres(1 << 14, gen);
+  description.triangles = randomTriangles(1 << 14, gen);
+  auto scene = buildScene(description);
+
+  constexpr int32_t width = 512;
+  Vec3f const eye(0.f, 0.f, 15.f);
+  Vec3f const light(20.f, 15.f, 10.f);
+
+  std::vector<Ray> primary;
+  primary.reserve(width * width);
+  for (int32_t y = 0; y < width; ++y) {
+    for (int32_t x = 0; x < width; ++x) {
+      Vec3f target(12.f * (x + 0.5f) / width - 6.f,
+                   12.f * (y + 0.5f) / width - 6.f, 0.f);
+      primary.emplace_back(eye, normalized(target - eye));
+    }
+  }
+
+  std::cout << "ray packets, " << primary.size() << " primary rays, "
+            << scene.spheres.size() << " spheres / " << scene.triangles.size()
+            << " triangles\n";
+
+  // reference hits and the shadow rays they cast
+  std::vector<SceneHit> reference(primary.size());
+  std::vector<Ray> shadows(primary.size());
+  std::vector<bool> referenceShadowed(primary.size());
+  {
+    temporal::Timer timer(true);
+    uint64_t rays = 0;
+    for (size_t i = 0; i < primary.size(); ++i) {
+      reference[i] = intersect(primary[i], scene);
+      ++rays;
+      if (!reference[i])
+        continue;
+      Vec3f p = evaluate(primary[i], reference[i].hit.rayDepth);
+      Vec3f direction = normalized(light - p);
+      shadows[i] = Ray(p, direction, surfaceEpsilon, distance(light, p));
+      referenceShadowed[i] = bool(intersect(shadows[i], scene));
+      ++rays;
+    }
+    double ns = double(timer.elapsed<nanoseconds_t>());
+    std::cout << "  single rays: " << 1e3 * rays / ns << " Mrays/s\n";
+  }
+
+  for (int32_t size : {4, 8, 16}) {
+    int32_t blockWidth = size == 4 ? 2 : 4;
+    int32_t blockHeight = size / blockWidth;
+
+    temporal::Timer timer(true);
+    uint64_t rays = 0;
+    uint64_t mismatches = 0;
+    for (int32_t by = 0; by < width; by += blockHeight) {
+      for (int32_t bx = 0; bx < width; bx += blockWidth) {
+        RayPacket packet;
+        uint32_t pixels[maxPacketSize];
+        for (int32_t y = by; y < by + blockHeight; ++y) {
+          for (int32_t x = bx; x < bx + blockWidth; ++x) {
+            pixels[packet.size] = uint32_t(y * width + x);
+            append(packet, primary[y * width + x]);
+          }
+        }
+
+        SceneHit hits[maxPacketSize];
+        intersect(packet, scene, hits);
+        rays += packet.size;
+
+        RayPacket shadowPacket;
+        uint32_t shadowOf[maxPacketSize];
+        for (uint32_t i = 0; i < packet.size; ++i) {
+          if (hits[i]) {
+            shadowOf[shadowPacket.size] = pixels[i];
+            append(shadowPacket, shadows[pixels[i]]);
+          }
+        }
+
+        SceneHit shadowHits[maxPacketSize];
+        intersect(shadowPacket, scene, shadowHits);
+        rays += shadowPacket.size;
+
+        for (uint32_t i = 0; i < packet.size; ++i) {
+          auto const &expected = reference[pixels[i]];
+          if (bool(hits[i]) != bool(expected) ||
+              hits[i].hit.rayDepth != expected.hit.rayDepth ||
+              hits[i].primitive != expected.primitive)
+            ++mismatches;
+        }
+        for (uint32_t i = 0; i < shadowPacket.size; ++i)
+          if (bool(shadowHits[i]) != referenceShadowed[shadowOf[i]])
+            ++mismatches;
+      }
+    }
+    double ns = double(timer.elapsed<nanoseconds_t>());
+    std::cout << "  packets of " << size << ": " << 1e3 * rays / ns
+              << " Mrays/s\n";
+    if (mismatches > 0)
+      std::cout << "  [Warning] " << mismatches
+                << " packet hits differ from single rays\n";
+  }
+}
+
+// shadow rays from the visible points of a random scene towards a point
+// light, as closest hit queries and as occlusion queries
+void shadowRays() {
+  std::mt19937 gen(0);
+  SceneDescription description;
+  description.spheres = randomSpheres(1 << 14, gen);
+  description.triangles = randomTriangles(1 << 14, gen);
+  auto scene = buildScene(description);
+
+  constexpr int32_t width = 512;
+  Vec3f const eye(0.f, 0.f, 15.f);
+  Vec3f const light(20.f, 15.f, 10.f);
+
+  std::vector<Ray> shadows;
+  for (int32_t y = 0; y < width; ++y) {
+    for (int32_t x = 0; x < width; ++x) {
+      Vec3f target(12.f * (x + 0.5f) / width - 6.f,
+                   12.f * (y + 0.5f) / width - 6.f, 0.f);
+      Ray ray(eye, normalized(target - eye));
+      auto hit = intersect(ray, scene);
+      if (!hit)
+        continue;
+      Vec3f p = evaluate(ray, hit.hit.rayDepth);
+      Vec3f direction = normalized(light - p);
+      shadows.emplace_back(p, direction, surfaceEpsilon, distance(light, p));
+    }
+  }
+
+  std::cout << "shadow rays, " << shadows.size() << " rays, "
+            << scene.spheres.size() << " spheres / " << scene.triangles.size()
+            << " triangles\n";
+
+  auto reportRays = [&](char const *name, uint64_t nanoseconds,
+                        uint64_t blocked) {
+    std::cout << "  " << name << ": " << 1e3 * shadows.size() / nanoseconds
+              << " Mrays/s, " << blocked << " occluded\n";
+  };
+
+  {
+    temporal::Timer timer(true);
+    uint64_t blocked = 0;
+    for (auto const &ray : shadows)
+      blocked += bool(intersect(ray, scene));
+    reportRays("closest hit", timer.elapsed<nanoseconds_t>(), blocked);
+  }
+
+  {
+    temporal::Timer timer(true);
+    uint64_t blocked = 0;
+    for (auto const &ray : shadows)
+      blocked += occluded(ray, scene);
+    reportRays("any hit", timer.elapsed<nanoseconds_t>(), blocked);
+  }
+
+  {
+    temporal::Timer timer(true);
+    uint64_t blocked = 0;
+    OcclusionCache cache;
+    for (auto const &ray : shadows)
+      blocked += occluded(ray, scene, cache);
+    reportRays("any hit, cached occluder", timer.elapsed<nanoseconds_t>(),
+               blocked);
+  }
+
+  {
+    temporal::Timer timer(true);
+    uint64_t blocked = 0;
+    OcclusionCache cache;
+    for (size_t first = 0; first < shadows.size(); first += maxPacketSize) {
+      RayPacket packet;
+      size_t last = std::min(first + maxPacketSize, shadows.size());
+      for (size_t i = first; i < last; ++i)
+        append(packet, shadows[i]);
+      bool shadowed[maxPacketSize];
+      occluded(packet, scene, shadowed, cache);
+      for (uint32_t i = 0; i < packet.size; ++i)
+        blocked += shadowed[i];
+    }
+    reportRays("any hit, packets, cached occluder",
+               timer.elapsed<nanoseconds_t>(), blocked);
+  }
+}
+
+// reflection rays of a random scene, one bounce and two, traced in pixel
+// order one by one and as packets, and as packets after sorting them by
+// direction and origin, over the whole queue and in the tile sized queues
+// of the wavefront renderer
+void raySorting() {
+  std::mt19937 gen(0);
+  SceneDescription description;
+  description.spheres = randomSpheres(1 << 14, gen);
+  description.triangles = randomTriangles(1 << 14, gen);
+  auto scene = buildScene(description);
+
+  constexpr int32_t width = 512;
+  Vec3f const eye(0.f, 0.f, 15.f);
+
+  auto reflect = [](Ray const &ray, SceneHit const &hit) {
+    Vec3f d = ray.direction;
+    Vec3f r = d - (2.f * (d * hit.normal)) * hit.normal;
+    return Ray(hit.point, normalized(r), surfaceEpsilon);
+  };
+
+  // rays of 16 x 16 pixel tiles, 4 x 4 blocks of pixels next to each other
+  std::vector<Ray> bounces[2];
+  for (int32_t ty = 0; ty < width; ty += 16)
+    for (int32_t tx = 0; tx < width; tx += 16)
+      for (int32_t by = ty; by < ty + 16; by += 4)
+        for (int32_t bx = tx; bx < tx + 16; bx += 4)
+          for (int32_t y = by; y < by + 4; ++y)
+            for (int32_t x = bx; x < bx + 4; ++x) {
+              Vec3f target(12.f * (x + 0.5f) / width - 6.f,
+                           12.f * (y + 0.5f) / width - 6.f, 0.f);
+              Ray ray(eye, normalized(target - eye));
+              for (auto &bounce : bounces) {
+                auto hit = intersect(ray, scene);
+                if (!hit)
+                  break;
+                ray = reflect(ray, hit);
+                bounce.push_back(ray);
+              }
+            }
+
+  std::cout << "ray sorting, " << scene.spheres.size() << " spheres / "
+            << scene.triangles.size() << " triangles\n";
+
+  for (int b = 0; b < 2; ++b) {
+    std::vector<Ray> const &rays = bounces[b];
+    std::cout << "  bounce " << b + 1 << ", " << rays.size() << " rays\n";
+
+    std::vector<SceneHit> reference(rays.size());
+    {
+      temporal::Timer timer(true);
+      for (size_t i = 0; i < rays.size(); ++i)
+        reference[i] = intersect(rays[i], scene);
+      double ns = double(timer.elapsed<nanoseconds_t>());
+      std::cout << "    single rays: " << 1e3 * rays.size() / ns
+                << " Mrays/s\n";
+    }
+
+    // queues of chunk rays at a time, sorted or not; the variants take turns
+    // and the best of five runs counts, so they see the same machine
+    struct Variant {
+      char const *name;
+      size_t chunk;
+      bool sorted;
+      uint64_t best;
+    };
+    Variant variants[] = {{"packets", rays.size(), false, ~uint64_t(0)},
+                          {"packets, sorted", rays.size(), true, ~uint64_t(0)},
+                          {"packets, tiles", 256, false, ~uint64_t(0)},
+                          {"packets, tiles sorted", 256, true, ~uint64_t(0)}};
+
+    RayQueue queue;
+    RaySort sort;
+    std::vector<SceneHit> hits;
+    uint64_t mismatches = 0;
+    for (int run = 0; run < 5; ++run) {
+      for (auto &variant : variants) {
+        temporal::Timer timer(true);
+        for (size_t first = 0; first < rays.size(); first += variant.chunk) {
+          size_t last = std::min(first + variant.chunk, rays.size());
+          queue.clear();
+          for (size_t i = first; i < last; ++i)
+            append(queue, rays[i]);
+          if (variant.sorted)
+            sortByCoherence(queue, sort);
+          intersect(queue, scene, hits, maxPacketSize);
+          for (uint32_t i = 0; i < queue.size(); ++i) {
+            auto const &expected =
+                reference[first + (variant.sorted ? sort.order[i] : i)];
+            if (bool(hits[i]) != bool(expected) ||
+                hits[i].primitive != expected.primitive)
+              ++mismatches;
+          }
+        }
+        variant.best =
+            std::min(variant.best, uint64_t(timer.elapsed<nanoseconds_t>()));
+      }
+    }
+
+    for (auto const &variant : variants)
+      std::cout << "    " << variant.name << ": "
+                << 1e3 * rays.size() / variant.best << " Mrays/s\n";
+    if (mismatches > 0)
+      std::cout << "    [Warning] " << mismatches
+                << " hits differ from single rays\n";
+  }
+}
+
+void bvhBuilding() {
+  concurrency::ThreadPool threadPool;
+  std::cout << "BVH builds, " << threadPool.threadCount() << " threads\n";
+
+  // as buildScene builds them
+  BVHBuildOptions options;
+  options.maxLeafSize = std::max(options.maxLeafSize, simd::laneCount);
+  options.leafGroupSize = simd::laneCount;
+
+  struct Variant {
+    char const *name;
+    BVHBuilder builder;
+    uint32_t treeletRounds;
+  };
+  Variant const variants[] = {{"binned SAH", BVHBuilder::SAH, 0},
+                              {"linear", BVHBuilder::LINEAR, 0},
+                              {"linear, 1 treelet pass", BVHBuilder::LINEAR, 1},
+                              {"linear, 3 treelet passes", BVHBuilder::LINEAR,
+                               3}};
+
+  std::mt19937 gen(0);
+  for (uint32_t count : {1u << 16, 1u << 20, 1u << 22}) {
+    auto triangles = randomTriangles(count, gen);
+    std::vector<AABB> primitiveBounds;
+    primitiveBounds.reserve(count);
+    for (auto const &t : triangles)
+      primitiveBounds.push_back(bounds(t));
+    std::cout << "  " << count << " triangles\n";
+
+    for (auto const &variant : variants) {
+      BVHBuildOptions variantOptions = options;
+      variantOptions.treeletRounds = variant.treeletRounds;
+
+      temporal::Timer timer(true);
+      BVH bvh = variant.builder == BVHBuilder::LINEAR
+                    ? buildLinearBVH(primitiveBounds, threadPool, variantOptions)
+                    : buildBVH(primitiveBounds, variantOptions);
+      double ms = timer.elapsed<nanoseconds_t>() * 1e-6;
+      std::cout << "    " << variant.name << ": " << ms << " ms, "
+                << bvh.nodes.size() << " nodes, SAH cost "
+                << surfaceAreaCost(bvh, options) << '\n';
+    }
+  }
+
+  // the trees traced, hits must match the binned build's
+  std::cout << "  tracing, 1M triangles\n";
+  SceneDescription description;
+  description.triangles = randomTriangles(1 << 20, gen);
+  auto rays = randomRays(1 << 16, gen);
+
+  std::vector<SceneHit> reference;
+  for (auto const &variant : variants) {
+    SceneBuildOptions buildOptions;
+    buildOptions.builder = variant.builder;
+    buildOptions.treeletRounds = variant.treeletRounds;
+    auto scene = buildScene(description, buildOptions, threadPool);
+
+    std::vector<SceneHit> hits(rays.size());
+    temporal::Timer timer(true);
+    for (size_t i = 0; i < rays.size(); ++i)
+      hits[i] = intersect(rays[i], scene);
+    double ns = double(timer.elapsed<nanoseconds_t>());
+
+    // slots differ between the builds, compare what was hit
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); ++i) {
+      if (reference.empty())
+        break;
+      if (bool(hits[i]) != bool(reference[i]) ||
+          (hits[i] && hits[i].hit.rayDepth != reference[i].hit.rayDepth))
+        ++mismatches;
+    }
+    if (reference.empty())
+      reference = hits;
+
+    std::cout << "    " << variant.name << ": " << 1e3 * rays.size() / ns
+              << " Mrays/s\n";
+    if (mismatches > 0)
+      std::cout << "    [Warning] " << mismatches
+                << " hits differ from the binned SAH tree\n";
+  }
+}
+
+// single rays through the binary BVHs and through the same BVHs collapsed to
+// quantized wide ones, the variants taking turns, best of five
+void wideBVH() {
+  std::mt19937 gen(0);
+  concurrency::ThreadPool threadPool;
+  std::cout << "wide BVH, " << wideBVHWidth << " children per node, "
+            << sizeof(WideBVHNode) << " bytes per node ("
+            << sizeof(BVHNode) << " binary)\n";
+
+  for (uint32_t count : {1u << 14, 1u << 20}) {
+    SceneDescription description;
+    description.spheres = randomSpheres(count, gen);
+    description.triangles = randomTriangles(count, gen);
+    SceneBuildOptions buildOptions;
+    buildOptions.accelerator = Accelerator::WIDE_BVH;
+    auto scene = buildScene(description, buildOptions, threadPool);
+
+    auto bytes = [](size_t nodes, size_t size) {
+      return double(nodes * size) / (1 << 20);
+    };
+    std::cout << "  " << count << " spheres / " << count
+              << " triangles, nodes "
+              << bytes(scene.sphereBVH.nodes.size() +
+                           scene.triangleBVH.nodes.size(),
+                       sizeof(BVHNode))
+              << " MB binary, "
+              << bytes(scene.sphereWideBVH.nodes.size() +
+                           scene.triangleWideBVH.nodes.size(),
+                       sizeof(WideBVHNode))
+              << " MB wide\n";
+
+    auto rays = randomRays(1 << 16, gen);
+    std::vector<SceneHit> hits[2];
+    std::vector<bool> blocked[2];
+    uint64_t best[2][2] = {{~uint64_t(0), ~uint64_t(0)},
+                           {~uint64_t(0), ~uint64_t(0)}};
+    for (int run = 0; run < 5; ++run) {
+      for (int wide = 0; wide < 2; ++wide) {
+        scene.buildOptions.accelerator =
+            wide ? Accelerator::WIDE_BVH : Accelerator::BVH;
+        hits[wide].clear();
+        blocked[wide].clear();
+
+        temporal::Timer timer(true);
+        for (auto const &ray : rays)
+          hits[wide].push_back(intersect(ray, scene));
+        best[wide][0] =
+            std::min(best[wide][0], uint64_t(timer.elapsed<nanoseconds_t>()));
+
+        // no occlusion cache, every query traverses
+        timer.reset();
+        for (auto const &ray : rays)
+          blocked[wide].push_back(occluded(ray, scene));
+        best[wide][1] =
+            std::min(best[wide][1], uint64_t(timer.elapsed<nanoseconds_t>()));
+      }
+    }
+
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); ++i)
+      if (bool(hits[0][i]) != bool(hits[1][i]) ||
+          hits[0][i].hit.rayDepth != hits[1][i].hit.rayDepth ||
+          blocked[0][i] != blocked[1][i])
+        ++mismatches;
+
+    char const *names[] = {"binary", "wide"};
+    for (int wide = 0; wide < 2; ++wide)
+      std::cout << "    " << names[wide] << ": closest hit "
+                << 1e3 * rays.size() / best[wide][0] << " Mrays/s, occluded "
+                << 1e3 * rays.size() / best[wide][1] << " Mrays/s\n";
+    if (mismatches > 0)
+      std::cout << "    [Warning] " << mismatches
+                << " rays differ between the trees\n";
+  }
+}
+
+// spheres spread evenly through the box of randomRays, small like particles
+std::vector<Sphere> particles(size_t count, std::mt19937 &gen) {
+  std::uniform_real_distribution<float> position(-5.f, 5.f);
+  std::uniform_real_distribution<float> radius(0.01f, 0.02f);
+  std::vector<Sphere> spheres;
+  spheres.reserve(count);
+
+  for (size_t i = 0; i < count; ++i)
+    spheres.emplace_back(Vec3f(position(gen), position(gen), position(gen)),
+                         radius(gen));
+  return spheres;
+}
+
+// the same, with most of them in a ball at the center of the box, 4 across
+std::vector<Sphere> clusteredParticles(size_t count, std::mt19937 &gen) {
+  std::uniform_real_distribution<float> offset(-2.f, 2.f);
+  auto spheres = particles(count, gen);
+  for (size_t i = 0; i < count / 8 * 7; ++i) {
+    Vec3f p;
+    do {
+      p = Vec3f(offset(gen), offset(gen), offset(gen));
+    } while (dot(p, p) > 4.f);
+    spheres[i].origin = p;
+  }
+  return spheres;
+}
+
+// single rays through every accelerator of Scene on generated scenes, from
+// millions of evenly spread particles for which grids are made to clustered
+// ones and random spheres and triangles; the BVHs are built linear, as
+// scenes of millions would be, and the grids over their slots; the
+// accelerators take turns, best of three
+void gridAccelerators() {
+  std::mt19937 gen(0);
+  concurrency::ThreadPool threadPool;
+
+  struct Generated {
+    char const *name;
+    SceneDescription description;
+  };
+  std::vector<Generated> scenes(3);
+  scenes[0].name = "particles";
+  scenes[0].description.spheres = particles(1 << 21, gen);
+  scenes[1].name = "clustered particles";
+  scenes[1].description.spheres = clusteredParticles(1 << 20, gen);
+  scenes[2].name = "spheres and triangles";
+  scenes[2].description.spheres = randomSpheres(1 << 16, gen);
+  scenes[2].description.triangles = randomTriangles(1 << 16, gen);
+
+  auto rays = randomRays(1 << 16, gen);
+  auto megabytes = [](size_t bytes) { return double(bytes) / (1 << 20); };
+  auto milliseconds = [](temporal::Timer const &timer) {
+    return timer.elapsed<nanoseconds_t>() * 1e-6;
+  };
+
+  for (auto &generated : scenes) {
+    auto const &description = generated.description;
+    std::cout << generated.name << ", " << description.spheres.size()
+              << " spheres / " << description.triangles.size()
+              << " triangles\n";
+
+    // collapsing moves the leaves, so the wide BVHs come with the scene
+    SceneBuildOptions buildOptions;
+    buildOptions.builder = BVHBuilder::LINEAR;
+    buildOptions.accelerator = Accelerator::WIDE_BVH;
+    temporal::Timer timer(true);
+    auto scene = buildScene(description, buildOptions, threadPool);
+    std::cout << "  scene with wide BVHs: " << milliseconds(timer) << " ms\n";
+
+    // bounds of the slots, as buildScene builds the grids over
+    std::vector<AABB> sphereBounds(description.spheres.size());
+    for (size_t i = 0; i < description.spheres.size(); ++i)
+      sphereBounds[scene.sphereSlots[i]] = bounds(description.spheres[i]);
+    std::vector<AABB> triangleBounds(description.triangles.size());
+    for (size_t i = 0; i < description.triangles.size(); ++i)
+      triangleBounds[scene.triangleSlots[i]] = bounds(description.triangles[i]);
+
+    timer.reset();
+    scene.sphereGrid = buildUniformGrid(sphereBounds);
+    scene.triangleGrid = buildUniformGrid(triangleBounds);
+    double gridMs = milliseconds(timer);
+    timer.reset();
+    scene.sphereTwoLevelGrid = buildTwoLevelGrid(sphereBounds);
+    scene.triangleTwoLevelGrid = buildTwoLevelGrid(triangleBounds);
+    double twoLevelMs = milliseconds(timer);
+
+    auto gridBytes = [](UniformGrid const &grid) {
+      return grid.cellStart.size() * sizeof(uint32_t) +
+             grid.ranges.size() * sizeof(GridRange);
+    };
+    auto twoLevelBytes = [](TwoLevelGrid const &grid) {
+      return grid.cellShapes.size() * sizeof(GridShape) +
+             (grid.firstCell.size() + grid.cellStart.size()) *
+                 sizeof(uint32_t) +
+             grid.ranges.size() * sizeof(GridRange);
+    };
+    std::cout << "  grids: " << gridMs << " ms, "
+              << megabytes(gridBytes(scene.sphereGrid) +
+                           gridBytes(scene.triangleGrid))
+              << " MB; two level grids: " << twoLevelMs << " ms, "
+              << megabytes(twoLevelBytes(scene.sphereTwoLevelGrid) +
+                           twoLevelBytes(scene.triangleTwoLevelGrid))
+              << " MB; BVHs "
+              << megabytes((scene.sphereBVH.nodes.size() +
+                            scene.triangleBVH.nodes.size()) *
+                           sizeof(BVHNode))
+              << " MB\n";
+
+    struct Variant {
+      char const *name;
+      Accelerator accelerator;
+    };
+    Variant const variants[] = {{"BVH", Accelerator::BVH},
+                                {"wide BVH", Accelerator::WIDE_BVH},
+                                {"grid", Accelerator::GRID},
+                                {"two level grid",
+                                 Accelerator::TWO_LEVEL_GRID}};
+    constexpr int variantCount = sizeof(variants) / sizeof(variants[0]);
+
+    std::vector<SceneHit> hits[variantCount];
+    std::vector<bool> blocked[variantCount];
+    uint64_t best[variantCount][2];
+    for (auto &b : best)
+      b[0] = b[1] = ~uint64_t(0);
+    for (int run = 0; run < 3; ++run) {
+      for (int v = 0; v < variantCount; ++v) {
+        scene.buildOptions.accelerator = variants[v].accelerator;
+        hits[v].clear();
+        blocked[v].clear();
+
+        timer.reset();
+        for (auto const &ray : rays)
+          hits[v].push_back(intersect(ray, scene));
+        best[v][0] =
+            std::min(best[v][0], uint64_t(timer.elapsed<nanoseconds_t>()));
+
+        timer.reset();
+        for (auto const &ray : rays)
+          blocked[v].push_back(occluded(ray, scene));
+        best[v][1] =
+            std::min(best[v][1], uint64_t(timer.elapsed<nanoseconds_t>()));
+      }
+    }
+
+    for (int v = 0; v < variantCount; ++v) {
+      std::cout << "    " << variants[v].name << ": closest hit "
+                << 1e3 * rays.size() / best[v][0] << " Mrays/s, occluded "
+                << 1e3 * rays.size() / best[v][1] << " Mrays/s\n";
+
+      // the same slots are intersected with the same kernels
+      uint64_t mismatches = 0;
+      for (size_t i = 0; i < rays.size(); ++i)
+        if (bool(hits[v][i]) != bool(hits[0][i]) ||
+            hits[v][i].hit.rayDepth != hits[0][i].hit.rayDepth ||
+            blocked[v][i] != blocked[0][i])
+          ++mismatches;
+      if (mismatches > 0)
+        std::cout << "    [Warning] " << mismatches
+                  << " rays differ from the BVH\n";
+    }
+  }
+}
+
+// a size x size grid of quads with random heights
+OBJMesh makeGridMesh(uint32_t size, std::mt19937 &gen) {
+  std::uniform_real_distribution<float> height(-0.01f, 0.01f);
+  OBJMesh mesh;
+
+  uint32_t const n = size + 1;
+  for (uint32_t y = 0; y < n; ++y)
+    for (uint32_t x = 0; x < n; ++x)
+      mesh.vertices.push_back(Vec3f(x * 0.01f, height(gen), y * 0.01f));
+
+  auto corner = [&](uint32_t x, uint32_t y) {
+    Indices index;
+    index.id = {{y * n + x, missingIndex, missingIndex}};
+    return index;
+  };
+  for (uint32_t y = 0; y < size; ++y) {
+    for (uint32_t x = 0; x < size; ++x) {
+      mesh.triangles.push_back(
+          {corner(x, y), corner(x, y + 1), corner(x + 1, y + 1)});
+      mesh.triangles.push_back(
+          {corner(x, y), corner(x + 1, y + 1), corner(x + 1, y)});
+    }
+  }
+  return mesh;
+}
+
+// spheres and triangles flying apart from the origin, and instances of a
+// waving mesh in front of them moving and turning, each frame moved in place
+// and refit, against building the scene again
+void animation() {
+  concurrency::ThreadPool threadPool;
+  std::mt19937 gen(0);
+  SceneDescription description;
+  description.spheres = randomSpheres(1 << 18, gen);
+  description.triangles = randomTriangles(1 << 18, gen);
+
+  // the grid stands upright, facing the rays
+  auto mesh = makeTriangleMesh(makeGridMesh(64, gen));
+  constexpr uint32_t instanceCount = 4;
+  auto instanceToWorld = [](uint32_t instance, int frame) {
+    Vec3f position(-3.f + 2.f * instance, -1.f + 0.05f * instance * frame,
+                   7.f + 0.15f * frame);
+    return translateMatrix(position) *
+           rotateAboutZMatrix(10.f * instance * frame) *
+           rotateAboutXMatrix(90.f) * uniformScaleMatrix(4.f);
+  };
+  for (uint32_t i = 0; i < instanceCount; ++i)
+    description.meshInstances.push_back(
+        makeMeshInstance(mesh, instanceToWorld(i, 0), Vec3f(1.f, 1.f, 1.f)));
+
+  auto scene = buildScene(description, SceneBuildOptions(), threadPool);
+
+  // a random speed and direction each, so the tree degrades
+  std::uniform_real_distribution<float> speed(0.f, 0.1f);
+  std::vector<Vec3f> sphereVelocity, triangleVelocity;
+  for (auto const &s : description.spheres)
+    sphereVelocity.push_back(speed(gen) * s.origin);
+  for (auto const &t : description.triangles)
+    triangleVelocity.push_back(speed(gen) * t.a());
+
+  auto rays = randomRays(1 << 14, gen);
+  std::cout << "animation, " << scene.spheres.size() << " spheres / "
+            << scene.triangles.size() << " triangles / " << instanceCount
+            << " instances of " << mesh->mesh.triangles.size()
+            << " triangles, " << threadPool.threadCount() << " threads\n";
+
+  BVHBuildOptions options;
+  options.leafGroupSize = simd::laneCount;
+  for (int frame = 1; frame <= 8; ++frame) {
+    for (size_t i = 0; i < description.spheres.size(); ++i) {
+      auto &s = description.spheres[i];
+      s.origin = s.origin + sphereVelocity[i];
+      updateSphere(scene, uint32_t(i), s);
+    }
+    for (size_t i = 0; i < description.triangles.size(); ++i) {
+      auto &t = description.triangles[i];
+      Vec3f v = triangleVelocity[i];
+      t = Triangle(t.a() + v, t.b() + v, t.c() + v);
+      updateTriangle(scene, uint32_t(i), t);
+    }
+    for (auto &vertex : mesh->mesh.vertices)
+      vertex.y = 0.05f * float(frame) * std::sin(10.f * vertex.x + frame);
+    for (uint32_t i = 0; i < instanceCount; ++i)
+      updateMeshInstance(scene, i, instanceToWorld(i, frame));
+
+    float const sphereCost = scene.sphereBVHCost;
+    float const triangleCost = scene.triangleBVHCost;
+    temporal::Timer timer(true);
+    refitTriangleMesh(*mesh, threadPool);
+    refitScene(scene, threadPool);
+    double refitMs = timer.elapsed<nanoseconds_t>() * 1e-6;
+    char const *rebuilt = scene.sphereBVHCost != sphereCost
+                              ? (scene.triangleBVHCost != triangleCost
+                                     ? " (both rebuilt)"
+                                     : " (spheres rebuilt)")
+                              : (scene.triangleBVHCost != triangleCost
+                                     ? " (triangles rebuilt)"
+                                     : "");
+
+    // with a copy of the deformed mesh, built from scratch
+    timer.reset();
+    auto builtMesh = makeTriangleMesh(mesh->mesh);
+    for (uint32_t i = 0; i < instanceCount; ++i)
+      description.meshInstances[i] = makeMeshInstance(
+          builtMesh, instanceToWorld(i, frame), Vec3f(1.f, 1.f, 1.f));
+    auto built = buildScene(description, SceneBuildOptions(), threadPool);
+    double buildMs = timer.elapsed<nanoseconds_t>() * 1e-6;
+
+    // the refit scene must hit what the new one hits
+    uint64_t mismatches = 0;
+    timer.reset();
+    std::vector<SceneHit> hits;
+    for (auto const &ray : rays)
+      hits.push_back(intersect(ray, scene));
+    double traceNs = double(timer.elapsed<nanoseconds_t>());
+    uint64_t meshHits = 0;
+    for (size_t i = 0; i < rays.size(); ++i) {
+      auto expected = intersect(rays[i], built);
+      if (bool(hits[i]) != bool(expected) ||
+          (hits[i] && (hits[i].hit.rayDepth != expected.hit.rayDepth ||
+                       hits[i].type != expected.type)))
+        ++mismatches;
+      meshHits += hits[i].type == PrimitiveType::MESH;
+    }
+
+    std::cout << "  frame " << frame << ": refit " << refitMs << " ms"
+              << rebuilt << ", build " << buildMs
+              << " ms, triangle BVH cost "
+              << surfaceAreaCost(scene.triangleBVH, options) << " (built "
+              << surfaceAreaCost(built.triangleBVH, options) << "), "
+              << 1e3 * rays.size() / traceNs << " Mrays/s, " << meshHits
+              << " instance hits\n";
+    if (mismatches > 0)
+      std::cout << "  [Warning] " << mismatches
+                << " hits differ from the rebuilt scene\n";
+  }
+}
+
+// the vector math as it was before it moved into the headers, each operation
+// a call, kept as the reference for the inline versions
+namespace outOfLine {
+
+BENCHMARK_NOINLINE Vec3f add(Vec3f const &a, Vec3f const &b) {
+  return Vec3f(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+BENCHMARK_NOINLINE Vec3f subtract(Vec3f const &a, Vec3f const &b) {
+  return Vec3f(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+BENCHMARK_NOINLINE Vec3f scale(float s, Vec3f v) {
+  v.x *= s;
+  v.y *= s;
+  v.z *= s;
+  return v;
+}
+BENCHMARK_NOINLINE Vec3f negate(Vec3f v) {
+  v.x = -v.x;
+  v.y = -v.y;
+  v.z = -v.z;
+  return v;
+}
+BENCHMARK_NOINLINE float dot(Vec3f const &a, Vec3f const &b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+BENCHMARK_NOINLINE float norm(Vec3f const &v) {
+  return std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+}
+BENCHMARK_NOINLINE Vec3f normalized(Vec3f v) {
+  float l = outOfLine::norm(v);
+  v.x /= l;
+  v.y /= l;
+  v.z /= l;
+  return v;
+}
+BENCHMARK_NOINLINE float element(Mat4f const &m, int row, int column) {
+  return m(row, column);
+}
+BENCHMARK_NOINLINE Vec3f transformPoint(Mat4f const &m, Vec3f const &p) {
+  return {element(m, 0, 0) * p.x + element(m, 0, 1) * p.y +
+              element(m, 0, 2) * p.z + element(m, 0, 3),
+          element(m, 1, 0) * p.x + element(m, 1, 1) * p.y +
+              element(m, 1, 2) * p.z + element(m, 1, 3),
+          element(m, 2, 0) * p.x + element(m, 2, 1) * p.y +
+              element(m, 2, 2) * p.z + element(m, 2, 3)};
+}
+
+} // namespace outOfLine
+
+// the per hit arithmetic of castRay: light and view directions, diffuse and
+// specular terms and a point transform, out of line calls against inline math
+void vectorMath() {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> offset(-5.f, 5.f);
+
+  constexpr size_t count = 1 << 20;
+  std::vector<Vec3f> points, normals;
+  points.reserve(count);
+  normals.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    points.emplace_back(offset(gen), offset(gen), offset(gen));
+    normals.push_back(
+        normalized(Vec3f(offset(gen), offset(gen), offset(gen))));
+  }
+
+  Vec3f const light(20.f, 15.f, 10.f);
+  Vec3f const eye(0.f, 7.5f, 15.f);
+  Mat4f const toWorld = translateMatrix(1.f, 2.f, 3.f) * uniformScaleMatrix(2.f);
+
+  std::cout << "vector math, " << count << " shading points\n";
+
+  auto reportShading = [&](char const *name, uint64_t nanoseconds,
+                           double sum) {
+    std::cout << "  " << name << ": " << double(nanoseconds) / count
+              << " ns/point (checksum " << sum << ")\n";
+  };
+
+  {
+    temporal::Timer timer(true);
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+      using namespace outOfLine;
+      Vec3f p = outOfLine::transformPoint(toWorld, points[i]);
+      Vec3f const &n = normals[i];
+      Vec3f lightDir = outOfLine::normalized(subtract(light, p));
+      float diff = std::max(outOfLine::dot(n, lightDir), 0.f);
+      Vec3f view = outOfLine::normalized(subtract(p, eye));
+      Vec3f reflection = add(
+          lightDir, scale(2.f * outOfLine::dot(negate(lightDir), n), n));
+      float spec = std::max(outOfLine::dot(view, reflection), 0.f);
+      sum += diff + spec;
+    }
+    reportShading("out of line", timer.elapsed<nanoseconds_t>(), sum);
+  }
+
+  {
+    temporal::Timer timer(true);
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+      Vec3f p = transformPoint(toWorld, points[i]);
+      Vec3f const &n = normals[i];
+      Vec3f lightDir = normalized(light - p);
+      float diff = std::max(n * lightDir, 0.f);
+      Vec3f view = normalized(p - eye);
+      Vec3f reflection = lightDir + (2.f * (-lightDir * n)) * n;
+      float spec = std::max(view * reflection, 0.f);
+      sum += diff + spec;
+    }
+    reportShading("inline", timer.elapsed<nanoseconds_t>(), sum);
+  }
+}
+
+// the original loader, a stringstream per line and per face index, kept as
+// the reference for the memory mapped one
+bool loadOBJStreams(std::string const &filePath, OBJMesh &meshOut) {
+  std::ifstream in(filePath.c_str());
+  if (!in)
+    return false;
+
+  OBJMesh mesh;
+  std::string s;
+
+  while (getline(in, s)) {
+    std::stringstream line(s);
+    std::string token;
+    line >> token;
+
+    if (token == "v") {
+      Vec3f vec;
+      line >> vec;
+      mesh.vertices.push_back(vec);
+    } else if (token == "vt") {
+      Vec2f vec;
+      line >> vec;
+      mesh.textureCoords.push_back(vec);
+    } else if (token == "vn") {
+      Vec3f vec;
+      line >> vec;
+      mesh.normals.push_back(vec);
+    } else if (token == "f") {
+      std::vector<Indices> indices;
+      while (line >> s) {
+        std::stringstream item(s);
+        Indices index;
+        for (int component = 0; component < 3; ++component) {
+          index[component] = missingIndex;
+          if (getline(item, s, '/') && !s.empty()) {
+            std::stringstream number(s);
+            number >> index[component];
+            index[component] -= 1;
+          }
+        }
+        indices.push_back(index);
+      }
+      if (indices.size() != 3)
+        return false;
+      mesh.triangles.push_back({indices[0], indices[1], indices[2]});
+    }
+  }
+
+  meshOut = std::move(mesh);
+  return true;
+}
+
+// a grid of size x size quads with texture coordinates and normals
+void writeGridOBJ(std::string const &filePath, uint32_t size,
+                  std::mt19937 &gen) {
+  std::uniform_real_distribution<float> height(-1.f, 1.f);
+  std::ofstream out(filePath.c_str());
+  out << std::fixed << std::setprecision(6);
+
+  uint32_t const n = size + 1;
+  for (uint32_t y = 0; y < n; ++y)
+    for (uint32_t x = 0; x < n; ++x)
+      out << "v " << x * 0.01f << ' ' << height(gen) << ' ' << y * 0.01f
+          << '\n';
+  for (uint32_t y = 0; y < n; ++y)
+    for (uint32_t x = 0; x < n; ++x)
+      out << "vt " << float(x) / size << ' ' << float(y) / size << '\n';
+  for (uint32_t y = 0; y < n; ++y)
+    for (uint32_t x = 0; x < n; ++x)
+      out << "vn " << height(gen) << ' ' << 1.f << ' ' << height(gen) << '\n';
+
+  auto corner = [&](uint32_t x, uint32_t y) {
+    uint32_t i = y * n + x + 1;
+    out << ' ' << i << '/' << i << '/' << i;
+  };
+  for (uint32_t y = 0; y < size; ++y) {
+    for (uint32_t x = 0; x < size; ++x) {
+      out << 'f';
+      corner(x, y);
+      corner(x + 1, y);
+      corner(x + 1, y + 1);
+      out << "\nf";
+      corner(x, y);
+      corner(x + 1, y + 1);
+      corner(x, y + 1);
+      out << '\n';
+    }
+  }
+}
+
+// a generated OBJ file read with the stream based loader and the memory
+// mapped parallel one
+void objLoading() {
+  std::mt19937 gen(0);
+  std::string const filePath = "benchmark_grid.obj";
+  writeGridOBJ(filePath, 256, gen);
+
+  std::ifstream sizeCheck(filePath.c_str(), std::ios::binary | std::ios::ate);
+  double megabytes = double(sizeCheck.tellg()) * 1e-6;
+  sizeCheck.close();
+
+  std::cout << "OBJ loading, " << megabytes << " MB\n";
+
+  auto reportLoad = [&](char const *name, uint64_t nanoseconds) {
+    std::cout << "  " << name << ": " << 1e-6 * nanoseconds << " ms, "
+              << megabytes * 1e9 / nanoseconds << " MB/s\n";
+  };
+
+  OBJMesh reference;
+  {
+    temporal::Timer timer(true);
+    loadOBJStreams(filePath, reference);
+    reportLoad("streams", timer.elapsed<nanoseconds_t>());
+  }
+
+  for (unsigned threads : {1u, concurrency::hardwareThreads()}) {
+    concurrency::ThreadPool threadPool(threads);
+    OBJMesh mesh;
+    temporal::Timer timer(true);
+    loadOBJMeshFromFile(filePath, mesh, threadPool);
+    auto nanoseconds = timer.elapsed<nanoseconds_t>();
+
+    std::string name = "memory mapped, " + std::to_string(threads) +
+                       " thread" + (threads > 1 ? "s" : "");
+    reportLoad(name.c_str(), nanoseconds);
+
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < mesh.vertices.size(); ++i)
+      mismatches += normSquared(mesh.vertices[i] - reference.vertices[i]) > 0.f;
+    for (size_t i = 0; i < mesh.normals.size(); ++i)
+      mismatches += normSquared(mesh.normals[i] - reference.normals[i]) > 0.f;
+    for (size_t i = 0; i < mesh.triangles.size(); ++i)
+      for (int corner = 0; corner < 3; ++corner)
+        mismatches += mesh.triangles[i][corner].id !=
+                      reference.triangles[i][corner].id;
+    if (mesh.vertices.size() != reference.vertices.size() ||
+        mesh.triangles.size() != reference.triangles.size() || mismatches > 0)
+      std::cout << "  [Warning] " << mismatches
+                << " elements differ from the stream loader\n";
+
+    if (threads == concurrency::hardwareThreads())
+      break;
+  }
+
+  // the first load parses the file, builds the BVH and writes the cache, the
+  // second one only reads the cache
+  std::remove(meshCachePath(filePath).c_str());
+  concurrency::ThreadPool threadPool;
+  for (char const *name : {"OBJ and BVH build", "mesh cache"}) {
+    temporal::Timer timer(true);
+    auto mesh = loadTriangleMesh(filePath, threadPool);
+    auto nanoseconds = timer.elapsed<nanoseconds_t>();
+    std::cout << "  " << name << ": " << 1e-6 * nanoseconds << " ms ("
+              << mesh->bvh.nodes.size() << " BVH nodes)\n";
+  }
+
+  std::remove(meshCachePath(filePath).c_str());
+  std::remove(filePath.c_str());
+
+  // face indices that don't resolve to an element must be rejected, also
+  // those that only fit once narrowed to 32 bits; the long file puts the
+  // face into a later chunk than the vertices its relative indices reach
+  struct FaceCase {
+    char const *face;
+    uint32_t vertexCount;
+    bool valid;
+  };
+  FaceCase const faceCases[] = {
+      {"f 1 2 3", 3, true},
+      {"f -3 -2 -1", 3, true},
+      {"f -4 -2 -1", 3, false},
+      {"f 4 2 3", 3, false},
+      {"f 4294967296 2 3", 3, false},
+      {"f 4294967297 2 3", 3, false},
+      {"f 1/4294967296 2 3", 3, false},
+      {"f -600000 -2 -1", 600000, true},
+      {"f -600001 -2 -1", 600000, false}};
+
+  uint32_t wrong = 0;
+  for (auto const &faceCase : faceCases) {
+    {
+      std::ofstream out(filePath.c_str());
+      for (uint32_t i = 0; i < faceCase.vertexCount; ++i)
+        out << "v 0 0 0\n";
+      out << "vt 0 0\n" << faceCase.face << '\n';
+    }
+    OBJMesh mesh;
+    bool loaded = loadOBJMeshFromFile(filePath, mesh, threadPool);
+    if (loaded != faceCase.valid) {
+      std::cout << "  [Warning] \"" << faceCase.face << "\" was "
+                << (loaded ? "accepted" : "rejected") << '\n';
+      ++wrong;
+    }
+  }
+  std::cout << "  face index checks: " << wrong << " wrong of "
+            << sizeof(faceCases) / sizeof(faceCases[0]) << '\n';
+
+  std::remove(filePath.c_str());
+}
+
+// angle weighted vertex normals, straight from the definition
+Normals vertexNormalsReference(OBJMesh const &mesh) {
+  Normals normals(mesh.vertices.size());
+  for (auto const &t : mesh.triangles) {
+    Vec3f p[3] = {mesh.vertices[t.a().vertexID()],
+                  mesh.vertices[t.b().vertexID()],
+                  mesh.vertices[t.c().vertexID()]};
+    Vec3f n = normalized(cross(p[1] - p[0], p[2] - p[0]));
+    for (int corner = 0; corner < 3; ++corner) {
+      Vec3f e1 = normalized(p[(corner + 1) % 3] - p[corner]);
+      Vec3f e2 = normalized(p[(corner + 2) % 3] - p[corner]);
+      float angle = std::acos(std::max(-1.f, std::min(1.f, dot(e1, e2))));
+      normals[t[corner].vertexID()] += angle * n;
+    }
+  }
+  for (auto &n : normals)
+    n = normalized(n);
+  return normals;
+}
+
+// face and vertex normals of a 2M triangle grid on one and on all hardware
+// threads, checked against the reference
+void meshNormals() {
+  std::mt19937 gen(0);
+  OBJMesh mesh = makeGridMesh(1024, gen);
+
+  std::cout << "Mesh normals, " << mesh.triangles.size() << " triangles, "
+            << mesh.vertices.size() << " vertices\n";
+
+  auto reportNormals = [&](std::string const &name, uint64_t nanoseconds,
+                           size_t count) {
+    std::cout << "  " << name << ": " << 1e-6 * nanoseconds << " ms, "
+              << 1e3 * count / nanoseconds << " M/s\n";
+  };
+
+  Normals reference;
+  {
+    temporal::Timer timer(true);
+    reference = vertexNormalsReference(mesh);
+    reportNormals("vertex normals, reference", timer.elapsed<nanoseconds_t>(),
+                  mesh.vertices.size());
+  }
+
+  Normals single;
+  for (unsigned threads : {1u, concurrency::hardwareThreads()}) {
+    concurrency::ThreadPool threadPool(threads);
+    std::string suffix = ", " + std::to_string(threads) + " thread" +
+                         (threads > 1 ? "s" : "");
+
+    temporal::Timer timer(true);
+    Normals triangleNormals =
+        calculateTriangleNormals(mesh.triangles, mesh.vertices, threadPool);
+    reportNormals("triangle normals" + suffix, timer.elapsed<nanoseconds_t>(),
+                  mesh.triangles.size());
+
+    timer.reset();
+    Normals normals = calculateVertexNormals(mesh.triangles, mesh.vertices,
+                                             triangleNormals, threadPool);
+    reportNormals("vertex normals" + suffix, timer.elapsed<nanoseconds_t>(),
+                  mesh.vertices.size());
+
+    float maxDeviation = 0.f;
+    for (size_t i = 0; i < normals.size(); ++i)
+      maxDeviation = std::max(maxDeviation, norm(normals[i] - reference[i]));
+    std::cout << "  max deviation from the reference: " << maxDeviation
+              << '\n';
+
+    if (threads == 1) {
+      single = std::move(normals);
+    } else {
+      uint64_t mismatches = 0;
+      for (size_t i = 0; i < normals.size(); ++i)
+        mismatches += normSquared(normals[i] - single[i]) > 0.f;
+      if (mismatches > 0)
+        std::cout << "  [Warning] " << mismatches
+                  << " normals differ from the single threaded ones\n";
+      break;
+    }
+  }
+}
+
+// the tone mapping pass against the per pixel conversion the renderer used to
+// do, dither and clamp to 8 bits, on a 4K image of HDR noise
+void toneMapping() {
+  int32_t const width = 3840;
+  int32_t const height = 2160;
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> value(0.f, 1.5f);
+  Grid2<Vec3f> radiance(width, height);
+  for (int32_t y = 0; y < height; ++y)
+    for (int32_t x = 0; x < width; ++x)
+      radiance(x, y) = Vec3f(value(gen), value(gen), value(gen));
+
+  std::cout << "Tone mapping, " << width << "x" << height << ", "
+            << simd::laneCount << " lanes\n";
+
+  auto reportPixels = [&](std::string const &name, uint64_t nanoseconds) {
+    std::cout << "  " << name << ": " << 1e-6 * nanoseconds << " ms, "
+              << 1e3 * width * height / nanoseconds << " Mpixels/s\n";
+  };
+
+  Grid2<raster::RGB> reference(width, height);
+  {
+    temporal::Timer timer(true);
+    constexpr float halfStep = 1.f / 512;
+    for (int32_t y = 0; y < height; ++y) {
+      for (int32_t x = 0; x < width; ++x) {
+        uint32_t pixelIndex = uint32_t(reference.indexOf(x, y));
+        reference(x, y) = raster::convertToRGB(raster::quantizedErrorCorrection(
+            radiance(x, y),
+            sampling::randomRange(-halfStep, halfStep, pixelIndex, 0,
+                                  sampling::DITHER)));
+      }
+    }
+    reportPixels("per pixel", timer.elapsed<nanoseconds_t>());
+  }
+
+  raster::ToneMapping clamp;
+  for (unsigned threads : {1u, concurrency::hardwareThreads()}) {
+    concurrency::ThreadPool threadPool(threads);
+    Grid2<raster::RGB> screen(width, height);
+
+    temporal::Timer timer(true);
+    raster::toneMap(radiance, screen, clamp, threadPool);
+    reportPixels("tone map pass, " + std::to_string(threads) + " thread" +
+                     (threads > 1 ? "s" : ""),
+                 timer.elapsed<nanoseconds_t>());
+
+    uint64_t mismatches = 0;
+    for (int32_t y = 0; y < height; ++y) {
+      for (int32_t x = 0; x < width; ++x) {
+        raster::RGB a = screen(x, y);
+        raster::RGB b = reference(x, y);
+        mismatches += a.r != b.r || a.g != b.g || a.b != b.b;
+      }
+    }
+    if (mismatches > 0)
+      std::cout << "  [Warning] " << mismatches
+                << " pixels differ from the per pixel conversion\n";
+
+    if (threads == concurrency::hardwareThreads())
+      break;
+  }
+
+  concurrency::ThreadPool threadPool;
+  Grid2<raster::RGB> screen(width, height);
+  raster::ToneMapping aces;
+  aces.curve = raster::ToneMapCurve::ACES;
+  temporal::Timer timer(true);
+  raster::toneMap(radiance, screen, aces, threadPool);
+  reportPixels("ACES curve", timer.elapsed<nanoseconds_t>());
+}
+
+} // namespace
+
+bool run(std::string const &name) {
+  if (name == "triangle") {
+    triangleIntersection();
+  } else if (name == "surfaces") {
+    surfaceStorage();
+  } else if (name == "simd") {
+    simdKernels();
+  } else if (name == "packets") {
+    rayPackets();
+  } else if (name == "raysort") {
+    raySorting();
+  } else if (name == "lbvh") {
+    bvhBuilding();
+  } else if (name == "wide") {
+    wideBVH();
+  } else if (name == "grid") {
+    gridAccelerators();
+  } else if (name == "refit") {
+    animation();
+  } else if (name == "vecmath") {
+    vectorMath();
+  } else if (name == "shadows") {
+    shadowRays();
+  } else if (name == "obj") {
+    objLoading();
+  } else if (name == "normals") {
+    meshNormals();
+  } else if (name == "tonemap") {
+    toneMapping();
+  } else {
+    std::cerr << "[Error] unknown benchmark: " << name << '\n';
+    return false;
+  }
+  return true;
+}
+
+} // namespace benchmark
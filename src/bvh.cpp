@@ -0,0 +1,266 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace geometry {
+
+namespace {
+
+constexpr int binCount = 16;
+constexpr uint32_t maxDepth = 60; // traversal stack holds 64 entries
+
+// relative costs of one node traversal and one primitive intersection
+constexpr float traversalCost = 1.f;
+constexpr float intersectionCost = 1.f;
+
+struct Bin {
+  AABB bounds;
+  uint32_t count = 0;
+};
+
+struct Builder {
+  std::vector<AABB> const &primitiveBounds;
+  BVHBuildOptions options;
+  std::vector<math::Vec3f> centroids;
+  BVH &bvh;
+
+  Builder(std::vector<AABB> const &primitiveBounds,
+          BVHBuildOptions const &options, BVH &bvh)
+      : primitiveBounds(primitiveBounds), options(options), bvh(bvh) {
+    centroids.reserve(primitiveBounds.size());
+    for (auto const &box : primitiveBounds)
+      centroids.push_back(centroid(box));
+  }
+
+  // a leaf costs one intersection per group of primitives tested together
+  float leafCost(uint32_t count) const {
+    auto groups = (count + options.leafGroupSize - 1) / options.leafGroupSize;
+    return intersectionCost * groups;
+  }
+
+  void makeLeaf(uint32_t nodeIndex, uint32_t begin, uint32_t end) {
+    bvh.nodes[nodeIndex].offset = begin;
+    bvh.nodes[nodeIndex].count = end - begin;
+  }
+
+  // splits [begin, end) and returns the middle, or begin if a leaf is cheaper
+  uint32_t split(AABB const &nodeBounds, uint32_t begin, uint32_t end) {
+    auto &indices = bvh.primitiveIndices;
+    uint32_t count = end - begin;
+
+    AABB centroidBounds;
+    for (uint32_t i = begin; i < end; ++i)
+      centroidBounds = merge(centroidBounds, centroids[indices[i]]);
+
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    int bestBin = 0;
+
+    for (int axis = 0; axis < 3; ++axis) {
+      float lo = axisComponent(centroidBounds.min, axis);
+      float hi = axisComponent(centroidBounds.max, axis);
+      if (!(hi > lo))
+        continue;
+
+      float scale = binCount / (hi - lo);
+      std::array<Bin, binCount> bins;
+
+      for (uint32_t i = begin; i < end; ++i) {
+        uint32_t p = indices[i];
+        int b = std::min(
+            binCount - 1,
+            int((axisComponent(centroids[p], axis) - lo) * scale));
+        bins[b].count++;
+        bins[b].bounds = merge(bins[b].bounds, primitiveBounds[p]);
+      }
+
+      // sweep from the right to get the cost of everything right of a plane
+      std::array<float, binCount - 1> rightArea;
+      std::array<uint32_t, binCount - 1> rightCount;
+      AABB accumulated;
+      uint32_t accumulatedCount = 0;
+      for (int b = binCount - 1; b > 0; --b) {
+        accumulated = merge(accumulated, bins[b].bounds);
+        accumulatedCount += bins[b].count;
+        rightArea[b - 1] = surfaceArea(accumulated);
+        rightCount[b - 1] = accumulatedCount;
+      }
+
+      accumulated = AABB();
+      accumulatedCount = 0;
+      for (int b = 0; b < binCount - 1; ++b) {
+        accumulated = merge(accumulated, bins[b].bounds);
+        accumulatedCount += bins[b].count;
+        float cost = surfaceArea(accumulated) * leafCost(accumulatedCount) +
+                     rightArea[b] * leafCost(rightCount[b]);
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = b;
+        }
+      }
+    }
+
+    // all centroids coincide, nothing left to bin
+    if (bestAxis < 0)
+      return begin;
+
+    float area = surfaceArea(nodeBounds);
+    float splitCost = traversalCost + bestCost / std::max(area, 1e-20f);
+    if (splitCost >= leafCost(count) && count <= options.maxLeafSize)
+      return begin;
+
+    float lo = axisComponent(centroidBounds.min, bestAxis);
+    float hi = axisComponent(centroidBounds.max, bestAxis);
+    float scale = binCount / (hi - lo);
+
+    auto middle = std::partition(
+        indices.begin() + begin, indices.begin() + end, [&](uint32_t p) {
+          int b = std::min(
+              binCount - 1,
+              int((axisComponent(centroids[p], bestAxis) - lo) * scale));
+          return b <= bestBin;
+        });
+
+    return uint32_t(middle - indices.begin());
+  }
+
+  void build(uint32_t nodeIndex, uint32_t begin, uint32_t end,
+             uint32_t depth) {
+    AABB nodeBounds;
+    for (uint32_t i = begin; i < end; ++i)
+      nodeBounds = merge(nodeBounds, primitiveBounds[bvh.primitiveIndices[i]]);
+    bvh.nodes[nodeIndex].bounds = nodeBounds;
+
+    uint32_t count = end - begin;
+    if (count <= 1 || depth >= maxDepth) {
+      makeLeaf(nodeIndex, begin, end);
+      return;
+    }
+
+    uint32_t middle = split(nodeBounds, begin, end);
+
+    if (middle == begin || middle == end) {
+      if (count <= options.maxLeafSize) {
+        makeLeaf(nodeIndex, begin, end);
+        return;
+      }
+      // could not separate the primitives (e.g. identical centroids), fall
+      // back to splitting the range in half
+      middle = begin + count / 2;
+    }
+
+    uint32_t left = uint32_t(bvh.nodes.size());
+    bvh.nodes.emplace_back();
+    build(left, begin, middle, depth + 1);
+
+    uint32_t right = uint32_t(bvh.nodes.size());
+    bvh.nodes.emplace_back();
+    bvh.nodes[nodeIndex].offset = right;
+    build(right, middle, end, depth + 1);
+  }
+};
+
+// subtrees of up to this many nodes are refit by one task
+constexpr uint32_t refitTaskSize = 1 << 14;
+
+struct NodeRange {
+  uint32_t first, last;
+};
+
+void refitNode(BVH &bvh, std::vector<AABB> const &primitiveBounds,
+               uint32_t index) {
+  BVHNode &node = bvh.nodes[index];
+  if (node.isLeaf()) {
+    AABB nodeBounds;
+    for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+      nodeBounds = merge(nodeBounds, primitiveBounds[bvh.primitiveIndices[i]]);
+    node.bounds = nodeBounds;
+  } else {
+    node.bounds =
+        merge(bvh.nodes[index + 1].bounds, bvh.nodes[node.offset].bounds);
+  }
+}
+
+// the subtree of node first, which ends before last, into ranges of at most
+// refitTaskSize nodes; the interior nodes above them go to top, parents
+// before children
+void splitForRefit(BVH const &bvh, uint32_t first, uint32_t last,
+                   std::vector<NodeRange> &ranges,
+                   std::vector<uint32_t> &top) {
+  BVHNode const &node = bvh.nodes[first];
+  if (last - first <= refitTaskSize || node.isLeaf()) {
+    ranges.push_back({first, last});
+    return;
+  }
+  top.push_back(first);
+  splitForRefit(bvh, first + 1, node.offset, ranges, top);
+  splitForRefit(bvh, node.offset, last, ranges, top);
+}
+
+} // namespace
+
+AABB BVH::bounds() const { return isEmpty() ? AABB() : nodes[0].bounds; }
+
+BVH buildBVH(std::vector<AABB> const &primitiveBounds,
+             BVHBuildOptions const &options) {
+  BVH bvh;
+
+  if (primitiveBounds.empty())
+    return bvh;
+
+  auto primitiveCount = uint32_t(primitiveBounds.size());
+
+  bvh.primitiveIndices.resize(primitiveCount);
+  for (uint32_t i = 0; i < primitiveCount; ++i)
+    bvh.primitiveIndices[i] = i;
+
+  bvh.nodes.reserve(2 * primitiveCount - 1);
+  bvh.nodes.emplace_back();
+
+  Builder builder(primitiveBounds, options, bvh);
+  builder.build(0, 0, primitiveCount, 0);
+
+  bvh.nodes.shrink_to_fit();
+  return bvh;
+}
+
+float surfaceAreaCost(BVH const &bvh, BVHBuildOptions const &options) {
+  if (bvh.isEmpty())
+    return 0.f;
+
+  double cost = 0.0;
+  for (auto const &node : bvh.nodes) {
+    double nodeCost = traversalCost;
+    if (node.isLeaf()) {
+      auto groups =
+          (node.count + options.leafGroupSize - 1) / options.leafGroupSize;
+      nodeCost = intersectionCost * groups;
+    }
+    cost += nodeCost * surfaceArea(node.bounds);
+  }
+  return float(cost / std::max(surfaceArea(bvh.bounds()), 1e-20f));
+}
+
+void refit(BVH &bvh, std::vector<AABB> const &primitiveBounds,
+           concurrency::ThreadPool &threadPool) {
+  if (bvh.isEmpty())
+    return;
+
+  std::vector<NodeRange> ranges;
+  std::vector<uint32_t> top;
+  splitForRefit(bvh, 0, uint32_t(bvh.nodes.size()), ranges, top);
+
+  // children come after their parent, so backwards every node finds its
+  // children done
+  threadPool.parallelFor(uint32_t(ranges.size()), [&](uint32_t r, unsigned) {
+    for (uint32_t i = ranges[r].last; i-- > ranges[r].first;)
+      refitNode(bvh, primitiveBounds, i);
+  });
+
+  for (auto i = top.rbegin(); i != top.rend(); ++i)
+    refitNode(bvh, primitiveBounds, *i);
+}
+
+} // namespace geometry
@@ -302,4 +302,16 @@ math::Mat4f mat4(Mat3f const &m) {
           0,       0,       0,       1};
 }
 
+math::Mat4f affineInverse(Mat4f const &m) {
+  Mat3f linearInv = inverse(mat3(m));
+  Vec3f t = -Vec3f(m(0, 3), m(1, 3), m(2, 3));
+
+  Mat4f mInv = mat4(linearInv);
+  mInv(0, 3) = linearInv(0, 0) * t.x + linearInv(0, 1) * t.y + linearInv(0, 2) * t.z;
+  mInv(1, 3) = linearInv(1, 0) * t.x + linearInv(1, 1) * t.y + linearInv(1, 2) * t.z;
+  mInv(2, 3) = linearInv(2, 0) * t.x + linearInv(2, 1) * t.y + linearInv(2, 2) * t.z;
+
+  return mInv;
+}
+
 } // namespace math
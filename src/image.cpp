@@ -3,11 +3,10 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-
 #include <iostream>
 
+#include "image_output.hpp"
+
 namespace raster {
 
 Image::Image(data_ptr data, uint32_t width, uint32_t height, uint8_t channels)
@@ -80,20 +79,16 @@ Image read_image_from_file_and_flipVertically(char const *filename) {
           uint8_t(channels)};
 }
 
+// rows are stored bottom up, the encoders take care of the flip
 int write_image_to_png(char const *filename, Image const &image) {
-  stbi_flip_vertically_on_write(true);
-  return stbi_write_png(
-      filename, image.width(), image.height(), image.channels(), image.data(),
-      sizeof(unsigned char) * image.width() * image.channels());
+  concurrency::ThreadPool threadPool;
+  return writeImage(filename, view(image), makePNGEncoder(), threadPool);
 }
 
 int write_screen_to_file(char const *filename,
                          geometry::Grid2<RGB> const &screen) {
-
-  stbi_flip_vertically_on_write(true);
-  return stbi_write_png(filename, screen.width(), screen.height(), 3,
-                        screen.data(),
-                        sizeof(unsigned char) * screen.width() * 3);
+  concurrency::ThreadPool threadPool;
+  return writeImage(filename, view(screen), makePNGEncoder(), threadPool);
 }
 
 RGB convertToRGB(math::Vec3f const &color) {
@@ -0,0 +1,709 @@
+#include "image_output.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace raster {
+
+ImageView view(geometry::Grid2<RGB> const &screen) {
+  static_assert(sizeof(RGB) == 3, "screen pixels must be packed");
+  ImageView image;
+  image.pixels = reinterpret_cast<unsigned char const *>(screen.data());
+  image.width = uint32_t(screen.width());
+  image.height = uint32_t(screen.height());
+  image.channels = 3;
+  return image;
+}
+
+ImageView view(geometry::Grid2<RGB> const &screen,
+               geometry::Grid2<math::Vec3f> const &radiance) {
+  ImageView image = view(screen);
+  image.radiance = radiance.data();
+  return image;
+}
+
+ImageView view(Image const &image) {
+  ImageView imageView;
+  imageView.pixels = image.data();
+  imageView.width = image.width();
+  imageView.height = image.height();
+  imageView.channels = image.channels();
+  return imageView;
+}
+
+namespace {
+
+void append(Bytes &out, std::string const &text) {
+  out.insert(out.end(), text.begin(), text.end());
+}
+
+void appendBigEndian(Bytes &out, uint32_t value) {
+  out.push_back(uint8_t(value >> 24));
+  out.push_back(uint8_t(value >> 16));
+  out.push_back(uint8_t(value >> 8));
+  out.push_back(uint8_t(value));
+}
+
+// screen rows of a band, [first, last)
+struct RowRange {
+  uint32_t first;
+  uint32_t last;
+};
+
+RowRange rowsOf(uint32_t band, uint32_t bandHeight, uint32_t height) {
+  return {band * bandHeight, std::min((band + 1) * bandHeight, height)};
+}
+
+uint32_t bandCountOf(uint32_t height, uint32_t bandHeight) {
+  return (height + bandHeight - 1) / bandHeight;
+}
+
+// PPM and raw: the rows as they are, top row first
+class RowsEncoder : public ImageEncoder {
+public:
+  explicit RowsEncoder(bool header) : m_header(header) {}
+
+  bool begin(ImageView const &image, uint32_t bandHeight,
+             Bytes &out) override {
+    if (m_header && image.channels != 1 && image.channels != 3) {
+      std::cerr << "[Error] PPM files have 1 or 3 channels, not "
+                << int(image.channels) << '\n';
+      return false;
+    }
+    m_image = image;
+    m_bandHeight = bandHeight;
+    if (m_header)
+      append(out, std::string(image.channels == 3 ? "P6\n" : "P5\n") +
+                      std::to_string(image.width) + ' ' +
+                      std::to_string(image.height) + "\n255\n");
+    return true;
+  }
+
+  void encode(uint32_t band, Bytes &out) override {
+    RowRange rows = rowsOf(band, m_bandHeight, m_image.height);
+    size_t const rowBytes = size_t(m_image.width) * m_image.channels;
+    for (uint32_t y = rows.last; y-- > rows.first;)
+      out.insert(out.end(), m_image.row(y), m_image.row(y) + rowBytes);
+  }
+
+  void finish(Bytes &) override {}
+
+private:
+  bool m_header;
+  ImageView m_image;
+  uint32_t m_bandHeight = 0;
+};
+
+// Portable Float Map, rows bottom up like the screen; the sign of the scale
+// gives the byte order of the floats
+class PFMEncoder : public ImageEncoder {
+public:
+  bool topDown() const override { return false; }
+
+  bool begin(ImageView const &image, uint32_t bandHeight,
+             Bytes &out) override {
+    if (image.channels != 1 && image.channels != 3) {
+      std::cerr << "[Error] PFM files have 1 or 3 channels, not "
+                << int(image.channels) << '\n';
+      return false;
+    }
+    m_image = image;
+    m_bandHeight = bandHeight;
+
+    uint16_t const one = 1;
+    bool littleEndian = *reinterpret_cast<uint8_t const *>(&one) == 1;
+    append(out, std::string(image.channels == 3 ? "PF\n" : "Pf\n") +
+                    std::to_string(image.width) + ' ' +
+                    std::to_string(image.height) + '\n' +
+                    (littleEndian ? "-1.0\n" : "1.0\n"));
+    return true;
+  }
+
+  void encode(uint32_t band, Bytes &out) override {
+    RowRange rows = rowsOf(band, m_bandHeight, m_image.height);
+    size_t const rowValues = size_t(m_image.width) * m_image.channels;
+    size_t start = out.size();
+    out.resize(start + (rows.last - rows.first) * rowValues * sizeof(float));
+
+    unsigned char *p = out.data() + start;
+    auto put = [&](float value) {
+      std::memcpy(p, &value, sizeof(float));
+      p += sizeof(float);
+    };
+
+    for (uint32_t y = rows.first; y < rows.last; ++y) {
+      if (m_image.radiance) {
+        math::Vec3f const *row = m_image.radiance + size_t(y) * m_image.width;
+        for (uint32_t x = 0; x < m_image.width; ++x) {
+          put(row[x].x);
+          put(row[x].y);
+          put(row[x].z);
+        }
+      } else {
+        for (size_t i = 0; i < rowValues; ++i)
+          put(m_image.row(y)[i] * (1.f / 255.f));
+      }
+    }
+  }
+
+  void finish(Bytes &) override {}
+
+private:
+  ImageView m_image;
+  uint32_t m_bandHeight = 0;
+};
+
+// PNG
+
+uint32_t const *crcTable() {
+  static uint32_t const *table = [] {
+    static uint32_t entries[256];
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      entries[n] = c;
+    }
+    return entries;
+  }();
+  return table;
+}
+
+uint32_t crc32(unsigned char const *data, size_t size) {
+  uint32_t const *table = crcTable();
+  uint32_t c = 0xffffffffu;
+  for (size_t i = 0; i < size; ++i)
+    c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+  return c ^ 0xffffffffu;
+}
+
+constexpr uint32_t adlerBase = 65521;
+
+uint32_t adler32(unsigned char const *data, size_t size) {
+  uint32_t a = 1;
+  uint32_t b = 0;
+  // the sums can't overflow within 5552 bytes (as in zlib)
+  while (size > 0) {
+    size_t block = std::min(size, size_t(5552));
+    for (size_t i = 0; i < block; ++i) {
+      a += data[i];
+      b += a;
+    }
+    a %= adlerBase;
+    b %= adlerBase;
+    data += block;
+    size -= block;
+  }
+  return (b << 16) | a;
+}
+
+// checksum of the concatenation of two blocks from the checksums of the
+// blocks, as zlib's adler32_combine
+uint32_t combineAdler32(uint32_t first, uint32_t second, size_t secondSize) {
+  uint32_t const remainder = uint32_t(secondSize % adlerBase);
+  uint32_t a = first & 0xffff;
+  uint32_t b = uint32_t((uint64_t(remainder) * a) % adlerBase);
+  a += (second & 0xffff) + adlerBase - 1;
+  b += (first >> 16) + (second >> 16) + adlerBase - remainder;
+  if (a >= adlerBase)
+    a -= adlerBase;
+  if (a >= adlerBase)
+    a -= adlerBase;
+  if (b >= 2 * adlerBase)
+    b -= 2 * adlerBase;
+  if (b >= adlerBase)
+    b -= adlerBase;
+  return (b << 16) | a;
+}
+
+// Deflate (RFC 1951) with the fixed Huffman codes and a single probe hash
+// for matches, about what zlib does at its fastest levels
+
+struct BitWriter {
+  explicit BitWriter(Bytes &out) : out(out) {}
+
+  // value's lowest n bits, first bit first
+  void put(uint32_t value, uint32_t n) {
+    bits |= uint64_t(value) << count;
+    count += n;
+    while (count >= 8) {
+      out.push_back(uint8_t(bits));
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+
+  void alignToByte() {
+    if (count > 0)
+      put(0, 8 - count);
+  }
+
+  Bytes &out;
+  uint64_t bits = 0;
+  uint32_t count = 0;
+};
+
+// Huffman codes are sent most significant bit first
+uint32_t reverseBits(uint32_t code, uint32_t length) {
+  uint32_t reversed = 0;
+  for (uint32_t i = 0; i < length; ++i, code >>= 1)
+    reversed = (reversed << 1) | (code & 1);
+  return reversed;
+}
+
+struct Code {
+  uint16_t bits; // reversed, ready for BitWriter::put
+  uint16_t length;
+};
+
+constexpr uint16_t lengthBase[29] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                     11, 13, 15, 17,  19,  23,  27,  31,
+                                     35, 43, 51, 59,  67,  83,  99,  115,
+                                     131, 163, 195, 227, 258};
+constexpr uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                     1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                     4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t distanceBase[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+constexpr uint8_t distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                       4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                       9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+struct FixedCodes {
+  Code literal[288];
+  Code distance[30];
+  uint8_t lengthCode[259];   // by match length
+  uint8_t distanceCode[512]; // by distance - 1 up to 256, then by
+                             // 256 + (distance - 1) / 128
+};
+
+FixedCodes const &fixedCodes() {
+  static FixedCodes const codes = [] {
+    FixedCodes c;
+    for (uint32_t s = 0; s < 288; ++s) {
+      if (s < 144)
+        c.literal[s] = {uint16_t(reverseBits(0x30 + s, 8)), 8};
+      else if (s < 256)
+        c.literal[s] = {uint16_t(reverseBits(0x190 + s - 144, 9)), 9};
+      else if (s < 280)
+        c.literal[s] = {uint16_t(reverseBits(s - 256, 7)), 7};
+      else
+        c.literal[s] = {uint16_t(reverseBits(0xc0 + s - 280, 8)), 8};
+    }
+    for (uint32_t d = 0; d < 30; ++d)
+      c.distance[d] = {uint16_t(reverseBits(d, 5)), 5};
+
+    uint8_t code = 0;
+    for (uint32_t length = 3; length <= 258; ++length) {
+      while (code < 28 && lengthBase[code + 1] <= length)
+        ++code;
+      c.lengthCode[length] = code;
+    }
+    code = 0;
+    for (uint32_t i = 0; i < 512; ++i) {
+      uint32_t distance = i < 256 ? i + 1 : (i - 256) * 128 + 1;
+      while (code < 29 && distanceBase[code + 1] <= distance)
+        ++code;
+      c.distanceCode[i] = code;
+    }
+    return c;
+  }();
+  return codes;
+}
+
+void putLiteral(BitWriter &writer, FixedCodes const &codes, uint32_t symbol) {
+  writer.put(codes.literal[symbol].bits, codes.literal[symbol].length);
+}
+
+void putMatch(BitWriter &writer, FixedCodes const &codes, uint32_t length,
+              uint32_t distance) {
+  uint32_t lengthCode = codes.lengthCode[length];
+  putLiteral(writer, codes, 257 + lengthCode);
+  writer.put(length - lengthBase[lengthCode], lengthExtra[lengthCode]);
+
+  uint32_t distanceCode =
+      codes.distanceCode[distance <= 256 ? distance - 1
+                                         : 256 + ((distance - 1) >> 7)];
+  writer.put(codes.distance[distanceCode].bits, 5);
+  writer.put(distance - distanceBase[distanceCode],
+             distanceExtra[distanceCode]);
+}
+
+constexpr uint32_t hashBits = 15;
+constexpr size_t windowSize = 32768;
+constexpr size_t minMatch = 3;
+constexpr size_t maxMatch = 258;
+
+uint32_t hash3(unsigned char const *p) {
+  uint32_t v = uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16;
+  return (v * 2654435761u) >> (32 - hashBits);
+}
+
+// data as one non final fixed Huffman block followed by an empty stored
+// block, which ends on a byte boundary (what zlib calls a sync flush), so
+// the outputs of several calls can be concatenated into one stream
+void deflateBlock(unsigned char const *data, size_t size, Bytes &out) {
+  FixedCodes const &codes = fixedCodes();
+  BitWriter writer(out);
+  writer.put(0, 1); // not final
+  writer.put(1, 2); // fixed Huffman codes
+
+  std::vector<int32_t> head(size_t(1) << hashBits, -1);
+  size_t i = 0;
+  while (i + minMatch <= size) {
+    uint32_t h = hash3(data + i);
+    int32_t candidate = head[h];
+    head[h] = int32_t(i);
+
+    size_t length = 0;
+    if (candidate >= 0 && i - size_t(candidate) <= windowSize) {
+      size_t limit = std::min(maxMatch, size - i);
+      unsigned char const *a = data + candidate;
+      unsigned char const *b = data + i;
+      while (length < limit && a[length] == b[length])
+        ++length;
+    }
+
+    if (length >= minMatch) {
+      putMatch(writer, codes, uint32_t(length), uint32_t(i - candidate));
+      for (size_t k = 1; k < length && i + k + minMatch <= size; ++k)
+        head[hash3(data + i + k)] = int32_t(i + k);
+      i += length;
+    } else {
+      putLiteral(writer, codes, data[i]);
+      ++i;
+    }
+  }
+  for (; i < size; ++i)
+    putLiteral(writer, codes, data[i]);
+
+  putLiteral(writer, codes, 256); // end of block
+
+  writer.put(0, 1); // not final
+  writer.put(0, 2); // stored
+  writer.alignToByte();
+  out.push_back(0x00);
+  out.push_back(0x00);
+  out.push_back(0xff);
+  out.push_back(0xff);
+}
+
+uint8_t paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return uint8_t(a);
+  return uint8_t(pb <= pc ? b : c);
+}
+
+// one PNG row filtered with filter into out, prior is the row before it in
+// the file (nullptr for none); returns the cost of the filtered row, filtered
+// rows tend to compress best when their bytes are close to 0 as signed values
+// one loop per filter, they are tried on every row
+uint64_t filterRow(int filter, unsigned char const *row,
+                   unsigned char const *prior, size_t size, uint32_t bpp,
+                   unsigned char *out) {
+  auto cost = [](unsigned char filtered) {
+    return uint64_t(std::abs(int(int8_t(filtered))));
+  };
+  uint64_t total = 0;
+
+  switch (filter) {
+  case 0:
+    for (size_t i = 0; i < size; ++i)
+      total += cost(out[i] = row[i]);
+    break;
+  case 1:
+    for (size_t i = 0; i < bpp; ++i)
+      total += cost(out[i] = row[i]);
+    for (size_t i = bpp; i < size; ++i)
+      total += cost(out[i] = uint8_t(row[i] - row[i - bpp]));
+    break;
+  case 2:
+    for (size_t i = 0; i < size; ++i)
+      total += cost(out[i] = uint8_t(row[i] - prior[i]));
+    break;
+  case 3:
+    for (size_t i = 0; i < bpp; ++i)
+      total += cost(out[i] = uint8_t(row[i] - (prior[i] >> 1)));
+    for (size_t i = bpp; i < size; ++i)
+      total += cost(out[i] =
+                        uint8_t(row[i] - ((row[i - bpp] + prior[i]) >> 1)));
+    break;
+  case 4:
+    for (size_t i = 0; i < bpp; ++i)
+      total += cost(out[i] = uint8_t(row[i] - prior[i]));
+    for (size_t i = bpp; i < size; ++i)
+      total += cost(out[i] = uint8_t(row[i] - paeth(row[i - bpp], prior[i],
+                                                    prior[i - bpp])));
+    break;
+  }
+  return total;
+}
+
+class PNGEncoder : public ImageEncoder {
+public:
+  bool begin(ImageView const &image, uint32_t bandHeight,
+             Bytes &out) override {
+    static uint8_t const colourTypes[5] = {0, 0, 4, 2, 6};
+    if (image.channels < 1 || image.channels > 4) {
+      std::cerr << "[Error] PNG files have 1 to 4 channels, not "
+                << int(image.channels) << '\n';
+      return false;
+    }
+    m_image = image;
+    m_bandHeight = bandHeight;
+    uint32_t bandCount = bandCountOf(image.height, bandHeight);
+    m_adler.assign(bandCount, 1);
+    m_filteredSize.assign(bandCount, 0);
+
+    static unsigned char const signature[8] = {0x89, 'P',  'N',  'G',
+                                               '\r', '\n', 0x1a, '\n'};
+    out.insert(out.end(), signature, signature + 8);
+
+    Bytes header;
+    appendBigEndian(header, image.width);
+    appendBigEndian(header, image.height);
+    header.push_back(8); // bits per channel
+    header.push_back(colourTypes[image.channels]);
+    header.push_back(0); // deflate
+    header.push_back(0); // adaptive filtering
+    header.push_back(0); // not interlaced
+    appendChunk(out, "IHDR", header);
+
+    // the zlib header, fastest compression without dictionary
+    appendChunk(out, "IDAT", Bytes{0x78, 0x01});
+    return true;
+  }
+
+  // the band's rows are filtered and compressed on their own: the first row
+  // doesn't refer to the row before it and matches don't reach into other
+  // bands
+  void encode(uint32_t band, Bytes &out) override {
+    RowRange rows = rowsOf(band, m_bandHeight, m_image.height);
+    uint32_t const bpp = m_image.channels;
+    size_t const rowBytes = size_t(m_image.width) * bpp;
+
+    Bytes filtered((rows.last - rows.first) * (rowBytes + 1));
+    Bytes candidate(rowBytes);
+    unsigned char *p = filtered.data();
+
+    unsigned char const *prior = nullptr;
+    for (uint32_t y = rows.last; y-- > rows.first;) {
+      unsigned char const *row = m_image.row(y);
+
+      int bestFilter = 0;
+      uint64_t bestCost = ~uint64_t(0);
+      for (int filter = 0; filter < 5; ++filter) {
+        // up, average and paeth need the row before
+        if (filter >= 2 && prior == nullptr)
+          break;
+        uint64_t cost =
+            filterRow(filter, row, prior, rowBytes, bpp, candidate.data());
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestFilter = filter;
+          std::copy(candidate.begin(), candidate.end(), p + 1);
+        }
+      }
+      p[0] = uint8_t(bestFilter);
+      p += rowBytes + 1;
+      prior = row;
+    }
+
+    m_adler[band] = adler32(filtered.data(), filtered.size());
+    m_filteredSize[band] = filtered.size();
+
+    Bytes compressed;
+    deflateBlock(filtered.data(), filtered.size(), compressed);
+    appendChunk(out, "IDAT", compressed);
+  }
+
+  void finish(Bytes &out) override {
+    // bands are in the stream top down
+    uint32_t adler = 1;
+    for (size_t band = m_adler.size(); band-- > 0;)
+      adler = combineAdler32(adler, m_adler[band], m_filteredSize[band]);
+
+    Bytes end = {0x01, 0x00, 0x00, 0xff, 0xff}; // empty final stored block
+    appendBigEndian(end, adler);
+    appendChunk(out, "IDAT", end);
+    appendChunk(out, "IEND", Bytes());
+  }
+
+private:
+  static void appendChunk(Bytes &out, char const *type, Bytes const &data) {
+    appendBigEndian(out, uint32_t(data.size()));
+    size_t typeStart = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    appendBigEndian(out, crc32(out.data() + typeStart, data.size() + 4));
+  }
+
+  ImageView m_image;
+  uint32_t m_bandHeight = 0;
+  // per band, combined into the stream's checksum at the end
+  std::vector<uint32_t> m_adler;
+  std::vector<size_t> m_filteredSize;
+};
+
+bool endsWith(std::string const &text, std::string const &suffix) {
+  if (text.size() < suffix.size())
+    return false;
+  return std::equal(suffix.begin(), suffix.end(),
+                    text.end() - suffix.size(), [](char a, char b) {
+                      return std::tolower(static_cast<unsigned char>(a)) ==
+                             std::tolower(static_cast<unsigned char>(b));
+                    });
+}
+
+} // namespace
+
+std::unique_ptr<ImageEncoder> makePNGEncoder() {
+  return std::unique_ptr<ImageEncoder>(new PNGEncoder());
+}
+
+std::unique_ptr<ImageEncoder> makePPMEncoder() {
+  return std::unique_ptr<ImageEncoder>(new RowsEncoder(true));
+}
+
+std::unique_ptr<ImageEncoder> makePFMEncoder() {
+  return std::unique_ptr<ImageEncoder>(new PFMEncoder());
+}
+
+std::unique_ptr<ImageEncoder> makeRawEncoder() {
+  return std::unique_ptr<ImageEncoder>(new RowsEncoder(false));
+}
+
+std::unique_ptr<ImageEncoder> makeEncoderFor(std::string const &path) {
+  if (endsWith(path, ".png"))
+    return makePNGEncoder();
+  if (endsWith(path, ".ppm"))
+    return makePPMEncoder();
+  if (endsWith(path, ".pfm"))
+    return makePFMEncoder();
+  if (endsWith(path, ".raw"))
+    return makeRawEncoder();
+  return nullptr;
+}
+
+ImageOutput::ImageOutput(std::unique_ptr<ImageEncoder> encoder,
+                         ImageView const &image, uint32_t bandHeight,
+                         Prepare prepare)
+    : m_encoder(std::move(encoder)), m_image(image),
+      m_prepare(std::move(prepare)),
+      m_bandHeight(std::max(bandHeight, 1u)),
+      m_bandCount(bandCountOf(image.height, m_bandHeight)),
+      m_remaining(new std::atomic<int64_t>[m_bandCount]),
+      m_encoded(m_bandCount), m_ready(m_bandCount, false) {
+  for (uint32_t band = 0; band < m_bandCount; ++band) {
+    RowRange rows = rowsOf(band, m_bandHeight, image.height);
+    m_remaining[band].store(int64_t(rows.last - rows.first) * image.width);
+  }
+}
+
+bool ImageOutput::open(std::string const &path) {
+  Bytes header;
+  if (!m_encoder->begin(m_image, m_bandHeight, header))
+    return false;
+
+  m_file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!m_file) {
+    std::cerr << "[Error] could not open " << path << '\n';
+    return false;
+  }
+
+  m_file.write(reinterpret_cast<char const *>(header.data()),
+               std::streamsize(header.size()));
+  m_open = true;
+  return true;
+}
+
+void ImageOutput::markDone(int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+  if (!m_open)
+    return;
+
+  int64_t const width = x1 - x0;
+  for (uint32_t band = uint32_t(y0) / m_bandHeight;
+       band < m_bandCount && int32_t(band * m_bandHeight) < y1; ++band) {
+    RowRange rows = rowsOf(band, m_bandHeight, m_image.height);
+    int64_t pixels = (std::min(int64_t(rows.last), int64_t(y1)) -
+                      std::max(int64_t(rows.first), int64_t(y0))) *
+                     width;
+    if (pixels <= 0)
+      continue;
+
+    // the last region of the band makes it ready
+    if (m_remaining[band].fetch_sub(pixels) == pixels) {
+      if (m_prepare)
+        m_prepare(rows.first, rows.last);
+      Bytes bytes;
+      m_encoder->encode(band, bytes);
+      write(band, std::move(bytes));
+    }
+  }
+}
+
+void ImageOutput::write(uint32_t band, Bytes bytes) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  uint32_t position = m_encoder->topDown() ? m_bandCount - 1 - band : band;
+  m_encoded[position] = std::move(bytes);
+  m_ready[position] = true;
+
+  while (m_written < m_bandCount && m_ready[m_written]) {
+    Bytes &next = m_encoded[m_written];
+    m_file.write(reinterpret_cast<char const *>(next.data()),
+                 std::streamsize(next.size()));
+    Bytes().swap(next);
+    ++m_written;
+  }
+}
+
+bool ImageOutput::close() {
+  if (!m_open)
+    return false;
+  m_open = false;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_written != m_bandCount) {
+    std::cerr << "[Error] image output closed before all rows were done\n";
+    m_file.close();
+    return false;
+  }
+
+  Bytes end;
+  m_encoder->finish(end);
+  m_file.write(reinterpret_cast<char const *>(end.data()),
+               std::streamsize(end.size()));
+  m_file.close();
+  return !m_file.fail();
+}
+
+bool writeImage(std::string const &path, ImageView const &image,
+                std::unique_ptr<ImageEncoder> encoder,
+                concurrency::ThreadPool &threadPool) {
+  constexpr uint32_t bandHeight = 32;
+
+  ImageOutput output(std::move(encoder), image, bandHeight);
+  if (!output.open(path))
+    return false;
+
+  threadPool.parallelFor(
+      bandCountOf(image.height, bandHeight), [&](uint32_t band, unsigned) {
+        RowRange rows = rowsOf(band, bandHeight, image.height);
+        output.markDone(0, int32_t(rows.first), int32_t(image.width),
+                        int32_t(rows.last));
+      });
+
+  return output.close();
+}
+
+} // namespace raster
@@ -0,0 +1,510 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "morton.hpp"
+#include "radix_sort.hpp"
+
+namespace geometry {
+
+namespace {
+
+// primitives handed to a task at once
+constexpr uint32_t blockSize = 1 << 16;
+
+constexpr uint32_t maxDepth = 60; // traversal stack holds 64 entries
+constexpr uint32_t none = ~0u;
+
+// as the binned builder
+constexpr float traversalCost = 1.f;
+constexpr float intersectionCost = 1.f;
+
+// leaves of a treelet, its best topology is searched over all 2^5 subsets
+constexpr uint32_t treeletSize = 5;
+
+// subtrees below this many primitives are emitted by one task
+constexpr uint32_t minTaskSize = 1 << 12;
+
+uint32_t blockCount(uint32_t count) {
+  return (count + blockSize - 1) / blockSize;
+}
+
+// x != 0
+int leadingZeros(uint32_t x) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse(&index, x);
+  return 31 - int(index);
+#else
+  return __builtin_clz(x);
+#endif
+}
+
+// index of the lowest set bit, x != 0
+uint32_t lowestBit(uint32_t x) {
+  uint32_t i = 0;
+  while (!(x & (1u << i)))
+    ++i;
+  return i;
+}
+
+uint32_t bitCount(uint32_t x) {
+  uint32_t count = 0;
+  for (; x; x &= x - 1)
+    ++count;
+  return count;
+}
+
+// drops the nodes no interior node points to, keeping the depth first order
+void compact(BVH &bvh) {
+  std::vector<BVHNode> nodes;
+  nodes.reserve(bvh.nodes.size());
+
+  struct Pending {
+    uint32_t from;   // in bvh.nodes
+    uint32_t parent; // in nodes, whose right child this is, none for the root
+  };
+  std::vector<Pending> stack = {{0, none}};
+  while (!stack.empty()) {
+    Pending pending = stack.back();
+    stack.pop_back();
+
+    // walks down the left children, pushing the right ones
+    for (uint32_t from = pending.from;;) {
+      auto to = uint32_t(nodes.size());
+      if (pending.parent != none) {
+        nodes[pending.parent].offset = to;
+        pending.parent = none;
+      }
+      nodes.push_back(bvh.nodes[from]);
+      if (nodes.back().isLeaf())
+        break;
+      stack.push_back({nodes.back().offset, to});
+      from = from + 1;
+    }
+  }
+
+  bvh.nodes.swap(nodes);
+}
+
+// Node of the binary radix tree over the sorted primitives
+// internal nodes are [0, n - 1) and the leaf of sorted primitive i is
+// n - 1 + i, node 0 is the root (the only leaf if n is 1)
+struct TreeNode {
+  AABB bounds;
+  uint32_t left = none;
+  uint32_t right = none;
+  uint32_t parent = none;
+  uint32_t count = 0;     // primitives below
+  uint32_t nodeCount = 0; // BVHNodes the subtree is emitted as
+  float cost = 0.f;       // surface area heuristic, times the node's area
+};
+
+struct Builder {
+  std::vector<AABB> const &primitiveBounds;
+  BVHBuildOptions options;
+  concurrency::ThreadPool &threadPool;
+  uint32_t n;
+
+  std::vector<uint32_t> codes; // sorted Morton codes
+  std::vector<uint32_t> order; // primitive of each sorted slot
+  std::vector<TreeNode> tree;
+
+  Builder(std::vector<AABB> const &primitiveBounds,
+          BVHBuildOptions const &options, concurrency::ThreadPool &threadPool)
+      : primitiveBounds(primitiveBounds), options(options),
+        threadPool(threadPool), n(uint32_t(primitiveBounds.size())) {}
+
+  uint32_t leaf(uint32_t slot) const { return n - 1 + slot; }
+  bool isLeaf(uint32_t node) const { return node >= n - 1; }
+
+  // subtrees this small become one BVH leaf, whatever the tree below
+  bool emitsLeaf(uint32_t count) const { return count <= options.maxLeafSize; }
+
+  float leafCost(uint32_t count) const {
+    auto groups = (count + options.leafGroupSize - 1) / options.leafGroupSize;
+    return intersectionCost * groups;
+  }
+
+  void sortByMortonCode() {
+    uint32_t const blocks = blockCount(n);
+    std::vector<AABB> blockBounds(blocks);
+    threadPool.parallelFor(blocks, [&](uint32_t block, unsigned) {
+      uint32_t last = std::min(n, (block + 1) * blockSize);
+      for (uint32_t i = block * blockSize; i < last; ++i)
+        blockBounds[block] =
+            merge(blockBounds[block], centroid(primitiveBounds[i]));
+    });
+
+    AABB centroidBounds;
+    for (auto const &box : blockBounds)
+      centroidBounds = merge(centroidBounds, box);
+
+    // centroids quantized to a 1024^3 grid over their bounds
+    math::Vec3f const lo = centroidBounds.min;
+    math::Vec3f const size = extent(centroidBounds);
+    auto scale = [](float extent) {
+      return extent > 0.f ? 1023.f / extent : 0.f;
+    };
+    math::Vec3f const toGrid(scale(size.x), scale(size.y), scale(size.z));
+
+    codes.resize(n);
+    order.resize(n);
+    threadPool.parallelFor(blocks, [&](uint32_t block, unsigned) {
+      uint32_t last = std::min(n, (block + 1) * blockSize);
+      for (uint32_t i = block * blockSize; i < last; ++i) {
+        math::Vec3f c = centroid(primitiveBounds[i]);
+        auto cell = [](float x) {
+          return uint32_t(std::min(std::max(x, 0.f), 1023.f));
+        };
+        codes[i] = mortonCode(cell((c.x - lo.x) * toGrid.x),
+                              cell((c.y - lo.y) * toGrid.y),
+                              cell((c.z - lo.z) * toGrid.z));
+        order[i] = i;
+      }
+    });
+
+    concurrency::radixSort(codes, order, threadPool);
+  }
+
+  // length of the common prefix of the keys of slots i and j, -1 outside;
+  // equal codes are told apart by the slot
+  int commonPrefix(int i, int j) const {
+    if (j < 0 || j >= int(n))
+      return -1;
+    uint32_t a = codes[i];
+    uint32_t b = codes[j];
+    if (a == b)
+      return 32 + leadingZeros(uint32_t(i ^ j));
+    return leadingZeros(a ^ b);
+  }
+
+  // Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees,
+  // and k-d Trees" (2012): every internal node finds the range of slots it
+  // covers and where that range splits on its own
+  void linkInternalNode(int i) {
+    int d = commonPrefix(i, i + 1) > commonPrefix(i, i - 1) ? 1 : -1;
+    int minPrefix = commonPrefix(i, i - d);
+
+    // other end of the range, the upper bound first then a binary search
+    int lengthBound = 2;
+    while (commonPrefix(i, i + lengthBound * d) > minPrefix)
+      lengthBound *= 2;
+    int length = 0;
+    for (int step = lengthBound / 2; step >= 1; step /= 2)
+      if (commonPrefix(i, i + (length + step) * d) > minPrefix)
+        length += step;
+    int j = i + length * d;
+
+    // the split is where the prefix of the whole range ends
+    int nodePrefix = commonPrefix(i, j);
+    int split = 0;
+    int step = length;
+    do {
+      step = (step + 1) / 2;
+      if (commonPrefix(i, i + (split + step) * d) > nodePrefix)
+        split += step;
+    } while (step > 1);
+    int gamma = i + split * d + std::min(d, 0);
+
+    uint32_t left = std::min(i, j) == gamma ? leaf(gamma) : uint32_t(gamma);
+    uint32_t right =
+        std::max(i, j) == gamma + 1 ? leaf(gamma + 1) : uint32_t(gamma + 1);
+    tree[i].left = left;
+    tree[i].right = right;
+    tree[left].parent = uint32_t(i);
+    tree[right].parent = uint32_t(i);
+  }
+
+  void buildRadixTree() {
+    tree.resize(2 * n - 1);
+
+    threadPool.parallelFor(blockCount(n), [&](uint32_t block, unsigned) {
+      uint32_t last = std::min(n, (block + 1) * blockSize);
+      for (uint32_t i = block * blockSize; i < last; ++i) {
+        TreeNode &node = tree[leaf(i)];
+        node.bounds = primitiveBounds[order[i]];
+        node.count = 1;
+        node.nodeCount = 1;
+        node.cost = leafCost(1) * surfaceArea(node.bounds);
+        if (i + 1 < n)
+          linkInternalNode(int(i));
+      }
+    });
+  }
+
+  // bounds, counts and cost of an internal node from its children
+  void summarize(uint32_t index) {
+    TreeNode &node = tree[index];
+    TreeNode const &left = tree[node.left];
+    TreeNode const &right = tree[node.right];
+    node.bounds = merge(left.bounds, right.bounds);
+    node.count = left.count + right.count;
+    float area = surfaceArea(node.bounds);
+    if (emitsLeaf(node.count)) {
+      node.nodeCount = 1;
+      node.cost = leafCost(node.count) * area;
+    } else {
+      node.nodeCount = 1 + left.nodeCount + right.nodeCount;
+      node.cost = traversalCost * area + left.cost + right.cost;
+    }
+  }
+
+  // Karras and Aila, "Fast Parallel Construction of High-Quality Bounding
+  // Volume Hierarchies" (2013): the treelet below root is grown to up to
+  // treeletSize leaves by expanding its largest leaf, then rebuilt with the
+  // topology of least cost found by dynamic programming over subsets of its
+  // leaves; the internal nodes are reused, so the tree keeps its size
+  struct Treelet {
+    uint32_t leaves[treeletSize];
+    uint32_t leafCount = 0;
+    uint32_t internals[treeletSize]; // below the root
+    uint32_t internalCount = 0;
+    float cost[1 << treeletSize];     // least cost of a subset of the leaves
+    uint32_t split[1 << treeletSize]; // left side of the best partition
+  };
+
+  void optimizeTreelet(uint32_t root) {
+    Treelet treelet;
+    treelet.leaves[treelet.leafCount++] = tree[root].left;
+    treelet.leaves[treelet.leafCount++] = tree[root].right;
+
+    while (treelet.leafCount < treeletSize) {
+      uint32_t largest = none;
+      float largestArea = -1.f;
+      for (uint32_t i = 0; i < treelet.leafCount; ++i) {
+        uint32_t node = treelet.leaves[i];
+        if (isLeaf(node) || emitsLeaf(tree[node].count))
+          continue;
+        float area = surfaceArea(tree[node].bounds);
+        if (area > largestArea) {
+          largestArea = area;
+          largest = i;
+        }
+      }
+      if (largest == none)
+        break;
+
+      uint32_t expanded = treelet.leaves[largest];
+      treelet.internals[treelet.internalCount++] = expanded;
+      treelet.leaves[largest] = tree[expanded].left;
+      treelet.leaves[treelet.leafCount++] = tree[expanded].right;
+    }
+
+    // two leaves have only the one topology
+    if (treelet.leafCount < 3)
+      return;
+
+    uint32_t const full = (1u << treelet.leafCount) - 1;
+
+    // subsets come before the sets containing them
+    for (uint32_t mask = 1; mask <= full; ++mask) {
+      AABB bounds;
+      uint32_t count = 0;
+      for (uint32_t i = 0; i < treelet.leafCount; ++i) {
+        if (mask & (1u << i)) {
+          bounds = merge(bounds, tree[treelet.leaves[i]].bounds);
+          count += tree[treelet.leaves[i]].count;
+        }
+      }
+
+      if (bitCount(mask) == 1) {
+        treelet.cost[mask] = tree[treelet.leaves[lowestBit(mask)]].cost;
+        continue;
+      }
+
+      // each partition once, with the lowest leaf on the left
+      uint32_t const lowest = mask & (0u - mask);
+      float bestPartition = std::numeric_limits<float>::max();
+      for (uint32_t left = (mask - 1) & mask; left; left = (left - 1) & mask) {
+        if (!(left & lowest))
+          continue;
+        float cost = treelet.cost[left] + treelet.cost[mask ^ left];
+        if (cost < bestPartition) {
+          bestPartition = cost;
+          treelet.split[mask] = left;
+        }
+      }
+
+      float area = surfaceArea(bounds);
+      treelet.cost[mask] = emitsLeaf(count)
+                               ? leafCost(count) * area
+                               : traversalCost * area + bestPartition;
+    }
+
+    if (treelet.cost[full] < tree[root].cost * (1.f - 1e-5f))
+      rebuildTreelet(treelet, full, root);
+  }
+
+  // links the subtree over the leaves in mask below node as treelet.split
+  // says, internal nodes are taken from the treelet's
+  void rebuildTreelet(Treelet &treelet, uint32_t mask, uint32_t node) {
+    uint32_t const sides[2] = {treelet.split[mask],
+                               mask ^ treelet.split[mask]};
+    uint32_t children[2];
+    for (int side = 0; side < 2; ++side) {
+      if (bitCount(sides[side]) == 1) {
+        children[side] = treelet.leaves[lowestBit(sides[side])];
+      } else {
+        children[side] = treelet.internals[--treelet.internalCount];
+        rebuildTreelet(treelet, sides[side], children[side]);
+      }
+      tree[children[side]].parent = node;
+    }
+    tree[node].left = children[0];
+    tree[node].right = children[1];
+    summarize(node);
+  }
+
+  // visits every internal node once after both of its children: the thread
+  // of a leaf walks up and stops at the first node whose other child is
+  // still being worked on, the thread finishing that child goes on from there
+  template <typename Visit> void bottomUp(Visit visit) {
+    std::unique_ptr<std::atomic<uint32_t>[]> arrivals(
+        new std::atomic<uint32_t>[n - 1]);
+    for (uint32_t i = 0; i + 1 < n; ++i)
+      arrivals[i].store(0, std::memory_order_relaxed);
+
+    threadPool.parallelFor(blockCount(n), [&](uint32_t block, unsigned) {
+      uint32_t last = std::min(n, (block + 1) * blockSize);
+      for (uint32_t i = block * blockSize; i < last; ++i) {
+        uint32_t node = leaf(i);
+        for (;;) {
+          uint32_t parent = tree[node].parent;
+          if (parent == none ||
+              arrivals[parent].fetch_add(1, std::memory_order_acq_rel) == 0)
+            break;
+          visit(parent);
+          node = parent;
+        }
+      }
+    });
+  }
+
+  void summarizeTree() {
+    if (options.treeletRounds == 0) {
+      bottomUp([&](uint32_t node) { summarize(node); });
+      return;
+    }
+
+    for (uint32_t round = 0; round < options.treeletRounds; ++round) {
+      bottomUp([&](uint32_t node) {
+        summarize(node);
+        if (!emitsLeaf(tree[node].count))
+          optimizeTreelet(node);
+      });
+    }
+  }
+
+  // writes node as bvh.nodes[index] and its primitives from
+  // bvh.primitiveIndices[first] on
+  // returns false if it had to cut the tree at maxDepth
+  bool emit(BVH &bvh, uint32_t node, uint32_t index, uint32_t first,
+            uint32_t depth) const {
+    TreeNode const &treeNode = tree[node];
+    BVHNode &out = bvh.nodes[index];
+    out.bounds = treeNode.bounds;
+
+    if (emitsLeaf(treeNode.count) || depth >= maxDepth) {
+      out.offset = first;
+      out.count = treeNode.count;
+      uint32_t next = first;
+      gather(bvh, node, next);
+      return !(depth >= maxDepth && !emitsLeaf(treeNode.count));
+    }
+
+    uint32_t left = treeNode.left;
+    out.count = 0;
+    out.offset = index + 1 + tree[left].nodeCount;
+    bool leftComplete = emit(bvh, left, index + 1, first, depth + 1);
+    bool rightComplete = emit(bvh, treeNode.right, out.offset,
+                              first + tree[left].count, depth + 1);
+    return leftComplete && rightComplete;
+  }
+
+  // the primitives below node in tree order
+  void gather(BVH &bvh, uint32_t node, uint32_t &next) const {
+    if (isLeaf(node)) {
+      bvh.primitiveIndices[next++] = order[node - (n - 1)];
+      return;
+    }
+    gather(bvh, tree[node].left, next);
+    gather(bvh, tree[node].right, next);
+  }
+
+  struct EmitTask {
+    uint32_t node, index, first, depth;
+  };
+
+  // the top of the tree serially, down to subtrees small enough for a task
+  void emitTop(BVH &bvh, uint32_t node, uint32_t index, uint32_t first,
+               uint32_t depth, uint32_t taskSize,
+               std::vector<EmitTask> &tasks) const {
+    TreeNode const &treeNode = tree[node];
+    if (treeNode.count <= taskSize || emitsLeaf(treeNode.count) ||
+        depth >= maxDepth) {
+      tasks.push_back({node, index, first, depth});
+      return;
+    }
+
+    uint32_t left = treeNode.left;
+    BVHNode &out = bvh.nodes[index];
+    out.bounds = treeNode.bounds;
+    out.count = 0;
+    out.offset = index + 1 + tree[left].nodeCount;
+    emitTop(bvh, left, index + 1, first, depth + 1, taskSize, tasks);
+    emitTop(bvh, treeNode.right, out.offset, first + tree[left].count,
+            depth + 1, taskSize, tasks);
+  }
+
+  BVH emit() const {
+    BVH bvh;
+    bvh.nodes.resize(tree[0].nodeCount);
+    bvh.primitiveIndices.resize(n);
+
+    uint32_t taskSize =
+        std::max(minTaskSize, n / (16 * threadPool.threadCount()));
+    std::vector<EmitTask> tasks;
+    emitTop(bvh, 0, 0, 0, 0, taskSize, tasks);
+
+    std::atomic<bool> complete(true);
+    threadPool.parallelFor(uint32_t(tasks.size()), [&](uint32_t i, unsigned) {
+      EmitTask const &task = tasks[i];
+      if (!emit(bvh, task.node, task.index, task.first, task.depth))
+        complete.store(false, std::memory_order_relaxed);
+    });
+
+    // subtrees cut at maxDepth left their nodes unused
+    if (!complete.load())
+      compact(bvh);
+    return bvh;
+  }
+
+  BVH build() {
+    sortByMortonCode();
+    buildRadixTree();
+    summarizeTree();
+    return emit();
+  }
+};
+
+} // namespace
+
+BVH buildLinearBVH(std::vector<AABB> const &primitiveBounds,
+                   concurrency::ThreadPool &threadPool,
+                   BVHBuildOptions const &options) {
+  if (primitiveBounds.empty())
+    return BVH();
+
+  Builder builder(primitiveBounds, options, threadPool);
+  return builder.build();
+}
+
+} // namespace geometry
@@ -1,8 +1,8 @@
+#include <atomic>
 #include <iostream>
 #include <vector>
 #include <cmath>
 #include <cassert> //assert
-#include <random>
 #include <fstream>
 #include <string>
 
@@ -11,6 +11,8 @@
 #include "vec3f.hpp"
 #include "vec2f.hpp"
 #include "image.hpp"
+#include "image_output.hpp"
+#include "tonemap.hpp"
 #include "vec2i.hpp"
 #include "grid2.hpp"
 #include "timer.hpp"
@@ -18,6 +20,17 @@
 #include "plane.hpp"
 #include "ray.hpp"
 #include "ray_intersect.hpp"
+#include "aabb.hpp"
+#include "scene.hpp"
+#include "common_matrices.hpp"
+#include "mesh_instance.hpp"
+#include "mesh_cache.hpp"
+#include "obj_mesh_file_io.hpp"
+#include "benchmark.hpp"
+#include "thread_pool.hpp"
+#include "ray_packet.hpp"
+#include "ray_queue.hpp"
+#include "random.hpp"
 
 
 using namespace math;
@@ -28,54 +41,73 @@ using namespace std;
 int width;
 int height;
 
+//optional OBJ mesh, instanced meshInstances x meshInstances times
+string meshFile;
+int meshInstances = 1;
+
+//run the named micro benchmark instead of rendering
+string benchmarkName;
+
+//rendered image, the format is chosen by the extension: .png, .ppm, .pfm, .raw
+string outputFile = "./test.png";
+
+//exposure, tone curve and dithering of the 8 bit output
+raster::ToneMapping toneMapping;
+
+//render threads, 0 uses all hardware threads
+unsigned renderThreads = 0;
+
+//primary and shadow rays are traced in packets of 4, 8 or 16 neighbouring
+//pixels, 0 traces every ray on its own
+uint32_t packetSize = 16;
+
+//trace the paths of a tile as a wavefront, one stage at a time over queues of
+//rays, instead of one path after the other
+bool wavefront = false;
+
+//in wavefront mode, sort the reflection and shadow rays from the second
+//bounce on by direction and origin so they are traced in coherent packets;
+//pays off once the queues are long and the BVHs big (see "benchmark
+//raysort"), the queues of a tile are short
+bool sortRays = false;
+
+//builder of the sphere and triangle BVHs: sah (default) or linear, which
+//builds millions of primitives in milliseconds for a slower tree; treelets
+//restructuring passes improve the linear tree (see "benchmark lbvh");
+//accelerator picks what single rays traverse instead of the BVHs: bvh
+//(default), wide_bvh for 4 or 8 wide quantized BVHs (see "benchmark wide"),
+//grid or two_level_grid for grids traversed with a 3D-DDA (see "benchmark
+//grid")
+raytracing::SceneBuildOptions sceneBuild;
+
+//adaptive anti-aliasing: every pixel gets firstSamples jittered samples, then
+//more one at a time until the standard error of its mean luminance drops
+//below sampleError or it has samples; samples 1 traces the pixel centres
+struct AntiAliasing {
+  uint32_t samples = 1;
+  uint32_t firstSamples = 4;
+  float sampleError = 1.f / 256;
+} antiAliasing;
+
+//reflections: a path bounces at most bounces times, keeping reflectance of
+//the light each time; once its throughput drops below minContribution it
+//ends at random (Russian roulette), surviving with probability
+//throughput / minContribution
+struct Reflections {
+  uint32_t bounces = 2;
+  float reflectance = 0.7f;
+  float minContribution = 0.05f;
+} reflections;
 
 
 namespace raytracing {
 
-Vec3f normalAt(Vec3f const &p, Triangle const &t) {
-
-}
-
-Vec3f normalAt(Vec3f const &p, Sphere const &s) {
-  Vec3f n = (p - s.origin) / s.radius;
-
-  n = normalized(n);
-
-  return n;
-}
-
-Vec3f normalAt(Vec3f const &point, Plane const &plane) { return plane.normal; }
-
-struct Surface {
-  virtual ~Surface() = default;
-  virtual Hit intersectSelf(Ray const &ray) const = 0;
-  virtual Vec3f normalAtSelf(Vec3f const &p) const = 0;
-  virtual Vec3f colour() const = 0;
-};
-
-// helper class/function to make, e.g., class Sphere : public Surface
-// Wrapping the geometry (e.g., sphere) in a class for intersection
-// does not 'pollute' the geometry with inheritence
-template <class T> struct Intersect_ : public Surface {
-  template <typename... Args>
-  Intersect_(Args... args)
-      : m_self(std::forward<Args>(args)...) {}
-
-  Hit intersectSelf(Ray const &ray) const { return intersect(ray, m_self); }
-  Vec3f normalAtSelf(Vec3f const &p) const { return normalAt(p, m_self); }
-  Vec3f colour() const {return m_self.colour;}
-
-  T m_self;
-};
-
-template <typename T> std::unique_ptr<Intersect_<T>> makeIntersectable(T t) {
-  return std::unique_ptr<Intersect_<T>>(new Intersect_<T>(t));
-}
-
 struct ImagePlane {
   using Screen = geometry::Grid2<raster::RGB>;
+  using Radiance = geometry::Grid2<math::Vec3f>;
 
-  Screen screen;
+  Radiance radiance; // linear HDR colour the renderer writes
+  Screen screen;     // 8 bit output, tonemapped from radiance
   math::Vec3f origin;
   math::Vec3f u;
   math::Vec3f v;
@@ -84,6 +116,7 @@ struct ImagePlane {
 
   //ignore the given parameters, use global width and height instead
   ImagePlane &resolution(uint32_t local_width, uint32_t local_height) {
+    radiance = Radiance(width, height);
     screen = Screen(width, height);
     return *this;
   }
@@ -139,43 +172,33 @@ ImagePlane makeImagePlane(Vec3f const &eye, Vec3f const &lookatPosition,
   return imagePlane;
 }
 
-using s_ptr = std::unique_ptr<Surface>;
-
-Vec3f castRay(Ray ray,
-              math::Vec3f eye,   //
-              math::Vec3f light, //
-              std::vector<s_ptr> const &surfaces,
-              int reflectionDepth) {
-
-  constexpr float ambientIntensity = 0.1f;
+Vec3f const backgroundColour(0.1f, 0.1f, 0.1f);
 
-  // background color
-  Vec3f colorOut(0.1f, 0.1f, 0.1f);
+// ray from the hit point up to the light
+Ray shadowRay(SceneHit const &closest, math::Vec3f light) {
+    Vec3f rayP = closest.point;
 
-  // find closed object, if any
-  Hit closest;
-  // pointer to closest object
-  Surface const *surface = nullptr;
-  for (auto const &s : surfaces) {
-    auto hit = s->intersectSelf(ray);
-    if (hit && (hit.rayDepth < closest.rayDepth) && hit.rayDepth > 0.f) {
-      closest = hit;
-      surface = s.get();
-    }
-  }
+    //only blockers between the surface and the light count
+    return Ray(rayP, normalized(light - rayP), surfaceEpsilon,
+               distance(light, rayP));
+}
 
-  // if hit get point
-  if (surface != nullptr) {
-      Vec3f lightColour = surface->colour();
-    float t = closest.rayDepth;
+// lighting at a hit from the light alone, inShadow is whether its shadowRay
+// is blocked
+Vec3f directLighting(SceneHit const &closest,
+                     bool inShadow,
+                     math::Vec3f eye,   //
+                     math::Vec3f light, //
+                     Scene const &scene) {
 
+  constexpr float ambientIntensity = 0.1f;
 
+      Vec3f lightColour = colourAt(closest, scene);
 
     //spot on sphere where the intersection occurs
-    Vec3f rayP = ray.origin + (t * ray.direction);
+    Vec3f rayP = closest.point;
 
-    Vec3f normal = surface->normalAtSelf(rayP);
-    normal = normalized(normal);
+    Vec3f normal = closest.normal;
 
     //we can now do the phong lighting equation using that point
 
@@ -203,80 +226,524 @@ Vec3f castRay(Ray ray,
     //lighting before shadow and reflections
     Vec3f result = (ambient + diffuse + specular);
 
-    colorOut = result;
-
-    Ray shadow;
-    shadow.direction = normalized(light - rayP);
-    //p = e + td
-    shadow.origin = rayP + (shadow.direction * 0.00001f);
-    Surface const *surface = nullptr;
-    for(auto const &s : surfaces) {
-        auto hit = s->intersectSelf(shadow);
-        //if shadow ray hits anything within bounds, set that to ambient light
-        if(hit && (hit.rayDepth < 1e+5) && (hit.rayDepth > 0)) {
-            colorOut = ambient;
-            break;
-        }
-    }
+    Vec3f colorOut = result;
 
-    //reflection
-    if(reflectionDepth >= 0) {
-        //find reflection ray and shoot it
-        //adjust colourOut
+    //if shadow ray hits anything within bounds, set that to ambient light
+    if(inShadow) {
+        colorOut = ambient;
+    }
 
-        Vec3f reflectionDirection = eye - (2 * normal * (eye * normal));
+  return colorOut;
+}
 
-        reflectionDirection = -normalized(reflectionDirection);
+// mirror reflection off a hit
+Ray reflectionRay(SceneHit const &closest, math::Vec3f eye) {
+    Vec3f normal = closest.normal;
 
-        auto bias = 1e-4f;
-        Ray reflectionRay(rayP + (reflectionDirection * bias), reflectionDirection);
+    Vec3f reflectionDirection = eye - (2 * normal * (eye * normal));
 
+    reflectionDirection = -normalized(reflectionDirection);
 
-        float reflectionMagnitude = 0.7f;
+    return Ray(closest.point, reflectionDirection, surfaceEpsilon);
+}
 
-        colorOut += reflectionMagnitude * castRay(reflectionRay, eye, light, surfaces, reflectionDepth - 1);
+// lighting at a hit including its reflections, inShadow is whether its
+// shadowRay is blocked; pixel and sample seed the Russian roulette
+//
+// the path is followed in a loop, each bounce adding its direct lighting
+// weighted by the throughput, the share of it that makes it back to the
+// camera
+Vec3f shade(SceneHit const &closest,
+            bool inShadow,
+            math::Vec3f eye,   //
+            math::Vec3f light, //
+            Scene const &scene,
+            OcclusionCache &occlusionCache,
+            uint32_t pixel,
+            uint32_t sample) {
+
+  Vec3f colorOut = directLighting(closest, inShadow, eye, light, scene);
+
+  SceneHit hit = closest;
+  float throughput = 1.f;
+  for (uint32_t bounce = 0; bounce < reflections.bounces; ++bounce) {
+    throughput *= reflections.reflectance;
+
+    // paths that can't add much any more end at random, the survivors
+    // carrying the share of those that ended so the mean is unchanged
+    if (throughput < reflections.minContribution) {
+      float survival = throughput / reflections.minContribution;
+      if (sampling::random01(pixel, sample, sampling::ROULETTE + bounce) >=
+          survival)
+        break;
+      throughput = reflections.minContribution;
     }
 
+    hit = intersect(reflectionRay(hit, eye), scene);
+    if (!hit) {
+      colorOut += throughput * backgroundColour;
+      break;
+    }
 
+    bool hitInShadow =
+        occluded(shadowRay(hit, light), scene, occlusionCache);
+    colorOut +=
+        throughput * directLighting(hit, hitInShadow, eye, light, scene);
   }
+
   return colorOut;
 }
 
-void render(ImagePlane &imagePlane, //
-            math::Vec3f eye,        // all below could be in 'scene' object
-            math::Vec3f light,      //
-            std::vector<s_ptr> const &surfaces) {
+Vec3f castRay(Ray ray,
+              math::Vec3f eye,   //
+              math::Vec3f light, //
+              Scene const &scene,
+              OcclusionCache &occlusionCache,
+              uint32_t pixel,
+              uint32_t sample) {
+
+  // find closed object, if any
+  SceneHit closest = intersect(ray, scene);
+
+  // background color
+  if (!closest)
+    return backgroundColour;
+
+  bool inShadow = occluded(shadowRay(closest, light), scene, occlusionCache);
+
+  return shade(closest, inShadow, eye, light, scene, occlusionCache, pixel,
+               sample);
+}
+
+// offset from the centre of the pixel, in pixels
+Ray primaryRay(ImagePlane const &imagePlane, math::Vec3f eye, int32_t x,
+               int32_t y, math::Vec2f offset = math::Vec2f(0.f, 0.f)) {
+  math::Vec2f pixel(x + offset.x, y + offset.y);
+  auto pixel3D = imagePlane.pixelTo3D(pixel);
+  auto direction = normalized(pixel3D - eye);
+  return Ray(eye, direction);
+}
+
+// pixels covered by a packet, packets of 8 are 4 pixels wide and 2 high
+struct PacketShape {
+  int32_t width;
+  int32_t height;
+};
+
+PacketShape packetShape(uint32_t size) {
+  switch (size) {
+  case 4:
+    return {2, 2};
+  case 8:
+    return {4, 2};
+  default:
+    return {4, 4};
+  }
+}
+
+// square tiles of the image are the unit of work for the render threads
+constexpr int32_t tileSize = 16;
+
+// position of a sample in its pixel: the R2 low discrepancy sequence
+// (M. Roberts), shifted by a random amount per pixel so neighbouring pixels
+// don't share a pattern; any number of samples covers the pixel evenly
+math::Vec2f sampleOffset(uint32_t pixel, uint32_t sample) {
+  if (antiAliasing.samples <= 1)
+    return math::Vec2f(0.f, 0.f);
+  float u = sampling::random01(pixel, 0, sampling::PIXEL_X) +
+            float(sample) * 0.7548776662f;
+  float v = sampling::random01(pixel, 0, sampling::PIXEL_Y) +
+            float(sample) * 0.5698402910f;
+  return math::Vec2f(u - std::floor(u) - 0.5f, v - std::floor(v) - 0.5f);
+}
 
-  // Standard mersenne_twister_engine seeded
-  thread_local std::mt19937 gen(0);
-  auto sampleRange = [](float a, float b) {
-    using distrubution = std::uniform_real_distribution<>;
-    return distrubution(a, b)(gen);
-  };
+// running sums of the samples of a pixel
+struct PixelSamples {
+  Vec3f sum = Vec3f(0.f, 0.f, 0.f);
+  float luminance = 0.f;
+  float luminanceSquared = 0.f;
+  uint32_t count = 0;
+
+  void add(Vec3f colour) {
+    sum += colour;
+    // luminance of what the display shows, so bright highlights don't keep
+    // asking for samples they can't use
+    float l = 0.2126f * min(max(colour.x, 0.f), 1.f) +
+              0.7152f * min(max(colour.y, 0.f), 1.f) +
+              0.0722f * min(max(colour.z, 0.f), 1.f);
+    luminance += l;
+    luminanceSquared += l * l;
+    ++count;
+  }
 
+  // the variance of the mean, estimated from the spread of the samples, is
+  // within maxError squared
+  bool converged(float maxError) const {
+    if (count < 2)
+      return false;
+    float n = float(count);
+    float mean = luminance / n;
+    float variance =
+        max(0.f, (luminanceSquared - n * mean * mean) / (n - 1.f));
+    return variance / n <= maxError * maxError;
+  }
+};
 
-  for (int32_t y = 0; y < imagePlane.screen.height(); ++y) {
-    for (int32_t x = 0; x < imagePlane.screen.width(); ++x) {
+// Wavefront tracing: rather than following each path to its end before
+// starting the next, all paths of a wave advance together one stage at a
+// time, each stage a loop over a queue of rays: closest hits, shadow rays,
+// then lighting, which puts the reflection rays of the paths that go on
+// into the next queue. Every loop runs the same code over data laid out in
+// the order it reads it
+struct Wave {
+  // per path, by slot
+  std::vector<uint32_t> pixel;
+  std::vector<uint32_t> sample;
+  std::vector<Vec3f> colour; // what castRay returns for the path
+
+  // per ray of the current bounce
+  RayQueue rays;
+  std::vector<uint32_t> path; // slot of the path the ray belongs to
+  std::vector<float> throughput;
+
+  // kept from wave to wave so their memory is reused
+  std::vector<SceneHit> hits;
+  RayQueue shadows;
+  std::vector<bool> shadowed;
+  RayQueue nextRays;
+  std::vector<uint32_t> nextPath;
+  std::vector<float> nextThroughput;
+  RaySort sort;
+  std::vector<bool> sortedShadowed;
+  std::vector<uint32_t> indexScratch;
+  std::vector<float> floatScratch;
+
+  uint32_t size() const { return uint32_t(pixel.size()); }
+
+  void clear() {
+    pixel.clear();
+    sample.clear();
+    rays.clear();
+    path.clear();
+    throughput.clear();
+  }
 
-      math::Vec2f pixel(x, y);
-      auto pixel3D = imagePlane.pixelTo3D(pixel);
-      auto direction = normalized(pixel3D - eye);
-      auto bias = 1e-4f;
-      auto p = pointOnLne(eye, direction, bias);
-      Ray r(p, direction);
+  void add(Ray const &ray, uint32_t pixelIndex, uint32_t sampleIndex) {
+    path.push_back(size());
+    pixel.push_back(pixelIndex);
+    sample.push_back(sampleIndex);
+    append(rays, ray);
+    throughput.push_back(1.f);
+  }
+};
 
-      auto colorOut = castRay(r, eye, light, surfaces, 1);
+// colour[i] of the wave comes out the same as castRay for path i
+void trace(Wave &wave,
+           math::Vec3f eye,   //
+           math::Vec3f light, //
+           Scene const &scene,
+           OcclusionCache &occlusionCache) {
+  wave.colour.resize(wave.size());
+
+  // paths of a wave are all on the same bounce
+  for (uint32_t bounce = 0; !wave.rays.empty(); ++bounce) {
+    // the rays of neighbouring paths stay next to each other in the queue,
+    // so reflections off the same surface are traced as packets too; packet
+    // traversal falls back to single rays where they diverge
+    intersect(wave.rays, scene, wave.hits, packetSize);
+
+    wave.shadows.clear();
+    for (uint32_t i = 0; i < wave.rays.size(); ++i)
+      if (wave.hits[i])
+        append(wave.shadows, shadowRay(wave.hits[i], light));
+
+    // rays of the primary hits and their first reflections are still
+    // coherent in pixel order, after that they go every which way
+    if (sortRays && bounce >= 2) {
+      sortByCoherence(wave.shadows, wave.sort);
+      occluded(wave.shadows, scene, wave.sortedShadowed, occlusionCache,
+               packetSize);
+      wave.shadowed.resize(wave.shadows.size());
+      for (uint32_t i = 0; i < wave.shadows.size(); ++i)
+        wave.shadowed[wave.sort.order[i]] = wave.sortedShadowed[i];
+    } else {
+      occluded(wave.shadows, scene, wave.shadowed, occlusionCache,
+               packetSize);
+    }
 
-      // correct to quantiezed error
-      // (i.e., removes banded aliasing when converting to 8bit RGB)
-      constexpr float halfStep = 1.f / 512;
-      colorOut = raster::quantizedErrorCorrection(
-          colorOut, sampleRange(-halfStep, halfStep));
+    // lighting, and stream compaction: the rays of paths that go on are
+    // packed into the next queue
+    wave.nextRays.clear();
+    wave.nextPath.clear();
+    wave.nextThroughput.clear();
+    uint32_t shadow = 0;
+    for (uint32_t i = 0; i < wave.rays.size(); ++i) {
+      uint32_t const path = wave.path[i];
+      float throughput = wave.throughput[i];
+      SceneHit const &hit = wave.hits[i];
+
+      if (!hit) {
+        if (bounce == 0)
+          wave.colour[path] = backgroundColour;
+        else
+          wave.colour[path] += throughput * backgroundColour;
+        continue;
+      }
+
+      Vec3f direct = directLighting(hit, wave.shadowed[shadow++], eye, light,
+                                    scene);
+      if (bounce == 0)
+        wave.colour[path] = direct;
+      else
+        wave.colour[path] += throughput * direct;
+
+      // as in shade
+      if (bounce >= reflections.bounces)
+        continue;
+      throughput *= reflections.reflectance;
+      if (throughput < reflections.minContribution) {
+        float survival = throughput / reflections.minContribution;
+        if (sampling::random01(wave.pixel[path], wave.sample[path],
+                               sampling::ROULETTE + bounce) >= survival)
+          continue;
+        throughput = reflections.minContribution;
+      }
+
+      append(wave.nextRays, reflectionRay(hit, eye));
+      wave.nextPath.push_back(path);
+      wave.nextThroughput.push_back(throughput);
+    }
 
-      imagePlane.screen({x, y}) = raster::convertToRGB(colorOut);
+    // the reflections traced next, sorted from the second bounce on
+    if (sortRays && bounce + 1 >= 2) {
+      sortByCoherence(wave.nextRays, wave.sort);
+      permute(wave.nextPath, wave.sort, wave.indexScratch);
+      permute(wave.nextThroughput, wave.sort, wave.floatScratch);
     }
+
+    std::swap(wave.rays, wave.nextRays);
+    std::swap(wave.path, wave.nextPath);
+    std::swap(wave.throughput, wave.nextThroughput);
   }
 }
+
+// returns the number of primary samples traced
+uint64_t render(ImagePlane &imagePlane, //
+                math::Vec3f eye,        // all below could be in 'scene' object
+                math::Vec3f light,      //
+                Scene const &scene,
+                concurrency::ThreadPool &threadPool,
+                raster::ImageOutput &output) {
+
+  int32_t const screenWidth = imagePlane.screen.width();
+  int32_t const screenHeight = imagePlane.screen.height();
+  int32_t const tilesX = (screenWidth + tileSize - 1) / tileSize;
+  int32_t const tilesY = (screenHeight + tileSize - 1) / tileSize;
+
+  uint32_t const maxSamples = max(antiAliasing.samples, 1u);
+  uint32_t const firstSamples =
+      min(max(antiAliasing.firstSamples, 1u), maxSamples);
+
+  std::atomic<uint64_t> samplesTraced(0);
+
+  // one per thread, the queues grow to the largest wave and stay that size
+  std::vector<Wave> waves(wavefront ? threadPool.threadCount() : 0);
+
+  threadPool.parallelFor(tilesX * tilesY, [&](uint32_t tile, unsigned worker) {
+    // from the top of the image down, the order most formats store the rows
+    // in, so the output can write them out while the rest is rendered
+    int32_t const x0 = (tile % tilesX) * tileSize;
+    int32_t const y0 = (tilesY - 1 - int32_t(tile) / tilesX) * tileSize;
+    int32_t const x1 = min(x0 + tileSize, screenWidth);
+    int32_t const y1 = min(y0 + tileSize, screenHeight);
+
+    // pixels are sampled into a tile local to the thread and only copied to
+    // the image row by row at the end, so threads don't keep writing to
+    // cache lines shared with neighbouring tiles
+    PixelSamples tilePixels[tileSize * tileSize];
+
+    // shadow rays of a tile tend to be blocked by the same primitives
+    OcclusionCache occlusionCache;
+
+    auto pixelIndex = [&](int32_t x, int32_t y) {
+      return uint32_t(y * screenWidth + x);
+    };
+
+    auto samplePixel = [&](int32_t x, int32_t y) -> PixelSamples & {
+      return tilePixels[(y - y0) * tileSize + (x - x0)];
+    };
+
+    auto sampleRay = [&](int32_t x, int32_t y, uint32_t sample) {
+      return primaryRay(imagePlane, eye, x, y,
+                        sampleOffset(pixelIndex(x, y), sample));
+    };
+
+    // every pixel gets the first samples, the same sample of all pixels of
+    // the tile at a time so packets stay coherent
+    if (wavefront) {
+      // all first samples of the tile in one wave, the rays of a packet
+      // next to each other in the queue
+      Wave &wave = waves[worker];
+      PacketShape const shape = packetShape(packetSize);
+      wave.clear();
+      for (uint32_t sample = 0; sample < firstSamples; ++sample)
+        for (int32_t by = y0; by < y1; by += shape.height)
+          for (int32_t bx = x0; bx < x1; bx += shape.width)
+            for (int32_t y = by; y < min(by + shape.height, y1); ++y)
+              for (int32_t x = bx; x < min(bx + shape.width, x1); ++x)
+                wave.add(sampleRay(x, y, sample), pixelIndex(x, y), sample);
+
+      trace(wave, eye, light, scene, occlusionCache);
+      for (uint32_t i = 0; i < wave.size(); ++i)
+        samplePixel(int32_t(wave.pixel[i]) % screenWidth,
+                    int32_t(wave.pixel[i]) / screenWidth)
+            .add(wave.colour[i]);
+    } else {
+      for (uint32_t sample = 0; sample < firstSamples; ++sample) {
+        if (packetSize == 0) {
+          for (int32_t y = y0; y < y1; ++y) {
+            for (int32_t x = x0; x < x1; ++x) {
+              Ray r = sampleRay(x, y, sample);
+              samplePixel(x, y).add(castRay(r, eye, light, scene,
+                                            occlusionCache, pixelIndex(x, y),
+                                            sample));
+            }
+          }
+          continue;
+        }
+
+        // primary rays of a block of pixels as one packet, then the shadow
+        // rays of those that hit something as another; reflections are
+        // incoherent and followed one path at a time
+        PacketShape const shape = packetShape(packetSize);
+
+        for (int32_t by = y0; by < y1; by += shape.height) {
+          for (int32_t bx = x0; bx < x1; bx += shape.width) {
+            RayPacket primary;
+            for (int32_t y = by; y < min(by + shape.height, y1); ++y)
+              for (int32_t x = bx; x < min(bx + shape.width, x1); ++x)
+                append(primary, sampleRay(x, y, sample));
+
+            SceneHit hits[maxPacketSize];
+            intersect(primary, scene, hits);
+
+            RayPacket shadows;
+            uint32_t shadowOf[maxPacketSize];
+            for (uint32_t i = 0; i < primary.size; ++i) {
+              if (hits[i]) {
+                shadowOf[shadows.size] = i;
+                append(shadows, shadowRay(hits[i], light));
+              }
+            }
+
+            bool shadowed[maxPacketSize];
+            occluded(shadows, scene, shadowed, occlusionCache);
+
+            bool inShadow[maxPacketSize] = {};
+            for (uint32_t i = 0; i < shadows.size; ++i)
+              inShadow[shadowOf[i]] = shadowed[i];
+
+            int32_t const blockWidth = min(bx + shape.width, x1) - bx;
+            for (uint32_t i = 0; i < primary.size; ++i) {
+              int32_t x = bx + int32_t(i) % blockWidth;
+              int32_t y = by + int32_t(i) / blockWidth;
+              samplePixel(x, y).add(
+                  hits[i] ? shade(hits[i], inShadow[i], eye, light, scene,
+                                  occlusionCache, pixelIndex(x, y), sample)
+                          : backgroundColour);
+            }
+          }
+        }
+      }
+    }
+
+    // the rest only where the first samples disagree, mostly edges, shadow
+    // boundaries and reflections of them. Features thinner than the gaps
+    // between the first samples can be missed by all of them, so the
+    // neighbours of a noisy pixel are refined as well, and get at least twice
+    // the first samples before their own spread is trusted
+    bool noisy[tileSize * tileSize] = {};
+    if (maxSamples > firstSamples)
+      for (int32_t y = y0; y < y1; ++y)
+        for (int32_t x = x0; x < x1; ++x)
+          noisy[(y - y0) * tileSize + (x - x0)] =
+              !samplePixel(x, y).converged(antiAliasing.sampleError);
+
+    auto isNoisy = [&](int32_t x, int32_t y) {
+      return x >= x0 && x < x1 && y >= y0 && y < y1 &&
+             noisy[(y - y0) * tileSize + (x - x0)];
+    };
+
+    bool refine[tileSize * tileSize];
+    for (int32_t y = y0; y < y1; ++y)
+      for (int32_t x = x0; x < x1; ++x)
+        refine[(y - y0) * tileSize + (x - x0)] =
+            isNoisy(x, y) || isNoisy(x - 1, y) || isNoisy(x + 1, y) ||
+            isNoisy(x, y - 1) || isNoisy(x, y + 1);
+
+    uint32_t const refinedSamples = min(2 * firstSamples, maxSamples);
+    auto wantsSample = [&](int32_t x, int32_t y) {
+      PixelSamples const &pixel = samplePixel(x, y);
+      return refine[(y - y0) * tileSize + (x - x0)] &&
+             pixel.count < maxSamples &&
+             (pixel.count < refinedSamples ||
+              !pixel.converged(antiAliasing.sampleError));
+    };
+
+    if (wavefront) {
+      Wave &wave = waves[worker];
+      // a wave adds one sample to every pixel that still wants one, until
+      // none does; each pixel gets the same samples as one by one
+      for (;;) {
+        wave.clear();
+        for (int32_t y = y0; y < y1; ++y)
+          for (int32_t x = x0; x < x1; ++x)
+            if (wantsSample(x, y)) {
+              uint32_t sample = samplePixel(x, y).count;
+              wave.add(sampleRay(x, y, sample), pixelIndex(x, y), sample);
+            }
+        if (wave.size() == 0)
+          break;
+
+        trace(wave, eye, light, scene, occlusionCache);
+        for (uint32_t i = 0; i < wave.size(); ++i)
+          samplePixel(int32_t(wave.pixel[i]) % screenWidth,
+                      int32_t(wave.pixel[i]) / screenWidth)
+              .add(wave.colour[i]);
+      }
+    } else {
+      // few and scattered, so traced one by one
+      for (int32_t y = y0; y < y1; ++y) {
+        for (int32_t x = x0; x < x1; ++x) {
+          while (wantsSample(x, y)) {
+            PixelSamples &pixel = samplePixel(x, y);
+            Ray r = sampleRay(x, y, pixel.count);
+            pixel.add(castRay(r, eye, light, scene, occlusionCache,
+                              pixelIndex(x, y), pixel.count));
+          }
+        }
+      }
+    }
+
+    uint64_t tileSamples = 0;
+    for (int32_t y = y0; y < y1; ++y)
+      for (int32_t x = x0; x < x1; ++x)
+        tileSamples += samplePixel(x, y).count;
+    samplesTraced += tileSamples;
+
+    // HDR, dithering and quantization are left to the tone mapping
+    for (int32_t y = y0; y < y1; ++y) {
+      PixelSamples const *row = tilePixels + (y - y0) * tileSize;
+      Vec3f *out = &imagePlane.radiance(x0, y);
+      for (int32_t x = 0; x < x1 - x0; ++x)
+        out[x] = row[x].sum / float(row[x].count);
+    }
+
+    output.markDone(x0, y0, x1, y1);
+  });
+
+  return samplesTraced;
+}
 } // namespace
 
 int main() {
@@ -308,6 +775,110 @@ int main() {
                 height = stoi(line.substr(6));
                 cout<<"height: "<<height<<endl;
             }
+            else if(line.find("mesh") == 0) {
+                meshFile = line.substr(5);
+                cout<<"mesh: "<<meshFile<<endl;
+            }
+            else if(line.find("instances") == 0) {
+                meshInstances = stoi(line.substr(9));
+                cout<<"instances: "<<meshInstances<<"x"<<meshInstances<<endl;
+            }
+            else if(line.find("benchmark") == 0) {
+                benchmarkName = line.substr(10);
+                cout<<"benchmark: "<<benchmarkName<<endl;
+            }
+            else if(line.find("output") == 0) {
+                outputFile = line.substr(7);
+                cout<<"output: "<<outputFile<<endl;
+            }
+            else if(line.find("exposure") == 0) {
+                toneMapping.exposure = stof(line.substr(8));
+                cout<<"exposure: "<<toneMapping.exposure<<endl;
+            }
+            else if(line.find("tonemap") == 0) {
+                string curve = line.substr(8);
+                if(curve == "reinhard")
+                    toneMapping.curve = raster::ToneMapCurve::REINHARD;
+                else if(curve == "aces")
+                    toneMapping.curve = raster::ToneMapCurve::ACES;
+                else
+                    toneMapping.curve = raster::ToneMapCurve::CLAMP;
+                cout<<"tonemap: "<<curve<<endl;
+            }
+            else if(line.find("dither") == 0) {
+                toneMapping.dither = stoi(line.substr(6)) != 0;
+                cout<<"dither: "<<toneMapping.dither<<endl;
+            }
+            else if(line.find("threads") == 0) {
+                renderThreads = stoi(line.substr(7));
+                cout<<"threads: "<<renderThreads<<endl;
+            }
+            else if(line.find("samples") == 0) {
+                antiAliasing.samples = stoi(line.substr(7));
+                cout<<"samples: "<<antiAliasing.samples<<endl;
+            }
+            else if(line.find("first_samples") == 0) {
+                antiAliasing.firstSamples = stoi(line.substr(13));
+                cout<<"first_samples: "<<antiAliasing.firstSamples<<endl;
+            }
+            else if(line.find("sample_error") == 0) {
+                antiAliasing.sampleError = stof(line.substr(12));
+                cout<<"sample_error: "<<antiAliasing.sampleError<<endl;
+            }
+            else if(line.find("bounces") == 0) {
+                reflections.bounces = stoi(line.substr(7));
+                cout<<"bounces: "<<reflections.bounces<<endl;
+            }
+            else if(line.find("reflectance") == 0) {
+                reflections.reflectance = stof(line.substr(11));
+                cout<<"reflectance: "<<reflections.reflectance<<endl;
+            }
+            else if(line.find("min_contribution") == 0) {
+                reflections.minContribution = stof(line.substr(16));
+                cout<<"min_contribution: "<<reflections.minContribution<<endl;
+            }
+            else if(line.find("wavefront") == 0) {
+                wavefront = stoi(line.substr(9)) != 0;
+                cout<<"wavefront: "<<wavefront<<endl;
+            }
+            else if(line.find("sort_rays") == 0) {
+                sortRays = stoi(line.substr(9)) != 0;
+                cout<<"sort_rays: "<<sortRays<<endl;
+            }
+            else if(line.find("bvh") == 0) {
+                string builder = line.substr(4);
+                if(builder == "linear")
+                    sceneBuild.builder = raytracing::BVHBuilder::LINEAR;
+                else
+                    sceneBuild.builder = raytracing::BVHBuilder::SAH;
+                cout<<"bvh: "<<builder<<endl;
+            }
+            else if(line.find("treelets") == 0) {
+                sceneBuild.treeletRounds = stoi(line.substr(8));
+                cout<<"treelets: "<<sceneBuild.treeletRounds<<endl;
+            }
+            else if(line.find("accelerator") == 0) {
+                using raytracing::Accelerator;
+                string accelerator = line.substr(12);
+                if(accelerator == "wide_bvh")
+                    sceneBuild.accelerator = Accelerator::WIDE_BVH;
+                else if(accelerator == "grid")
+                    sceneBuild.accelerator = Accelerator::GRID;
+                else if(accelerator == "two_level_grid")
+                    sceneBuild.accelerator = Accelerator::TWO_LEVEL_GRID;
+                else
+                    sceneBuild.accelerator = Accelerator::BVH;
+                cout<<"accelerator: "<<accelerator<<endl;
+            }
+            else if(line.find("packet") == 0) {
+                packetSize = stoi(line.substr(6));
+                if(packetSize != 0 && packetSize != 4 && packetSize != 8 &&
+                   packetSize != 16) {
+                    cout<<"packet must be 0, 4, 8 or 16\n";
+                    return -1;
+                }
+                cout<<"packet: "<<packetSize<<endl;
+            }
             else {
                 cout<<"Invalid file I/O\n";
                 return -1;
@@ -317,6 +888,9 @@ int main() {
         fileInput.close();
     }
 
+    if(!benchmarkName.empty())
+        return benchmark::run(benchmarkName) ? EXIT_SUCCESS : EXIT_FAILURE;
+
 
 
 
@@ -347,9 +921,9 @@ int main() {
 
 
   // setup scene, defaults to scene 1
-  std::vector<s_ptr> surfaces;
+  SceneDescription description;
   //add the default plane to every scene
-  surfaces.push_back(makeIntersectable(p));
+  description.planes.push_back(p);
 
   //********************************************SCENE 1********************************************
 
@@ -447,37 +1021,106 @@ int main() {
   //********************************************SCENE 3********************************************
 
   if(scene == 2) {
-    surfaces.push_back(makeIntersectable(s_s2));
-    surfaces.push_back(makeIntersectable(s1_s2));
-    surfaces.push_back(makeIntersectable(s2_s2));
-    surfaces.push_back(makeIntersectable(s3_s2));
-    surfaces.push_back(makeIntersectable(s4_s2));
+    description.spheres.push_back(s_s2);
+    description.spheres.push_back(s1_s2);
+    description.spheres.push_back(s2_s2);
+    description.spheres.push_back(s3_s2);
+    description.spheres.push_back(s4_s2);
   }
   else if(scene == 3) {
-    surfaces.push_back(makeIntersectable(t_s3));
-    surfaces.push_back(makeIntersectable(t1_s3));
-    surfaces.push_back(makeIntersectable(s_s3));
-    surfaces.push_back(makeIntersectable(s1_s3));
-    surfaces.push_back(makeIntersectable(s2_s3));
-    surfaces.push_back(makeIntersectable(s3_s3));
-    surfaces.push_back(makeIntersectable(s4_s3));
+    description.triangles.push_back(t_s3);
+    description.triangles.push_back(t1_s3);
+    description.spheres.push_back(s_s3);
+    description.spheres.push_back(s1_s3);
+    description.spheres.push_back(s2_s3);
+    description.spheres.push_back(s3_s3);
+    description.spheres.push_back(s4_s3);
   }
   else {    //default scene is 1
-      surfaces.push_back(makeIntersectable(s_s1));
-      surfaces.push_back(makeIntersectable(s2_s1));
-      surfaces.push_back(makeIntersectable(s3_s1));
-      surfaces.push_back(makeIntersectable(t1_s1));
-      surfaces.push_back(makeIntersectable(t2_s1));
+      description.spheres.push_back(s_s1);
+      description.spheres.push_back(s2_s1);
+      description.spheres.push_back(s3_s1);
+      description.triangles.push_back(t1_s1);
+      description.triangles.push_back(t2_s1);
+  }
+
+  //loads the mesh and renders
+  concurrency::ThreadPool threadPool(renderThreads > 0
+                                         ? renderThreads
+                                         : concurrency::hardwareThreads());
+
+  //optional mesh, one copy of the geometry placed on a grid above the plane
+  auto &instances = description.meshInstances;
+  if(!meshFile.empty()) {
+      auto triangleMesh = loadTriangleMesh(meshFile, threadPool);
+      if(!triangleMesh)
+          return -1;
+
+      //scale the mesh to fit into a unit cube resting on the plane
+      AABB meshBounds = triangleMesh->bvh.bounds();
+      Vec3f size = geometry::extent(meshBounds);
+      float scale = 1.f / max(max(size.x, size.y), max(size.z, 1e-6f));
+      Vec3f base = centroid(meshBounds);
+      base.y = meshBounds.min.y;
+
+      float spacing = 1.5f;
+      float start = -0.5f * spacing * (meshInstances - 1);
+      for(int i = 0; i < meshInstances; ++i) {
+          for(int j = 0; j < meshInstances; ++j) {
+              Vec3f position(start + i * spacing, 0.f, start + j * spacing);
+              Mat4f toWorld = translateMatrix(position) *
+                              uniformScaleMatrix(scale) *
+                              translateMatrix(-base);
+              instances.push_back(makeMeshInstance(triangleMesh, toWorld,
+                                                   Vec3f(0.8f, 0.8f, 0.8f)));
+          }
+      }
+  }
+
+  temporal::Timer buildTimer(true);
+
+  auto sceneToRender =
+      buildScene(std::move(description), sceneBuild, threadPool);
+
+  std::cout << "BVH build: " << buildTimer.milliseconds() << " ms ("
+            << sceneToRender.sphereBVH.nodes.size() +
+                   sceneToRender.triangleBVH.nodes.size()
+            << " nodes)\n";
+
+  // rows of tiles are tonemapped and encoded as soon as they are done, by
+  // the thread that finishes them
+  auto encoder = raster::makeEncoderFor(outputFile);
+  if(!encoder) {
+      cerr << "[Error] unknown image format: " << outputFile << '\n';
+      return -1;
   }
+  raster::ImageOutput output(
+      std::move(encoder),
+      raster::view(imagePlane.screen, imagePlane.radiance), tileSize,
+      [&](uint32_t firstRow, uint32_t lastRow) {
+          raster::toneMap(imagePlane.radiance, imagePlane.screen, toneMapping,
+                          int32_t(firstRow), int32_t(lastRow));
+      });
+  if(!output.open(outputFile))
+      return -1;
 
   // render that thing...
   temporal::Timer timer(true);
 
-  render(imagePlane, eye, light, surfaces);
+  uint64_t samples =
+      render(imagePlane, eye, light, sceneToRender, threadPool, output);
 
-  std::cout << "Time elapsed: " << std::fixed << timer.minutes() << " min.\n";
+  std::cout << "Time elapsed: " << timer.milliseconds() << " ms on "
+            << threadPool.threadCount() << " threads\n";
+  if(antiAliasing.samples > 1)
+      std::cout << "Samples: " << double(samples) / (width * height)
+                << " per pixel\n";
 
-  raster::write_screen_to_file("./test.png", imagePlane.screen);
+  temporal::Timer outputTimer(true);
+  if(!output.close())
+      return -1;
+  std::cout << "Output: " << outputTimer.milliseconds()
+            << " ms after rendering\n";
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,120 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace io {
+
+MappedFile::~MappedFile() { close(); }
+
+#ifdef _WIN32
+
+bool MappedFile::open(std::string const &path) {
+  close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return false;
+  }
+
+  m_file = file;
+  m_size = size_t(size.QuadPart);
+  m_open = true;
+
+  // empty files can't be mapped
+  if (m_size == 0)
+    return true;
+
+  m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping != nullptr)
+    m_data = static_cast<char const *>(
+        MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+
+  if (m_data == nullptr) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::close() {
+  if (m_data != nullptr)
+    UnmapViewOfFile(m_data);
+  if (m_mapping != nullptr)
+    CloseHandle(m_mapping);
+  if (m_file != nullptr)
+    CloseHandle(m_file);
+
+  m_data = nullptr;
+  m_mapping = nullptr;
+  m_file = nullptr;
+  m_size = 0;
+  m_open = false;
+}
+
+#else
+
+bool MappedFile::open(std::string const &path) {
+  close();
+
+  int file = ::open(path.c_str(), O_RDONLY);
+  if (file < 0)
+    return false;
+
+  struct stat status;
+  if (fstat(file, &status) != 0) {
+    ::close(file);
+    return false;
+  }
+
+  m_size = size_t(status.st_size);
+  m_open = true;
+
+  // empty files can't be mapped
+  if (m_size == 0) {
+    ::close(file);
+    return true;
+  }
+
+  void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+  // the mapping stays valid without the descriptor
+  ::close(file);
+
+  if (data == MAP_FAILED) {
+    m_size = 0;
+    m_open = false;
+    return false;
+  }
+
+  // mostly read front to back, let the kernel read ahead
+  madvise(data, m_size, MADV_SEQUENTIAL);
+
+  m_data = static_cast<char const *>(data);
+  return true;
+}
+
+void MappedFile::close() {
+  if (m_data != nullptr)
+    munmap(const_cast<char *>(m_data), m_size);
+
+  m_data = nullptr;
+  m_size = 0;
+  m_open = false;
+}
+
+#endif
+
+} // namespace io
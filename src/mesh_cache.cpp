@@ -0,0 +1,335 @@
+#include "mesh_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "obj_mesh_file_io.hpp"
+#include "timer.hpp"
+
+namespace geometry {
+
+namespace {
+
+// bump whenever the layout of the file or of a stored type changes, or the
+// BVH builder produces different trees
+constexpr uint32_t formatVersion = 1;
+constexpr char magic[8] = {'R', 'T', 'M', 'E', 'S', 'H', '\0', '\0'};
+// written as is, reads back differently on a machine of the other byte order
+constexpr uint32_t byteOrderMark = 0x01020304;
+
+// arrays start at multiples of this, enough for any of the stored types
+constexpr uint64_t sectionAlignment = 64;
+
+enum Section : uint32_t {
+  VERTICES,
+  TEXTURE_COORDS,
+  NORMALS,
+  TRIANGLES,
+  BVH_NODES,
+  PRIMITIVE_INDICES,
+  PRECOMPUTED,
+  SECTION_COUNT
+};
+
+// the arrays are copied byte for byte in both directions
+static_assert(std::is_trivially_copyable<math::Vec3f>::value, "");
+static_assert(std::is_trivially_copyable<math::Vec2f>::value, "");
+static_assert(std::is_trivially_copyable<IndicesTriangle>::value, "");
+static_assert(std::is_trivially_copyable<BVHNode>::value, "");
+static_assert(std::is_trivially_copyable<PrecomputedTriangle>::value, "");
+
+// sizes of the stored types, which depend on the build (e.g. Vec3f is
+// padded to 16 bytes with SIMD enabled)
+constexpr uint64_t elementSizes[SECTION_COUNT] = {
+    sizeof(math::Vec3f), sizeof(math::Vec2f), sizeof(math::Vec3f),
+    sizeof(IndicesTriangle), sizeof(BVHNode), sizeof(uint32_t),
+    sizeof(PrecomputedTriangle)};
+
+struct SectionRange {
+  uint64_t offset; // from the start of the file
+  uint64_t count;  // elements
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t contentHash;
+  uint64_t elementSizes[SECTION_COUNT];
+  SectionRange sections[SECTION_COUNT];
+};
+
+uint64_t alignUp(uint64_t offset) {
+  return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+// hash of 8 byte words, a multiply and rotate per word
+uint64_t mix(uint64_t hash, uint64_t word) {
+  hash ^= word * 0xff51afd7ed558ccdull;
+  hash = (hash << 31) | (hash >> 33);
+  return hash * 0x9e3779b97f4a7c15ull;
+}
+
+// final avalanche, so every input bit affects every output bit
+uint64_t finish(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+uint64_t hashBytes(char const *data, size_t size) {
+  uint64_t hash = size;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, 8);
+    hash = mix(hash, word);
+  }
+  if (i < size) {
+    uint64_t word = 0;
+    std::memcpy(&word, data + i, size - i);
+    hash = mix(hash, word);
+  }
+  return finish(hash);
+}
+
+constexpr size_t hashChunkSize = size_t(4) << 20;
+
+template <typename T>
+void readSection(char const *data, Header const &header, Section section,
+                 std::vector<T> &out) {
+  SectionRange const &range = header.sections[section];
+  auto first = reinterpret_cast<T const *>(data + range.offset);
+  out.assign(first, first + range.count);
+}
+
+template <typename T>
+bool writeSection(std::ofstream &out, Header const &header, Section section,
+                  std::vector<T> const &elements) {
+  static char const zeros[sectionAlignment] = {};
+  uint64_t position = uint64_t(out.tellp());
+  out.write(zeros, std::streamsize(header.sections[section].offset - position));
+  out.write(reinterpret_cast<char const *>(elements.data()),
+            std::streamsize(elements.size() * sizeof(T)));
+  return bool(out);
+}
+
+// the traversal stack holds 64 entries, see bvh.tpp
+constexpr uint32_t maxTreeDepth = 63;
+
+// a damaged file whose header is intact must not make tracing index out of
+// bounds: child and leaf offsets, primitive indices and face indices are all
+// checked, children must come after their parent, which rules out cycles
+bool isConsistent(TriangleMesh const &mesh) {
+  BVH const &bvh = mesh.bvh;
+  uint64_t const triangleCount = mesh.mesh.triangles.size();
+
+  std::vector<uint8_t> depth(bvh.nodes.size(), 0);
+  for (size_t i = 0; i < bvh.nodes.size(); ++i) {
+    BVHNode const &node = bvh.nodes[i];
+    if (node.isLeaf()) {
+      if (uint64_t(node.offset) + node.count > bvh.primitiveIndices.size())
+        return false;
+      continue;
+    }
+    // the left child follows its parent, the right one its left subtree
+    if (node.offset <= i + 1 || node.offset >= bvh.nodes.size() ||
+        depth[i] >= maxTreeDepth)
+      return false;
+    depth[i + 1] = depth[node.offset] = uint8_t(depth[i] + 1);
+  }
+
+  for (auto index : bvh.primitiveIndices)
+    if (index >= triangleCount)
+      return false;
+
+  size_t const sizes[3] = {mesh.mesh.vertices.size(),
+                           mesh.mesh.textureCoords.size(),
+                           mesh.mesh.normals.size()};
+  for (auto const &triangle : mesh.mesh.triangles)
+    for (int corner = 0; corner < 3; ++corner)
+      for (int component = 0; component < 3; ++component) {
+        unsigned int index = triangle[corner][component];
+        // only texture coordinates and normals may be missing
+        if (index == missingIndex ? component == 0 : index >= sizes[component])
+          return false;
+      }
+
+  return true;
+}
+
+} // namespace
+
+bool hashFileContents(std::string const &path,
+                      concurrency::ThreadPool &threadPool, uint64_t &hash) {
+  io::MappedFile file;
+  if (!file.open(path))
+    return false;
+
+  size_t const size = file.size();
+  uint32_t const chunkCount =
+      uint32_t((size + hashChunkSize - 1) / hashChunkSize);
+
+  std::vector<uint64_t> chunkHashes(chunkCount);
+  threadPool.parallelFor(chunkCount, [&](uint32_t i, unsigned) {
+    size_t first = i * hashChunkSize;
+    chunkHashes[i] =
+        hashBytes(file.data() + first, std::min(hashChunkSize, size - first));
+  });
+
+  hash = size;
+  for (auto chunkHash : chunkHashes)
+    hash = mix(hash, chunkHash);
+  hash = finish(hash);
+  return true;
+}
+
+std::shared_ptr<TriangleMesh> readMeshCache(std::string const &path,
+                                            uint64_t contentHash) {
+  io::MappedFile file;
+  if (!file.open(path) || file.size() < sizeof(Header))
+    return nullptr;
+
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(Header));
+
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+      header.version != formatVersion || header.byteOrder != byteOrderMark ||
+      header.contentHash != contentHash ||
+      !std::equal(elementSizes, elementSizes + SECTION_COUNT,
+                  header.elementSizes))
+    return nullptr;
+
+  // a truncated or otherwise damaged file must not be read past its end
+  for (uint32_t s = 0; s < SECTION_COUNT; ++s) {
+    SectionRange const &range = header.sections[s];
+    if (range.offset % sectionAlignment != 0 || range.offset > file.size() ||
+        range.count > (file.size() - range.offset) / elementSizes[s])
+      return nullptr;
+  }
+
+  uint64_t const triangleCount = header.sections[TRIANGLES].count;
+  if (header.sections[PRIMITIVE_INDICES].count != triangleCount ||
+      header.sections[PRECOMPUTED].count != triangleCount)
+    return nullptr;
+
+  std::shared_ptr<TriangleMesh> mesh(new TriangleMesh());
+  char const *data = file.data();
+  readSection(data, header, VERTICES, mesh->mesh.vertices);
+  readSection(data, header, TEXTURE_COORDS, mesh->mesh.textureCoords);
+  readSection(data, header, NORMALS, mesh->mesh.normals);
+  readSection(data, header, TRIANGLES, mesh->mesh.triangles);
+  readSection(data, header, BVH_NODES, mesh->bvh.nodes);
+  readSection(data, header, PRIMITIVE_INDICES, mesh->bvh.primitiveIndices);
+  readSection(data, header, PRECOMPUTED, mesh->precomputed);
+
+  if (!isConsistent(*mesh))
+    return nullptr;
+  return mesh;
+}
+
+bool writeMeshCache(std::string const &path, TriangleMesh const &mesh,
+                    uint64_t contentHash) {
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = formatVersion;
+  header.byteOrder = byteOrderMark;
+  header.contentHash = contentHash;
+  std::copy(elementSizes, elementSizes + SECTION_COUNT, header.elementSizes);
+
+  uint64_t const counts[SECTION_COUNT] = {
+      mesh.mesh.vertices.size(),  mesh.mesh.textureCoords.size(),
+      mesh.mesh.normals.size(),   mesh.mesh.triangles.size(),
+      mesh.bvh.nodes.size(),      mesh.bvh.primitiveIndices.size(),
+      mesh.precomputed.size()};
+
+  uint64_t offset = sizeof(Header);
+  for (uint32_t s = 0; s < SECTION_COUNT; ++s) {
+    offset = alignUp(offset);
+    header.sections[s].offset = offset;
+    header.sections[s].count = counts[s];
+    offset += counts[s] * elementSizes[s];
+  }
+
+  // written next to the cache and renamed once complete, so a reader never
+  // sees half a file
+  std::string const temporaryPath = path + ".tmp";
+  std::ofstream out(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out)
+    return false;
+
+  out.write(reinterpret_cast<char const *>(&header), sizeof(Header));
+  bool written = writeSection(out, header, VERTICES, mesh.mesh.vertices) &&
+                 writeSection(out, header, TEXTURE_COORDS,
+                              mesh.mesh.textureCoords) &&
+                 writeSection(out, header, NORMALS, mesh.mesh.normals) &&
+                 writeSection(out, header, TRIANGLES, mesh.mesh.triangles) &&
+                 writeSection(out, header, BVH_NODES, mesh.bvh.nodes) &&
+                 writeSection(out, header, PRIMITIVE_INDICES,
+                              mesh.bvh.primitiveIndices) &&
+                 writeSection(out, header, PRECOMPUTED, mesh.precomputed);
+  out.close();
+
+  // a failed write keeps the old cache
+  if (!written || !out) {
+    std::remove(temporaryPath.c_str());
+    return false;
+  }
+
+  // rename doesn't replace an existing file everywhere
+  std::remove(path.c_str());
+  if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    std::remove(temporaryPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::string meshCachePath(std::string const &objPath) {
+  return objPath + ".cache";
+}
+
+std::shared_ptr<TriangleMesh>
+loadTriangleMesh(std::string const &objPath,
+                 concurrency::ThreadPool &threadPool) {
+  temporal::Timer timer(true);
+
+  std::string const cachePath = meshCachePath(objPath);
+
+  // a missing OBJ file is reported by the loader below
+  uint64_t contentHash = 0;
+  bool hashed = hashFileContents(objPath, threadPool, contentHash);
+
+  if (hashed) {
+    if (auto mesh = readMeshCache(cachePath, contentHash)) {
+      std::cerr << "[Log] loaded " << cachePath << ": "
+                << mesh->mesh.triangles.size() << " triangles in "
+                << timer.elapsed<std::chrono::microseconds>() * 1e-3
+                << " ms\n";
+      return mesh;
+    }
+  }
+
+  OBJMesh objMesh;
+  if (!loadOBJMeshFromFile(objPath, objMesh, threadPool))
+    return nullptr;
+
+  auto mesh = makeTriangleMesh(std::move(objMesh));
+
+  if (hashed && !writeMeshCache(cachePath, *mesh, contentHash))
+    std::cerr << "[Log] could not write mesh cache " << cachePath << '\n';
+
+  return mesh;
+}
+
+} // namespace geometry
@@ -0,0 +1,195 @@
+#include "mesh_instance.hpp"
+
+#include <algorithm>
+
+#include "common_matrices.hpp"
+
+namespace geometry {
+
+std::shared_ptr<TriangleMesh> makeTriangleMesh(OBJMesh mesh) {
+  std::shared_ptr<TriangleMesh> triangleMesh(new TriangleMesh());
+  triangleMesh->mesh = std::move(mesh);
+
+  auto const &triangles = triangleMesh->mesh.triangles;
+
+  std::vector<AABB> triangleBounds;
+  triangleBounds.reserve(triangles.size());
+  for (uint32_t i = 0; i < triangles.size(); ++i)
+    triangleBounds.push_back(bounds(triangleAt(triangleMesh->mesh, i)));
+
+  triangleMesh->bvh = buildBVH(triangleBounds);
+
+  auto &precomputed = triangleMesh->precomputed;
+  precomputed.reserve(triangles.size());
+  for (auto index : triangleMesh->bvh.primitiveIndices)
+    precomputed.push_back(precompute(triangleAt(triangleMesh->mesh, index)));
+
+  return triangleMesh;
+}
+
+void refitTriangleMesh(TriangleMesh &mesh, concurrency::ThreadPool &threadPool) {
+  auto const count = uint32_t(mesh.mesh.triangles.size());
+  std::vector<AABB> triangleBounds(count);
+
+  constexpr uint32_t blockSize = 1 << 16;
+  threadPool.parallelFor(
+      (count + blockSize - 1) / blockSize, [&](uint32_t block, unsigned) {
+        uint32_t last = std::min(count, (block + 1) * blockSize);
+        for (uint32_t slot = block * blockSize; slot < last; ++slot) {
+          uint32_t index = mesh.bvh.primitiveIndices[slot];
+          Triangle triangle = triangleAt(mesh.mesh, index);
+          triangleBounds[index] = bounds(triangle);
+          mesh.precomputed[slot] = precompute(triangle);
+        }
+      });
+
+  refit(mesh.bvh, triangleBounds, threadPool);
+}
+
+Triangle triangleAt(OBJMesh const &mesh, uint32_t index) {
+  auto const &t = mesh.triangles[index];
+  return {mesh.vertices[t.a().vertexID()], //
+          mesh.vertices[t.b().vertexID()], //
+          mesh.vertices[t.c().vertexID()]};
+}
+
+MeshInstance makeMeshInstance(std::shared_ptr<TriangleMesh const> mesh,
+                              math::Mat4f const &toWorld,
+                              math::Vec3f const &colour) {
+  MeshInstance instance;
+  instance.mesh = std::move(mesh);
+  instance.toWorld = toWorld;
+  instance.toObject = math::affineInverse(toWorld);
+  instance.colour = colour;
+  return instance;
+}
+
+AABB bounds(MeshInstance const &instance) {
+  AABB local = instance.mesh->bvh.bounds();
+  AABB world;
+
+  if (isEmpty(local))
+    return world;
+
+  for (int corner = 0; corner < 8; ++corner) {
+    math::Vec3f p((corner & 1) ? local.max.x : local.min.x,
+                  (corner & 2) ? local.max.y : local.min.y,
+                  (corner & 4) ? local.max.z : local.min.z);
+    world = merge(world, math::transformPoint(instance.toWorld, p));
+  }
+
+  return world;
+}
+
+MeshInstances buildMeshInstances(std::vector<MeshInstance> instances) {
+  MeshInstances meshes;
+  meshes.instances = std::move(instances);
+
+  std::vector<AABB> instanceBounds;
+  instanceBounds.reserve(meshes.instances.size());
+  for (auto const &instance : meshes.instances)
+    instanceBounds.push_back(bounds(instance));
+
+  meshes.bvh = buildBVH(instanceBounds);
+
+  return meshes;
+}
+
+namespace {
+
+// the ray in the object space of instance, direction is not renormalized so
+// t, and with it the interval, is the same in both spaces
+Ray toObject(Ray const &ray, MeshInstance const &instance) {
+  return Ray(math::transformPoint(instance.toObject, ray.origin),
+             math::transformVector(instance.toObject, ray.direction),
+             ray.tMin, ray.tMax);
+}
+
+} // namespace
+
+InstanceHit::operator bool() const { return hit.didIntersect; }
+
+InstanceHit intersect(Ray const &ray, MeshInstances const &meshes) {
+  InstanceHit closestInstance;
+
+  auto intersectInstance = [&](uint32_t instanceIndex, Hit &closest) {
+    auto const &instance = meshes.instances[instanceIndex];
+
+    Ray local = toObject(ray, instance);
+    local.tMax = closest.rayDepth;
+
+    auto intersectTriangles = [&](uint32_t offset, uint32_t count,
+                                  Hit &closest) {
+      for (uint32_t i = offset; i < offset + count; ++i) {
+        auto hit = intersect(local, instance.mesh->precomputed[i]);
+        if (hit && hit.rayDepth < closest.rayDepth) {
+          closest = hit;
+          closestInstance.instance = instanceIndex;
+          closestInstance.triangle = instance.mesh->bvh.primitiveIndices[i];
+        }
+      }
+    };
+
+    auto hit = closestHit(instance.mesh->bvh, local, intersectTriangles);
+    if (hit)
+      closest = hit;
+  };
+
+  closestInstance.hit = closestHit(
+      meshes.bvh, ray,
+      [&](uint32_t offset, uint32_t count, Hit &closest) {
+        for (uint32_t i = offset; i < offset + count; ++i)
+          intersectInstance(meshes.bvh.primitiveIndices[i], closest);
+      });
+
+  return closestInstance;
+}
+
+bool occluded(Ray const &ray, MeshInstances const &meshes, uint32_t &instance,
+              uint32_t &slot) {
+  return anyHit(
+      meshes.bvh, ray,
+      [&](uint32_t offset, uint32_t count) {
+        for (uint32_t i = offset; i < offset + count; ++i) {
+          uint32_t instanceIndex = meshes.bvh.primitiveIndices[i];
+          auto const &mesh = *meshes.instances[instanceIndex].mesh;
+          Ray local = toObject(ray, meshes.instances[instanceIndex]);
+
+          bool hit = anyHit(
+              mesh.bvh, local,
+              [&](uint32_t offset, uint32_t count) {
+                for (uint32_t j = offset; j < offset + count; ++j) {
+                  if (intersect(local, mesh.precomputed[j])) {
+                    slot = j;
+                    return true;
+                  }
+                }
+                return false;
+              });
+
+          if (hit) {
+            instance = instanceIndex;
+            return true;
+          }
+        }
+        return false;
+      });
+}
+
+bool occludedByTriangle(Ray const &ray, MeshInstances const &meshes,
+                        uint32_t instance, uint32_t slot) {
+  auto const &meshInstance = meshes.instances[instance];
+  return bool(intersect(toObject(ray, meshInstance),
+                        meshInstance.mesh->precomputed[slot]));
+}
+
+math::Vec3f normalAt(InstanceHit const &hit, MeshInstances const &meshes) {
+  auto const &instance = meshes.instances[hit.instance];
+  auto n = normal(triangleAt(instance.mesh->mesh, hit.triangle));
+
+  // normals transform with the inverse transpose
+  return normalized(
+      math::transformVector(math::transposed(instance.toObject), n));
+}
+
+} // namespace geometry
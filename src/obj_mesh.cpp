@@ -2,34 +2,197 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 
 using namespace math;
 
 namespace geometry {
 
-std::vector<math::Vec3f>
-calculateTriangleNormals(std::vector<IndicesTriangle> const &indexTriangles,
-                         std::vector<math::Vec3f> const &vertices) {
-  std::vector<Vec3f> tmp;
+namespace {
 
-  return tmp;
+// faces or vertices handed to a task at once
+constexpr uint32_t blockSize = 1 << 16;
+// vertex ranges per thread, more than one so uneven ranges balance out
+constexpr uint32_t rangesPerThread = 8;
+
+uint32_t blockCount(size_t count) {
+  return uint32_t((count + blockSize - 1) / blockSize);
+}
+
+// unit vector, or zero for a zero vector (degenerate faces, unused vertices)
+Vec3f normalizedOrZero(Vec3f const &v) {
+  float length = norm(v);
+  return length > 0.f ? v / length : Vec3f();
+}
+
+// what corner of a face adds to the normal of its vertex, the face normal
+// weighted by the corner's angle or by the face's area
+Vec3f cornerNormal(IndicesTriangle const &triangle, int corner,
+                   Vertices const &vertices, Vec3f const &triangleNormal,
+                   NormalWeighting weighting) {
+  Vec3f const &p = vertices[triangle[corner].vertexID()];
+  Vec3f e1 = vertices[triangle[(corner + 1) % 3].vertexID()] - p;
+  Vec3f e2 = vertices[triangle[(corner + 2) % 3].vertexID()] - p;
+  float crossLength = norm(cross(e1, e2));
+
+  float weight = weighting == NormalWeighting::ANGLE
+                     ? std::atan2(crossLength, dot(e1, e2))
+                     : 0.5f * crossLength;
+  return weight * triangleNormal;
+}
+
+} // namespace
+
+Normals calculateTriangleNormals(IndicesTriangles const &indexTriangles,
+                                 Vertices const &vertices,
+                                 concurrency::ThreadPool &threadPool) {
+  Normals normals(indexTriangles.size());
+
+  uint32_t const blocks = blockCount(indexTriangles.size());
+  threadPool.parallelFor(blocks, [&](uint32_t block, unsigned) {
+    size_t first = size_t(block) * blockSize;
+    size_t last = std::min(first + blockSize, indexTriangles.size());
+    for (size_t i = first; i < last; ++i) {
+      auto const &t = indexTriangles[i];
+      Vec3f const &a = vertices[t.a().vertexID()];
+      normals[i] = normalizedOrZero(cross(vertices[t.b().vertexID()] - a,
+                                          vertices[t.c().vertexID()] - a));
+    }
+  });
+
+  return normals;
+}
+
+Normals calculateTriangleNormals(IndicesTriangles const &indexTriangles,
+                                 Vertices const &vertices) {
+  concurrency::ThreadPool threadPool;
+  return calculateTriangleNormals(indexTriangles, vertices, threadPool);
 }
 
-std::vector<math::Vec3f>
-calculateVertexNormals(std::vector<IndicesTriangle> const &indexTriangles,
-                       std::vector<math::Vec3f> const &vertices) {
-	std::vector<Vec3f> tmp;
+// The corners are scattered into buckets, one per range of vertices, and each
+// range is then summed up by a single task, so no two tasks ever write to the
+// same vertex:
+// 1. count the corners of every block of faces falling into every range
+// 2. the prefix sum of the counts gives every (block, range) pair its own
+//    slots in the buckets, the blocks write their corner ids there
+// 3. every range adds up the corners in its bucket
+// the buckets hold the corners in face order, which is the order of a serial
+// loop, so the sums are the same for any number of threads
+Normals calculateVertexNormals(IndicesTriangles const &indexTriangles,
+                               Vertices const &vertices,
+                               Normals const &triangleNormals,
+                               concurrency::ThreadPool &threadPool,
+                               NormalWeighting weighting) {
+  assert(triangleNormals.size() == indexTriangles.size());
+
+  Normals normals(vertices.size());
+
+  size_t const cornerCount = indexTriangles.size() * 3;
+  // corner ids are 32 bit
+  bool const bucketed = threadPool.threadCount() > 1 &&
+                        cornerCount <= std::numeric_limits<uint32_t>::max();
+
+  if (!bucketed) {
+    for (size_t i = 0; i < indexTriangles.size(); ++i)
+      for (int corner = 0; corner < 3; ++corner)
+        normals[indexTriangles[i][corner].vertexID()] +=
+            cornerNormal(indexTriangles[i], corner, vertices,
+                         triangleNormals[i], weighting);
+  } else {
+    uint32_t const blocks = blockCount(indexTriangles.size());
+    uint32_t const ranges = std::max(
+        1u, std::min(threadPool.threadCount() * rangesPerThread,
+                     uint32_t(vertices.size())));
+    size_t const rangeSize = (vertices.size() + ranges - 1) / ranges;
+
+    // 1. counts[block * ranges + range]
+    std::vector<uint32_t> counts(size_t(blocks) * ranges, 0);
+    threadPool.parallelFor(blocks, [&](uint32_t block, unsigned) {
+      uint32_t *blockCounts = &counts[size_t(block) * ranges];
+      size_t first = size_t(block) * blockSize;
+      size_t last = std::min(first + blockSize, indexTriangles.size());
+      for (size_t i = first; i < last; ++i)
+        for (int corner = 0; corner < 3; ++corner)
+          ++blockCounts[indexTriangles[i][corner].vertexID() / rangeSize];
+    });
+
+    // 2. range major, so a range's bucket is one contiguous run; counts
+    // becomes the write position of each (block, range)
+    std::vector<size_t> bucketStart(ranges + 1, 0);
+    size_t position = 0;
+    for (uint32_t range = 0; range < ranges; ++range) {
+      bucketStart[range] = position;
+      for (uint32_t block = 0; block < blocks; ++block) {
+        uint32_t &count = counts[size_t(block) * ranges + range];
+        uint32_t blockStart = uint32_t(position);
+        position += count;
+        count = blockStart;
+      }
+    }
+    bucketStart[ranges] = position;
 
-	return tmp;
+    std::vector<uint32_t> buckets(cornerCount);
+    threadPool.parallelFor(blocks, [&](uint32_t block, unsigned) {
+      uint32_t *next = &counts[size_t(block) * ranges];
+      size_t first = size_t(block) * blockSize;
+      size_t last = std::min(first + blockSize, indexTriangles.size());
+      for (size_t i = first; i < last; ++i)
+        for (int corner = 0; corner < 3; ++corner)
+          buckets[next[indexTriangles[i][corner].vertexID() / rangeSize]++] =
+              uint32_t(i * 3 + corner);
+    });
+
+    // 3.
+    threadPool.parallelFor(ranges, [&](uint32_t range, unsigned) {
+      for (size_t slot = bucketStart[range]; slot < bucketStart[range + 1];
+           ++slot) {
+        uint32_t i = buckets[slot] / 3;
+        int corner = int(buckets[slot] % 3);
+        normals[indexTriangles[i][corner].vertexID()] +=
+            cornerNormal(indexTriangles[i], corner, vertices,
+                         triangleNormals[i], weighting);
+      }
+    });
+  }
+
+  uint32_t const vertexBlocks = blockCount(normals.size());
+  threadPool.parallelFor(vertexBlocks, [&](uint32_t block, unsigned) {
+    size_t first = size_t(block) * blockSize;
+    size_t last = std::min(first + blockSize, normals.size());
+    for (size_t i = first; i < last; ++i)
+      normals[i] = normalizedOrZero(normals[i]);
+  });
+
+  return normals;
 }
 
-std::vector<math::Vec3f>
-calculateVertexNormals(std::vector<IndicesTriangle> const &indexTriangles,
-                       std::vector<math::Vec3f> const &vertices,
-                       std::vector<math::Vec3f> const &triangleNormals) {
-	std::vector<Vec3f> tmp;
+Normals calculateVertexNormals(IndicesTriangles const &indexTriangles,
+                               Vertices const &vertices,
+                               concurrency::ThreadPool &threadPool,
+                               NormalWeighting weighting) {
+  return calculateVertexNormals(
+      indexTriangles, vertices,
+      calculateTriangleNormals(indexTriangles, vertices, threadPool),
+      threadPool, weighting);
+}
+
+Normals calculateVertexNormals(IndicesTriangles const &indexTriangles,
+                               Vertices const &vertices,
+                               NormalWeighting weighting) {
+  concurrency::ThreadPool threadPool;
+  return calculateVertexNormals(indexTriangles, vertices, threadPool,
+                                weighting);
+}
 
-	return tmp;
+Normals calculateVertexNormals(IndicesTriangles const &indexTriangles,
+                               Vertices const &vertices,
+                               Normals const &triangleNormals,
+                               NormalWeighting weighting) {
+  concurrency::ThreadPool threadPool;
+  return calculateVertexNormals(indexTriangles, vertices, triangleNormals,
+                                threadPool, weighting);
 }
 
 } // namespace geometry
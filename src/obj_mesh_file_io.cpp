@@ -1,100 +1,433 @@
 #include "obj_mesh_file_io.hpp"
 
-#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <cmath>
-#include <sstream>
-#include <string>
-#include <fstream>
+#include <limits>
+
+#include "mapped_file.hpp"
+#include "timer.hpp"
 
 namespace geometry {
 
-bool loadOBJMeshFromFile(std::string const &filePath, OBJMesh &meshOut) {
+namespace {
 
-  std::ifstream in(filePath.c_str());
+// Numbers are parsed straight out of the mapped file in the style of
+// std::from_chars (which is C++17): each parser reads from [first, last) and
+// returns the end of what it consumed, or first if there is no number there
 
-  if (!in) {
-    std::cerr << "[Error] could not open OBJ file " << filePath << '\n';
-    return false;
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// exact powers of ten, as float and as double
+constexpr float floatPowers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+constexpr double doublePowers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                   1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                   1e18, 1e19, 1e20, 1e21, 1e22};
+
+char const *parseFloat(char const *first, char const *last, float &value) {
+  char const *p = first;
+
+  bool negative = false;
+  if (p != last && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
   }
 
-  std::vector<IndicesTriangle> triangles;
-  std::vector<math::Vec3f> vertices;
-  std::vector<math::Vec2f> textureCoords;
-  std::vector<math::Vec3f> normals;
+  // up to 19 significant digits fit into 64 bits, later ones are dropped
+  // (and only scale the exponent) as they can't change a float
+  uint64_t mantissa = 0;
+  int significantDigits = 0;
+  int exponent = 0;
+  bool anyDigits = false;
 
-  std::string s;
+  for (; p != last && isDigit(*p); ++p) {
+    anyDigits = true;
+    if (significantDigits < 19) {
+      mantissa = mantissa * 10 + uint64_t(*p - '0');
+      significantDigits += mantissa > 0;
+    } else {
+      ++exponent;
+    }
+  }
 
-  while (getline(in, s)) {
-    std::stringstream line(s);
-    std::string token;
+  if (p != last && *p == '.') {
+    for (++p; p != last && isDigit(*p); ++p) {
+      anyDigits = true;
+      if (significantDigits < 19) {
+        mantissa = mantissa * 10 + uint64_t(*p - '0');
+        significantDigits += mantissa > 0;
+        --exponent;
+      }
+    }
+  }
 
-    line >> token; // get first
+  if (!anyDigits)
+    return first;
 
-    if (token == "mtllib") {
-      std::cerr << "[Log] Ignoring mtlib\n";
-    } else if (token == "v") {
-      math::Vec3f vec;
-      line >> vec; // this calls the istream operator >> defined in vec3f.h/cpp
+  if (p != last && (*p == 'e' || *p == 'E')) {
+    char const *e = p + 1;
+    bool negativeExponent = false;
+    if (e != last && (*e == '-' || *e == '+')) {
+      negativeExponent = *e == '-';
+      ++e;
+    }
+    if (e != last && isDigit(*e)) {
+      int digits = 0;
+      for (; e != last && isDigit(*e); ++e)
+        digits = std::min(digits * 10 + (*e - '0'), 100000);
+      exponent += negativeExponent ? -digits : digits;
+      p = e;
+    }
+  }
 
-      vertices.push_back(vec);
-    } else if (token == "vt") {
-      math::Vec2f vec;
-      line >> vec; // this calls the istream operator >> defined in vec3f.h/cpp
+  // Both fast paths only round once, when the exact mantissa and power are
+  // multiplied or divided. The float one is exact like strtof; the double
+  // one is rounded again to float, which can differ from strtof in the last
+  // bit in rare halfway cases.
+  float result;
+  if (mantissa <= (uint64_t(1) << 24) && exponent >= -10 && exponent <= 10) {
+    result = exponent < 0 ? float(mantissa) / floatPowers[-exponent]
+                          : float(mantissa) * floatPowers[exponent];
+  } else if (mantissa <= (uint64_t(1) << 53) && exponent >= -22 &&
+             exponent <= 22) {
+    result = float(exponent < 0 ? double(mantissa) / doublePowers[-exponent]
+                                : double(mantissa) * doublePowers[exponent]);
+  } else {
+    // long mantissas and large exponents, rare in OBJ files
+    char buffer[64];
+    size_t length = size_t(p - first);
+    if (length >= sizeof(buffer))
+      return first;
+    std::memcpy(buffer, first, length);
+    buffer[length] = '\0';
+    value = std::strtof(buffer, nullptr);
+    return p;
+  }
 
-      textureCoords.push_back(vec);
-    } else if (token == "vn") {
-      math::Vec3f vec;
-      line >> vec; // this calls the istream operator >> defined in vec3f.h/cpp
+  value = negative ? -result : result;
+  return p;
+}
 
-      normals.push_back(vec);
-    } else if (token == "f") {
+char const *parseInteger(char const *first, char const *last,
+                         int64_t &value) {
+  char const *p = first;
 
-      std::vector<Indices> tmpIndices;
-      tmpIndices.reserve(4);
+  bool negative = false;
+  if (p != last && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
 
-      while (line >> s) {
-        std::stringstream item(s);
-        Indices tmpIndex;
+  if (p == last || !isDigit(*p))
+    return first;
 
-        if (getline(item, s, '/')) {
-          std::stringstream index(s);
-          index >> tmpIndex.vertexID();
-          tmpIndex.vertexID() -= 1;
-        }
+  int64_t result = 0;
+  for (; p != last && isDigit(*p); ++p)
+    result = std::min<int64_t>(result * 10 + (*p - '0'), INT64_C(1) << 40);
 
-        if (getline(item, s, '/')) {
-          std::stringstream index(s);
-          index >> tmpIndex.textureCoordID();
-          tmpIndex.textureCoordID() -= 1;
-        }
+  value = negative ? -result : result;
+  return p;
+}
 
-        if (getline(item, s, '/')) {
-          std::stringstream index(s);
-          index >> tmpIndex.normalID();
-          tmpIndex.normalID() -= 1;
-        }
+char const *skipBlanks(char const *p, char const *last) {
+  while (p != last && (*p == ' ' || *p == '\t'))
+    ++p;
+  return p;
+}
 
-        tmpIndices.push_back(tmpIndex);
+char const *endOfLine(char const *p, char const *last) {
+  auto end = static_cast<char const *>(std::memchr(p, '\n', size_t(last - p)));
+  return end != nullptr ? end : last;
+}
+
+// whether the line starting at p begins with keyword followed by a blank
+bool startsWith(char const *p, char const *last, char const *keyword) {
+  for (; *keyword != '\0'; ++p, ++keyword)
+    if (p == last || *p != *keyword)
+      return false;
+  return p != last && (*p == ' ' || *p == '\t');
+}
+
+// The part of the file between two line breaks, parsed on its own
+// face indices are made 0 based; relative (negative) ones can only be
+// resolved once the number of elements in the chunks before is known, they
+// are resolved against the start of the chunk and listed in relative
+struct Chunk {
+  Vertices vertices;
+  TextureCoords textureCoords;
+  Normals normals;
+  IndicesTriangles triangles;
+
+  // (triangle * 3 + corner) * 3 + component of each relative index
+  std::vector<uint64_t> relative;
+  // per component, how far the relative indices reach back before the start
+  // of the chunk (negative), the chunks before have to hold that many
+  int64_t lowestRelative[3] = {0, 0, 0};
+  // a positive index that doesn't fit 32 bits
+  bool outOfRange = false;
+
+  bool materialLibrary = false;
+  bool malformed = false;
+  bool notTriangulated = false;
+};
+
+template <size_t N>
+bool parseFloats(char const *p, char const *last, float (&values)[N]) {
+  for (auto &value : values) {
+    p = skipBlanks(p, last);
+    char const *end = parseFloat(p, last, value);
+    if (end == p)
+      return false;
+    p = end;
+  }
+  return true;
+}
+
+void parseFace(char const *p, char const *last, Chunk &chunk) {
+  IndicesTriangle triangle;
+  uint32_t corners = 0;
+  uint64_t firstSlot = uint64_t(chunk.triangles.size()) * 9;
+
+  // local sizes a relative index counts back from
+  int64_t const counts[3] = {int64_t(chunk.vertices.size()),
+                             int64_t(chunk.textureCoords.size()),
+                             int64_t(chunk.normals.size())};
+
+  for (p = skipBlanks(p, last); p != last && *p != '\r';
+       p = skipBlanks(p, last)) {
+    if (corners == 3) {
+      chunk.notTriangulated = true;
+      return;
+    }
+
+    Indices &indices = triangle[corners];
+    // v, v/t, v//n or v/t/n
+    for (int component = 0; component < 3; ++component) {
+      indices[component] = missingIndex;
+      if (component > 0) {
+        if (p == last || *p != '/')
+          continue;
+        ++p;
       }
 
-      if (tmpIndices.size() == 3) {
-        triangles.push_back({tmpIndices[0], // a
-                             tmpIndices[1], // b
-                             tmpIndices[2]} // c
-                            );
+      int64_t index;
+      char const *end = parseInteger(p, last, index);
+      if (end == p) {
+        // only the texture coordinate may be left out (v//n)
+        if (component == 1)
+          continue;
+        chunk.malformed = true;
+        return;
+      }
+      p = end;
 
+      // checked before narrowing, so no index wraps around to a valid one
+      if (index > 0) {
+        if (index > int64_t(std::numeric_limits<uint32_t>::max()))
+          chunk.outOfRange = true;
+        indices[component] = unsigned(index - 1);
+      } else if (index < 0) {
+        int64_t local = counts[component] + index;
+        chunk.lowestRelative[component] =
+            std::min(chunk.lowestRelative[component], local);
+        indices[component] = unsigned(local);
+        chunk.relative.push_back(firstSlot + corners * 3 + component);
       } else {
-        std::cerr << "[Error] not triangulated mesh: " << filePath << '\n';
-        return false;
+        chunk.malformed = true;
+        return;
       }
     }
+    ++corners;
   }
 
-  meshOut = {triangles, vertices, textureCoords, normals};
-  return true;
+  if (corners != 3) {
+    chunk.notTriangulated = true;
+    return;
+  }
+  chunk.triangles.push_back(triangle);
 }
 
+void parseChunk(char const *p, char const *last, Chunk &chunk) {
+  while (p != last && !chunk.malformed && !chunk.notTriangulated) {
+    char const *lineEnd = endOfLine(p, last);
+    p = skipBlanks(p, lineEnd);
 
+    if (startsWith(p, lineEnd, "v")) {
+      float v[3];
+      if (parseFloats(p + 2, lineEnd, v))
+        chunk.vertices.emplace_back(v[0], v[1], v[2]);
+      else
+        chunk.malformed = true;
+    } else if (startsWith(p, lineEnd, "vt")) {
+      float v[2];
+      if (parseFloats(p + 3, lineEnd, v))
+        chunk.textureCoords.emplace_back(v[0], v[1]);
+      else
+        chunk.malformed = true;
+    } else if (startsWith(p, lineEnd, "vn")) {
+      float v[3];
+      if (parseFloats(p + 3, lineEnd, v))
+        chunk.normals.emplace_back(v[0], v[1], v[2]);
+      else
+        chunk.malformed = true;
+    } else if (startsWith(p, lineEnd, "f")) {
+      parseFace(p + 2, lineEnd, chunk);
+    } else if (startsWith(p, lineEnd, "mtllib")) {
+      chunk.materialLibrary = true;
+    }
+    // comments, groups, smoothing groups and materials are skipped
+
+    p = lineEnd == last ? last : lineEnd + 1;
+  }
+}
+
+// chunks are parsed as separate tasks, small enough for the pool to balance
+// them but large enough that the per chunk vectors don't matter
+constexpr size_t chunkSize = size_t(4) << 20;
+
+} // namespace
+
+bool loadOBJMeshFromFile(std::string const &filePath, OBJMesh &meshOut,
+                         concurrency::ThreadPool &threadPool) {
+  temporal::Timer timer(true);
+
+  io::MappedFile file;
+  if (!file.open(filePath)) {
+    std::cerr << "[Error] could not open OBJ file " << filePath << '\n';
+    return false;
+  }
+
+  char const *begin = file.data();
+  char const *end = begin + file.size();
+
+  // split at line breaks, roughly chunkSize apart
+  std::vector<char const *> bounds(1, begin);
+  while (bounds.back() != end) {
+    char const *start = bounds.back();
+    char const *split = start + std::min(chunkSize, size_t(end - start));
+    if (split != end) {
+      split = endOfLine(split, end);
+      if (split != end)
+        ++split;
+    }
+    bounds.push_back(split);
+  }
+
+  uint32_t const chunkCount = uint32_t(bounds.size() - 1);
+  std::vector<Chunk> chunks(chunkCount);
+  threadPool.parallelFor(chunkCount, [&](uint32_t i, unsigned) {
+    parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+  });
+
+  // where each chunk's elements start in the merged arrays
+  struct Offsets {
+    size_t vertices = 0;
+    size_t textureCoords = 0;
+    size_t normals = 0;
+    size_t triangles = 0;
+  };
+  std::vector<Offsets> offsets(chunkCount + 1);
+
+  for (uint32_t i = 0; i < chunkCount; ++i) {
+    auto const &chunk = chunks[i];
+    if (chunk.notTriangulated) {
+      std::cerr << "[Error] not triangulated mesh: " << filePath << '\n';
+      return false;
+    }
+    if (chunk.malformed) {
+      std::cerr << "[Error] malformed OBJ file: " << filePath << '\n';
+      return false;
+    }
+
+    offsets[i + 1].vertices = offsets[i].vertices + chunk.vertices.size();
+    offsets[i + 1].textureCoords =
+        offsets[i].textureCoords + chunk.textureCoords.size();
+    offsets[i + 1].normals = offsets[i].normals + chunk.normals.size();
+    offsets[i + 1].triangles = offsets[i].triangles + chunk.triangles.size();
+  }
+
+  if (std::any_of(chunks.begin(), chunks.end(),
+                  [](Chunk const &c) { return c.materialLibrary; }))
+    std::cerr << "[Log] Ignoring mtlib\n";
+
+  OBJMesh mesh;
+  Offsets const &total = offsets[chunkCount];
+  mesh.vertices.resize(total.vertices);
+  mesh.textureCoords.resize(total.textureCoords);
+  mesh.normals.resize(total.normals);
+  mesh.triangles.resize(total.triangles);
+
+  std::vector<uint8_t> outOfRange(chunkCount, 0);
+  threadPool.parallelFor(chunkCount, [&](uint32_t i, unsigned) {
+    auto &chunk = chunks[i];
+    auto const &offset = offsets[i];
+
+    // relative indices reaching back past the first element of the file
+    size_t const starts[3] = {offset.vertices, offset.textureCoords,
+                              offset.normals};
+    for (int component = 0; component < 3; ++component)
+      if (int64_t(starts[component]) + chunk.lowestRelative[component] < 0)
+        chunk.outOfRange = true;
+
+    std::copy(chunk.vertices.begin(), chunk.vertices.end(),
+              mesh.vertices.begin() + offset.vertices);
+    std::copy(chunk.textureCoords.begin(), chunk.textureCoords.end(),
+              mesh.textureCoords.begin() + offset.textureCoords);
+    std::copy(chunk.normals.begin(), chunk.normals.end(),
+              mesh.normals.begin() + offset.normals);
+
+    // relative indices are resolved against the start of the chunk, unsigned
+    // arithmetic wraps back for the ones reaching into earlier chunks
+    for (auto slot : chunk.relative) {
+      int component = int(slot % 3);
+      auto &corner = chunk.triangles[slot / 9][int(slot / 3 % 3)];
+      corner[component] += unsigned(starts[component]);
+    }
+
+    size_t const sizes[3] = {total.vertices, total.textureCoords,
+                             total.normals};
+    for (auto const &triangle : chunk.triangles)
+      for (int corner = 0; corner < 3; ++corner)
+        for (int component = 0; component < 3; ++component)
+          // only texture coordinates and normals may be missing
+          if (triangle[corner][component] == missingIndex
+                  ? component == 0
+                  : triangle[corner][component] >= sizes[component])
+            outOfRange[i] = 1;
+    if (chunk.outOfRange)
+      outOfRange[i] = 1;
+
+    std::copy(chunk.triangles.begin(), chunk.triangles.end(),
+              mesh.triangles.begin() + offset.triangles);
+
+    // done with it, free the memory while the other chunks are merged
+    chunk = Chunk();
+  });
+
+  if (std::find(outOfRange.begin(), outOfRange.end(), 1) != outOfRange.end()) {
+    std::cerr << "[Error] face index out of range in " << filePath << '\n';
+    return false;
+  }
+
+  meshOut = std::move(mesh);
+
+  double seconds = timer.elapsed<std::chrono::microseconds>() * 1e-6;
+  double megabytes = file.size() * 1e-6;
+  std::cerr << "[Log] loaded " << filePath << ": " << megabytes << " MB in "
+            << seconds * 1e3 << " ms, "
+            << (seconds > 0. ? megabytes / seconds : 0.) << " MB/s on "
+            << threadPool.threadCount() << " threads\n";
+
+  return true;
+}
+
+bool loadOBJMeshFromFile(std::string const &filePath, OBJMesh &meshOut) {
+  concurrency::ThreadPool threadPool;
+  return loadOBJMeshFromFile(filePath, meshOut, threadPool);
+}
 
 } // namespace geometry
@@ -0,0 +1,73 @@
+#include "radix_sort.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace concurrency {
+
+namespace {
+
+// keys handed to a task at once
+constexpr uint32_t blockSize = 1 << 16;
+
+constexpr uint32_t digitCount = 256;
+
+using Histogram = std::array<uint32_t, digitCount>;
+
+} // namespace
+
+void radixSort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values,
+               ThreadPool &threadPool) {
+  auto const count = uint32_t(keys.size());
+  if (count < 2)
+    return;
+
+  uint32_t const blocks = (count + blockSize - 1) / blockSize;
+  std::vector<uint32_t> keysOut(count);
+  std::vector<uint32_t> valuesOut(count);
+  std::vector<Histogram> histograms(blocks);
+
+  for (uint32_t shift = 0; shift < 32; shift += 8) {
+    threadPool.parallelFor(blocks, [&](uint32_t block, unsigned) {
+      Histogram &histogram = histograms[block];
+      histogram.fill(0);
+      uint32_t last = std::min(count, (block + 1) * blockSize);
+      for (uint32_t i = block * blockSize; i < last; ++i)
+        ++histogram[(keys[i] >> shift) & 0xffu];
+    });
+
+    // every key has the same digit, nothing moves
+    Histogram total = {};
+    for (auto const &histogram : histograms)
+      for (uint32_t d = 0; d < digitCount; ++d)
+        total[d] += histogram[d];
+    if (*std::max_element(total.begin(), total.end()) == count)
+      continue;
+
+    // turns the counts into where each block writes its first key of a
+    // digit: all smaller digits first, then the same digit of earlier blocks
+    uint32_t offset = 0;
+    for (uint32_t d = 0; d < digitCount; ++d) {
+      for (auto &histogram : histograms) {
+        uint32_t digits = histogram[d];
+        histogram[d] = offset;
+        offset += digits;
+      }
+    }
+
+    threadPool.parallelFor(blocks, [&](uint32_t block, unsigned) {
+      Histogram &next = histograms[block];
+      uint32_t last = std::min(count, (block + 1) * blockSize);
+      for (uint32_t i = block * blockSize; i < last; ++i) {
+        uint32_t to = next[(keys[i] >> shift) & 0xffu]++;
+        keysOut[to] = keys[i];
+        valuesOut[to] = values[i];
+      }
+    });
+
+    keys.swap(keysOut);
+    values.swap(valuesOut);
+  }
+}
+
+} // namespace concurrency
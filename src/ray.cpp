@@ -2,8 +2,8 @@
 
 namespace geometry {
 
-Ray::Ray(math::Vec3f origin, math::Vec3f direction)
-    : origin(origin), direction(direction) {}
+Ray::Ray(math::Vec3f origin, math::Vec3f direction, float tMin, float tMax)
+    : origin(origin), direction(direction), tMin(tMin), tMax(tMax) {}
 
 math::Vec3f pointOnLne(math::Vec3f const &origin, math::Vec3f const &direction,
                        float t) {
@@ -14,4 +14,8 @@ math::Vec3f evaluate(Ray const &ray, float t) {
   return pointOnLne(ray.origin, ray.direction, t);
 }
 
+bool inInterval(Ray const &ray, float t) {
+  return t > ray.tMin && t < ray.tMax;
+}
+
 } // namespace geometry
\ No newline at end of file
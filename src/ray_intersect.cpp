@@ -1,5 +1,4 @@
 #include "ray_intersect.hpp"
-#include "common_matrices.hpp"
 #include <math.h>
 #include <cmath>
 #include <algorithm>
@@ -9,55 +8,50 @@ namespace geometry {
 
 Hit::operator bool() const { return didIntersect; }
 
-Hit intersect(Ray const &ray, Triangle const &triangle) {
-  Hit hit;
-
-  //construct list of values in a 3x3 matrix
-    math::Mat3f A = math::Mat3f{triangle.a().x - triangle.b().x, triangle.a().x - triangle.c().x, ray.direction.x,
-                              triangle.a().y - triangle.b().y, triangle.a().y - triangle.c().y, ray.direction.y,
-                              triangle.a().z - triangle.b().z, triangle.a().z - triangle.c().z, ray.direction.z};
-
-    float determinantA = math::determinant(A);
-
-    math::Mat3f gammaMatrix = math::Mat3f{triangle.a().x - triangle.b().x, triangle.a().x - ray.origin.x, ray.direction.x,
-                                          triangle.a().y - triangle.b().y, triangle.a().y - ray.origin.y, ray.direction.y,
-                                          triangle.a().z - triangle.b().z, triangle.a().z - ray.origin.z, ray.direction.z};
-    float gamma = math::determinant(gammaMatrix) / determinantA;
-
-    math::Mat3f betaMatrix = math::Mat3f{triangle.a().x - ray.origin.x, triangle.a().x - triangle.c().x, ray.direction.x,
-                                   triangle.a().y - ray.origin.y, triangle.a().y - triangle.c().y, ray.direction.y,
-                                   triangle.a().z - ray.origin.z, triangle.a().z - triangle.c().z, ray.direction.z};
-    float beta = math::determinant(betaMatrix) / determinantA;
+PrecomputedTriangle precompute(Triangle const &triangle) {
+  return {triangle.a(),                //
+          triangle.b() - triangle.a(), //
+          triangle.c() - triangle.a()};
+}
 
+Hit intersect(Ray const &ray, PrecomputedTriangle const &triangle) {
+  Hit hit;
 
+  math::Vec3f p = ray.direction ^ triangle.edgeAC;
+  float det = triangle.edgeAB * p;
 
-    math::Mat3f tMatrix = math::Mat3f{triangle.a().x - triangle.b().x, triangle.a().x - triangle.c().x, triangle.a().x - ray.origin.x,
-                                      triangle.a().y - triangle.b().y, triangle.a().y - triangle.c().y, triangle.a().y - ray.origin.y,
-                                      triangle.a().z - triangle.b().z, triangle.a().z - triangle.c().z, triangle.a().z - ray.origin.z};
-    float tResult = math::determinant(tMatrix) / determinantA;
+  // ray is parallel to the triangle
+  if (det == 0.f)
+    return hit;
 
+  float invDet = 1.f / det;
 
-    if(tResult < 0 || tResult > 10000) {
-      hit.didIntersect = false;
-      return hit;
-    }
+  math::Vec3f s = ray.origin - triangle.a;
+  float u = (s * p) * invDet;
+  if (u < 0.f || u > 1.f)
+    return hit;
 
-    if(gamma < 0 || gamma > 1) {
-        hit.didIntersect = false;
-        return hit;
-    }
+  math::Vec3f q = s ^ triangle.edgeAB;
+  float v = (ray.direction * q) * invDet;
+  if (v < 0.f || u + v > 1.f)
+    return hit;
 
-    if(beta < 0 || beta > (1 - gamma)) {
-        hit.didIntersect = false;
-        return hit;
-    }
+  float t = (triangle.edgeAC * q) * invDet;
+  if (!inInterval(ray, t))
+    return hit;
 
-    hit.didIntersect = true;
-    hit.rayDepth = tResult;
+  hit.didIntersect = true;
+  hit.rayDepth = t;
+  hit.u = u;
+  hit.v = v;
 
   return hit;
 }
 
+Hit intersect(Ray const &ray, Triangle const &triangle) {
+  return intersect(ray, precompute(triangle));
+}
+
 Hit intersect(Ray const &ray, Sphere const &sphere) {
   Hit hit;
 
@@ -78,9 +72,13 @@ Hit intersect(Ray const &ray, Sphere const &sphere) {
     float t0 = ((-d) * (e - c) + std::sqrt(discriminant)) / (d * d);
     float t1 = ((-d) * (e - c) - std::sqrt(discriminant)) / (d * d);
 
-    //we want the smaller of the 2
+    //we want the smaller of the 2, unless it is outside the ray interval
+    //(e.g. behind the origin of a ray starting inside the sphere)
     float t = std::min(t0, t1);
-
+    if (!inInterval(ray, t))
+        t = std::max(t0, t1);
+    if (!inInterval(ray, t))
+        return hit;
 
     hit.rayDepth = t;
     hit.didIntersect = true;
@@ -96,7 +94,7 @@ Hit intersect(Ray const &r, Plane const &p) {
 
   auto t = ((p.origin - r.origin) * p.normal) / denom;
 
-  if (t < 0.f)
+  if (!inInterval(r, t))
     return hit;
 
   hit.didIntersect = true;
@@ -0,0 +1,490 @@
+#include "ray_packet.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "aabb.hpp"
+#include "bvh.hpp"
+#include "simd_intersect.hpp"
+
+using namespace math;
+using namespace geometry;
+
+namespace raytracing {
+
+void append(RayPacket &packet, Ray const &ray) {
+  uint32_t i = packet.size++;
+  packet.originX[i] = ray.origin.x;
+  packet.originY[i] = ray.origin.y;
+  packet.originZ[i] = ray.origin.z;
+  packet.directionX[i] = ray.direction.x;
+  packet.directionY[i] = ray.direction.y;
+  packet.directionZ[i] = ray.direction.z;
+  packet.tMin[i] = ray.tMin;
+  packet.tMax[i] = ray.tMax;
+}
+
+Ray rayAt(RayPacket const &packet, uint32_t index) {
+  return Ray(Vec3f(packet.originX[index], packet.originY[index],
+                   packet.originZ[index]),
+             Vec3f(packet.directionX[index], packet.directionY[index],
+                   packet.directionZ[index]),
+             packet.tMin[index], packet.tMax[index]);
+}
+
+#ifdef RAYTRACING_SIMD
+
+namespace {
+
+using namespace simd;
+
+constexpr uint32_t registerCount = maxPacketSize / laneCount;
+
+// slot of the closest hit of a ray that has not hit anything yet
+constexpr uint32_t noHit = ~0u;
+
+// depth of rays found to be occluded, before the interval of every ray so
+// traversal drops them
+constexpr float occludedDepth = -1.f;
+
+// closest hits, or any hit for occlusion queries
+enum class Query { CLOSEST, ANY };
+
+// The rays of a packet spread over registerCount registers and the closest
+// hit found so far for each of them, shared by all primitive types
+struct Traversal {
+  float originX[maxPacketSize] = {};
+  float originY[maxPacketSize] = {};
+  float originZ[maxPacketSize] = {};
+  float directionX[maxPacketSize] = {};
+  float directionY[maxPacketSize] = {};
+  float directionZ[maxPacketSize] = {};
+  float invDirectionX[maxPacketSize] = {};
+  float invDirectionY[maxPacketSize] = {};
+  float invDirectionZ[maxPacketSize] = {};
+  float lengthSquared[maxPacketSize] = {}; // direction * direction
+  float tMin[maxPacketSize] = {};
+
+  float depth[maxPacketSize] = {};
+  float u[maxPacketSize] = {};
+  float v[maxPacketSize] = {};
+  uint32_t index[maxPacketSize] = {}; // noHit, or slot of the closest hit
+
+  Float active[registerCount]; // lanes holding a ray
+  uint32_t rayCount = 0;
+  uint32_t registers = 0; // registers holding at least one ray
+};
+
+void initialize(Traversal &state, RayPacket const &packet) {
+  for (uint32_t i = 0; i < packet.size; ++i) {
+    float dx = packet.directionX[i];
+    float dy = packet.directionY[i];
+    float dz = packet.directionZ[i];
+    state.originX[i] = packet.originX[i];
+    state.originY[i] = packet.originY[i];
+    state.originZ[i] = packet.originZ[i];
+    state.directionX[i] = dx;
+    state.directionY[i] = dy;
+    state.directionZ[i] = dz;
+    state.invDirectionX[i] = 1.f / dx;
+    state.invDirectionY[i] = 1.f / dy;
+    state.invDirectionZ[i] = 1.f / dz;
+    state.lengthSquared[i] = dx * dx + dy * dy + dz * dz;
+    state.tMin[i] = packet.tMin[i];
+    state.depth[i] = packet.tMax[i];
+  }
+
+  state.rayCount = packet.size;
+  state.registers = (packet.size + laneCount - 1) / laneCount;
+  for (uint32_t r = 0; r < registerCount; ++r)
+    state.active[r] = activeLanes(packet.size > r * laneCount
+                                      ? packet.size - r * laneCount
+                                      : 0);
+}
+
+// lanes of register r whose ray overlaps box between tMin and its closest
+// hit, the same slab test as intersect(AABB, ...)
+Float intersect(AABB const &box, Traversal const &state, uint32_t r) {
+  uint32_t base = r * laneCount;
+  Float ox = load(&state.originX[base]);
+  Float oy = load(&state.originY[base]);
+  Float oz = load(&state.originZ[base]);
+  Float invX = load(&state.invDirectionX[base]);
+  Float invY = load(&state.invDirectionY[base]);
+  Float invZ = load(&state.invDirectionZ[base]);
+
+  Float t0x = (broadcast(box.min.x) - ox) * invX;
+  Float t1x = (broadcast(box.max.x) - ox) * invX;
+  Float t0y = (broadcast(box.min.y) - oy) * invY;
+  Float t1y = (broadcast(box.max.y) - oy) * invY;
+  Float t0z = (broadcast(box.min.z) - oz) * invZ;
+  Float t1z = (broadcast(box.max.z) - oz) * invZ;
+
+  Float tEnter = max(max(min(t0x, t1x), min(t0y, t1y)),
+                     max(min(t0z, t1z), load(&state.tMin[base])));
+  Float tExit = min(min(max(t0x, t1x), max(t0y, t1y)),
+                    min(max(t0z, t1z), load(&state.depth[base])));
+
+  return state.active[r] & (tEnter <= tExit);
+}
+
+// Packet traversal of one BVH
+// intersectLeaf(offset, count, masks) tests the leaf's primitives against the
+// rays set in masks, intersectSingle(node, ray) traverses the subtree below
+// node with one ray of the packet
+template <typename PacketLeaf, typename SingleRay>
+void traverse(BVH const &bvh, Traversal &state, PacketLeaf intersectLeaf,
+              SingleRay intersectSingle) {
+  if (bvh.isEmpty())
+    return;
+
+  // interior nodes hit by no more than a quarter of the rays are left to
+  // single ray traversal, at that point most lanes would idle
+  uint32_t const divergedRayCount = std::max(1u, state.rayCount / 4);
+
+  // depth is bounded by the builder, 64 is plenty
+  uint32_t stack[64];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    uint32_t nodeIndex = stack[--top];
+    BVHNode const &node = bvh.nodes[nodeIndex];
+
+    Float masks[registerCount];
+    uint32_t hitCount = 0;
+    for (uint32_t r = 0; r < state.registers; ++r) {
+      masks[r] = intersect(node.bounds, state, r);
+      hitCount += count(masks[r]);
+    }
+
+    if (hitCount == 0)
+      continue;
+
+    if (node.isLeaf()) {
+      intersectLeaf(node.offset, node.count, masks);
+      continue;
+    }
+
+    if (hitCount <= divergedRayCount) {
+      for (uint32_t r = 0; r < state.registers; ++r)
+        for (uint32_t lane = 0; lane < laneCount; ++lane)
+          if (bits(masks[r]) & (1u << lane))
+            intersectSingle(nodeIndex, r * laneCount + lane);
+      continue;
+    }
+
+    uint32_t left = nodeIndex + 1;
+    uint32_t right = node.offset;
+
+    // order the children along the axis they are furthest apart on, by the
+    // direction of the first ray, the packet is assumed to mostly agree
+    Vec3f separation = centroid(bvh.nodes[right].bounds) -
+                       centroid(bvh.nodes[left].bounds);
+    int axis = 0;
+    for (int a = 1; a < 3; ++a)
+      if (std::abs(axisComponent(separation, a)) >
+          std::abs(axisComponent(separation, axis)))
+        axis = a;
+
+    Vec3f firstDirection(state.directionX[0], state.directionY[0],
+                         state.directionZ[0]);
+    bool rightFirst = axisComponent(firstDirection, axis) *
+                          axisComponent(separation, axis) <
+                      0.f;
+
+    // push far child first so the near one is popped first
+    if (rightFirst) {
+      stack[top++] = left;
+      stack[top++] = right;
+    } else {
+      stack[top++] = right;
+      stack[top++] = left;
+    }
+  }
+}
+
+// records lanes that found a closest hit in this traversal into hits
+void resolve(Traversal const &state, PrimitiveType type, SceneHit *hits) {
+  for (uint32_t i = 0; i < state.rayCount; ++i) {
+    if (state.index[i] == noHit)
+      continue;
+    hits[i].hit.didIntersect = true;
+    hits[i].hit.rayDepth = state.depth[i];
+    hits[i].hit.u = state.u[i];
+    hits[i].hit.v = state.v[i];
+    hits[i].type = type;
+    hits[i].primitive = state.index[i];
+  }
+}
+
+// keeps the closest hit of a single ray traversal of lane
+void update(Traversal &state, uint32_t lane, Hit const &hit, uint32_t index) {
+  if (!hit)
+    return;
+  state.depth[lane] = hit.rayDepth;
+  state.u[lane] = hit.u;
+  state.v[lane] = hit.v;
+  state.index[lane] = index;
+}
+
+void intersectSpheres(RayPacket const &packet, Scene const &scene,
+                      Query query, Traversal &state) {
+  auto const &spheres = scene.spheres;
+  Float const zero = broadcast(0.f);
+  Float const found = broadcast(occludedDepth);
+
+  auto intersectLeaf = [&](uint32_t offset, uint32_t count,
+                           Float const *masks) {
+    for (uint32_t i = offset; i < offset + count; ++i) {
+      Float cx = broadcast(spheres.centerX[i]);
+      Float cy = broadcast(spheres.centerY[i]);
+      Float cz = broadcast(spheres.centerZ[i]);
+      Float radius = broadcast(spheres.radius[i]);
+
+      for (uint32_t r = 0; r < state.registers; ++r) {
+        if (!any(masks[r]))
+          continue;
+        uint32_t base = r * laneCount;
+
+        // as intersectSpheres, one sphere against laneCount rays
+        Float dx = load(&state.directionX[base]);
+        Float dy = load(&state.directionY[base]);
+        Float dz = load(&state.directionZ[base]);
+        Float a = load(&state.lengthSquared[base]);
+        Float ocx = load(&state.originX[base]) - cx;
+        Float ocy = load(&state.originY[base]) - cy;
+        Float ocz = load(&state.originZ[base]) - cz;
+
+        Float b = dx * ocx + dy * ocy + dz * ocz;
+        Float c = ocx * ocx + ocy * ocy + ocz * ocz - radius * radius;
+        Float discriminant = b * b - a * c;
+        Float root = sqrt(max(discriminant, zero));
+        Float tNear = (zero - b - root) / a;
+        Float tMin = load(&state.tMin[base]);
+        Float t = select(tNear > tMin, tNear, (root - b) / a);
+
+        Float depth = load(&state.depth[base]);
+        Float hit = masks[r] & (discriminant >= zero) & (t > tMin) &
+                    (t < depth);
+        if (!any(hit))
+          continue;
+
+        store(&state.depth[base],
+              select(hit, query == Query::ANY ? found : t, depth));
+        store(&state.index[base],
+              select(hit, broadcast(i), load(&state.index[base])));
+      }
+    }
+  };
+
+  auto intersectSingle = [&](uint32_t node, uint32_t lane) {
+    Ray ray = rayAt(packet, lane);
+    ray.tMax = state.depth[lane];
+    uint32_t index = noHit;
+
+    if (query == Query::ANY) {
+      if (anyHit(
+              scene.sphereBVH, ray,
+              [&](uint32_t offset, uint32_t count) {
+                return occludedSpheresSIMD(spheres, offset, count, ray,
+                                           index);
+              },
+              node)) {
+        state.depth[lane] = occludedDepth;
+        state.index[lane] = index;
+      }
+      return;
+    }
+
+    auto hit = closestHit(
+        scene.sphereBVH, ray,
+        [&](uint32_t offset, uint32_t count, Hit &closest) {
+          intersectSpheresSIMD(spheres, offset, count, ray, closest, index);
+        },
+        node);
+    update(state, lane, hit, index);
+  };
+
+  traverse(scene.sphereBVH, state, intersectLeaf, intersectSingle);
+}
+
+void intersectTriangles(RayPacket const &packet, Scene const &scene,
+                        Query query, Traversal &state) {
+  auto const &triangles = scene.triangles;
+  Float const zero = broadcast(0.f);
+  Float const found = broadcast(occludedDepth);
+  Float const one = broadcast(1.f);
+
+  auto intersectLeaf = [&](uint32_t offset, uint32_t count,
+                           Float const *masks) {
+    for (uint32_t i = offset; i < offset + count; ++i) {
+      Float ax = broadcast(triangles.ax[i]);
+      Float ay = broadcast(triangles.ay[i]);
+      Float az = broadcast(triangles.az[i]);
+      Float abx = broadcast(triangles.abx[i]);
+      Float aby = broadcast(triangles.aby[i]);
+      Float abz = broadcast(triangles.abz[i]);
+      Float acx = broadcast(triangles.acx[i]);
+      Float acy = broadcast(triangles.acy[i]);
+      Float acz = broadcast(triangles.acz[i]);
+
+      for (uint32_t r = 0; r < state.registers; ++r) {
+        if (!any(masks[r]))
+          continue;
+        uint32_t base = r * laneCount;
+
+        // as intersectTriangles, one triangle against laneCount rays
+        Float dx = load(&state.directionX[base]);
+        Float dy = load(&state.directionY[base]);
+        Float dz = load(&state.directionZ[base]);
+
+        Float px = dy * acz - dz * acy;
+        Float py = dz * acx - dx * acz;
+        Float pz = dx * acy - dy * acx;
+
+        Float det = abx * px + aby * py + abz * pz;
+        Float invDet = one / det;
+
+        Float sx = load(&state.originX[base]) - ax;
+        Float sy = load(&state.originY[base]) - ay;
+        Float sz = load(&state.originZ[base]) - az;
+
+        Float u = (sx * px + sy * py + sz * pz) * invDet;
+
+        Float qx = sy * abz - sz * aby;
+        Float qy = sz * abx - sx * abz;
+        Float qz = sx * aby - sy * abx;
+
+        Float v = (dx * qx + dy * qy + dz * qz) * invDet;
+        Float t = (acx * qx + acy * qy + acz * qz) * invDet;
+
+        Float depth = load(&state.depth[base]);
+        Float hit = masks[r] & (det != zero) & (u >= zero) & (u <= one) &
+                    (v >= zero) & (u + v <= one) &
+                    (t > load(&state.tMin[base])) & (t < depth);
+        if (!any(hit))
+          continue;
+
+        store(&state.depth[base],
+              select(hit, query == Query::ANY ? found : t, depth));
+        store(&state.u[base], select(hit, u, load(&state.u[base])));
+        store(&state.v[base], select(hit, v, load(&state.v[base])));
+        store(&state.index[base],
+              select(hit, broadcast(i), load(&state.index[base])));
+      }
+    }
+  };
+
+  auto intersectSingle = [&](uint32_t node, uint32_t lane) {
+    Ray ray = rayAt(packet, lane);
+    ray.tMax = state.depth[lane];
+    uint32_t index = noHit;
+
+    if (query == Query::ANY) {
+      if (anyHit(
+              scene.triangleBVH, ray,
+              [&](uint32_t offset, uint32_t count) {
+                return occludedTrianglesSIMD(triangles, offset, count, ray,
+                                             index);
+              },
+              node)) {
+        state.depth[lane] = occludedDepth;
+        state.index[lane] = index;
+      }
+      return;
+    }
+
+    auto hit = closestHit(
+        scene.triangleBVH, ray,
+        [&](uint32_t offset, uint32_t count, Hit &closest) {
+          intersectTrianglesSIMD(triangles, offset, count, ray, closest,
+                                 index);
+        },
+        node);
+    update(state, lane, hit, index);
+  };
+
+  traverse(scene.triangleBVH, state, intersectLeaf, intersectSingle);
+}
+
+} // namespace
+
+void intersect(RayPacket const &packet, Scene const &scene, SceneHit *hits) {
+  Traversal state;
+  initialize(state, packet);
+
+  for (uint32_t i = 0; i < packet.size; ++i) {
+    hits[i] = SceneHit();
+    hits[i].hit.rayDepth = packet.tMax[i];
+  }
+
+  // same order as intersect(Ray, Scene), each type only looks for hits
+  // nearer than the ones found before
+  std::fill(state.index, state.index + maxPacketSize, noHit);
+  intersectSpheres(packet, scene, Query::CLOSEST, state);
+  resolve(state, PrimitiveType::SPHERE, hits);
+
+  std::fill(state.index, state.index + maxPacketSize, noHit);
+  intersectTriangles(packet, scene, Query::CLOSEST, state);
+  resolve(state, PrimitiveType::TRIANGLE, hits);
+
+  for (uint32_t i = 0; i < packet.size; ++i) {
+    Ray ray = rayAt(packet, i);
+    intersectPlanesAndMeshes(ray, scene, hits[i]);
+    if (hits[i])
+      evaluateSurface(hits[i], ray, scene);
+  }
+}
+
+// remembers a primitive the last traversal found in the cache
+void updateCache(Traversal const &state, PrimitiveType type,
+                 OcclusionCache &cache) {
+  for (uint32_t i = 0; i < state.rayCount; ++i) {
+    if (state.index[i] != noHit) {
+      cache.type = type;
+      cache.index = state.index[i];
+      return;
+    }
+  }
+}
+
+void occluded(RayPacket const &packet, Scene const &scene, bool *occluded,
+              OcclusionCache &cache) {
+  Traversal state;
+  initialize(state, packet);
+
+  // rays found occluded are out of the traversal from then on
+  for (uint32_t i = 0; i < packet.size; ++i)
+    if (occludedByCached(rayAt(packet, i), scene, cache))
+      state.depth[i] = occludedDepth;
+
+  std::fill(state.index, state.index + maxPacketSize, noHit);
+  intersectSpheres(packet, scene, Query::ANY, state);
+  updateCache(state, PrimitiveType::SPHERE, cache);
+
+  std::fill(state.index, state.index + maxPacketSize, noHit);
+  intersectTriangles(packet, scene, Query::ANY, state);
+  updateCache(state, PrimitiveType::TRIANGLE, cache);
+
+  for (uint32_t i = 0; i < packet.size; ++i)
+    occluded[i] = state.depth[i] == occludedDepth ||
+                  occludedByPlanesOrMeshes(rayAt(packet, i), scene, cache);
+}
+
+#else
+
+void intersect(RayPacket const &packet, Scene const &scene, SceneHit *hits) {
+  for (uint32_t i = 0; i < packet.size; ++i)
+    hits[i] = intersect(rayAt(packet, i), scene);
+}
+
+void occluded(RayPacket const &packet, Scene const &scene, bool *occluded,
+              OcclusionCache &cache) {
+  for (uint32_t i = 0; i < packet.size; ++i)
+    occluded[i] = raytracing::occluded(rayAt(packet, i), scene, cache);
+}
+
+#endif
+
+} // namespace raytracing
@@ -0,0 +1,181 @@
+#include "ray_queue.hpp"
+
+#include <algorithm>
+
+#include "aabb.hpp"
+#include "morton.hpp"
+
+using namespace math;
+using namespace geometry;
+
+namespace raytracing {
+
+void RayQueue::clear() {
+  originX.clear();
+  originY.clear();
+  originZ.clear();
+  directionX.clear();
+  directionY.clear();
+  directionZ.clear();
+  tMin.clear();
+  tMax.clear();
+}
+
+void RayQueue::reserve(uint32_t count) {
+  originX.reserve(count);
+  originY.reserve(count);
+  originZ.reserve(count);
+  directionX.reserve(count);
+  directionY.reserve(count);
+  directionZ.reserve(count);
+  tMin.reserve(count);
+  tMax.reserve(count);
+}
+
+void append(RayQueue &queue, Ray const &ray) {
+  queue.originX.push_back(ray.origin.x);
+  queue.originY.push_back(ray.origin.y);
+  queue.originZ.push_back(ray.origin.z);
+  queue.directionX.push_back(ray.direction.x);
+  queue.directionY.push_back(ray.direction.y);
+  queue.directionZ.push_back(ray.direction.z);
+  queue.tMin.push_back(ray.tMin);
+  queue.tMax.push_back(ray.tMax);
+}
+
+Ray rayAt(RayQueue const &queue, uint32_t index) {
+  return Ray(Vec3f(queue.originX[index], queue.originY[index],
+                   queue.originZ[index]),
+             Vec3f(queue.directionX[index], queue.directionY[index],
+                   queue.directionZ[index]),
+             queue.tMin[index], queue.tMax[index]);
+}
+
+void load(RayPacket &packet, RayQueue const &queue, uint32_t first,
+          uint32_t count) {
+  auto copy = [&](std::vector<float> const &from, float *to) {
+    std::copy(from.begin() + first, from.begin() + first + count, to);
+  };
+  copy(queue.originX, packet.originX);
+  copy(queue.originY, packet.originY);
+  copy(queue.originZ, packet.originZ);
+  copy(queue.directionX, packet.directionX);
+  copy(queue.directionY, packet.directionY);
+  copy(queue.directionZ, packet.directionZ);
+  copy(queue.tMin, packet.tMin);
+  copy(queue.tMax, packet.tMax);
+  packet.size = count;
+}
+
+void intersect(RayQueue const &queue, Scene const &scene,
+               std::vector<SceneHit> &hits, uint32_t packetSize) {
+  uint32_t const size = queue.size();
+  hits.resize(size);
+  if (packetSize == 0) {
+    for (uint32_t i = 0; i < size; ++i)
+      hits[i] = intersect(rayAt(queue, i), scene);
+    return;
+  }
+
+  RayPacket packet;
+  for (uint32_t first = 0; first < size; first += packetSize) {
+    load(packet, queue, first, std::min(packetSize, size - first));
+    intersect(packet, scene, hits.data() + first);
+  }
+}
+
+void occluded(RayQueue const &queue, Scene const &scene,
+              std::vector<bool> &occluded, OcclusionCache &cache,
+              uint32_t packetSize) {
+  uint32_t const size = queue.size();
+  occluded.resize(size);
+  if (packetSize == 0) {
+    for (uint32_t i = 0; i < size; ++i)
+      occluded[i] = raytracing::occluded(rayAt(queue, i), scene, cache);
+    return;
+  }
+
+  RayPacket packet;
+  bool blocked[maxPacketSize];
+  for (uint32_t first = 0; first < size; first += packetSize) {
+    uint32_t count = std::min(packetSize, size - first);
+    load(packet, queue, first, count);
+    raytracing::occluded(packet, scene, blocked, cache);
+    std::copy(blocked, blocked + count, occluded.begin() + first);
+  }
+}
+
+void sortByCoherence(RayQueue &queue, RaySort &sort) {
+  uint32_t const size = queue.size();
+
+  AABB origins;
+  for (uint32_t i = 0; i < size; ++i)
+    origins = merge(origins, Vec3f(queue.originX[i], queue.originY[i],
+                                   queue.originZ[i]));
+
+  // origins on a 16^3 grid over their bounds, finer cells would only split
+  // up what fits in one packet anyway
+  Vec3f const range = extent(origins);
+  auto scale = [](float length) {
+    return length > 0.f ? 15.f / length : 0.f;
+  };
+  float const scaleX = scale(range.x);
+  float const scaleY = scale(range.y);
+  float const scaleZ = scale(range.z);
+
+  sort.keys.resize(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    uint32_t octant = (queue.directionX[i] < 0.f ? 4u : 0u) |
+                      (queue.directionY[i] < 0.f ? 2u : 0u) |
+                      (queue.directionZ[i] < 0.f ? 1u : 0u);
+    uint32_t cell = mortonCode(
+        uint32_t((queue.originX[i] - origins.min.x) * scaleX),
+        uint32_t((queue.originY[i] - origins.min.y) * scaleY),
+        uint32_t((queue.originZ[i] - origins.min.z) * scaleZ));
+    sort.keys[i] = uint16_t((octant << 12) | cell);
+  }
+
+  // radix sort of the 15 bit keys, low byte then high byte; stable, so rays
+  // of a cell keep the order they came in
+  sort.order.resize(size);
+  sort.scratch.resize(size);
+  uint32_t *from = sort.scratch.data();
+  uint32_t *to = sort.order.data();
+  for (uint32_t i = 0; i < size; ++i)
+    from[i] = i;
+  for (uint32_t shift = 0; shift < 16; shift += 8) {
+    uint32_t offsets[256] = {};
+    for (uint32_t i = 0; i < size; ++i)
+      ++offsets[(sort.keys[i] >> shift) & 0xffu];
+    uint32_t sum = 0;
+    for (uint32_t &offset : offsets) {
+      uint32_t count = offset;
+      offset = sum;
+      sum += count;
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+      uint32_t ray = from[i];
+      to[offsets[(sort.keys[ray] >> shift) & 0xffu]++] = ray;
+    }
+    std::swap(from, to);
+  }
+  if (from != sort.order.data())
+    sort.order.swap(sort.scratch);
+
+  auto gather = [&](std::vector<float> const &in, std::vector<float> &out) {
+    out.resize(size);
+    for (uint32_t i = 0; i < size; ++i)
+      out[i] = in[sort.order[i]];
+  };
+  gather(queue.originX, sort.sorted.originX);
+  gather(queue.originY, sort.sorted.originY);
+  gather(queue.originZ, sort.sorted.originZ);
+  gather(queue.directionX, sort.sorted.directionX);
+  gather(queue.directionY, sort.sorted.directionY);
+  gather(queue.directionZ, sort.sorted.directionZ);
+  gather(queue.tMin, sort.sorted.tMin);
+  gather(queue.tMax, sort.sorted.tMax);
+  std::swap(queue, sort.sorted);
+}
+
+} // namespace raytracing
@@ -0,0 +1,610 @@
+#include "scene.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "aabb.hpp"
+#include "simd_intersect.hpp"
+
+using namespace math;
+using namespace geometry;
+
+namespace raytracing {
+
+namespace {
+
+void appendSphere(Spheres &spheres, Sphere const &s) {
+  spheres.centerX.push_back(s.origin.x);
+  spheres.centerY.push_back(s.origin.y);
+  spheres.centerZ.push_back(s.origin.z);
+  spheres.radius.push_back(s.radius);
+  spheres.colour.push_back(s.colour);
+}
+
+void appendTriangle(Triangles &triangles, Triangle const &t) {
+  auto p = precompute(t);
+  triangles.ax.push_back(p.a.x);
+  triangles.ay.push_back(p.a.y);
+  triangles.az.push_back(p.a.z);
+  triangles.abx.push_back(p.edgeAB.x);
+  triangles.aby.push_back(p.edgeAB.y);
+  triangles.abz.push_back(p.edgeAB.z);
+  triangles.acx.push_back(p.edgeAC.x);
+  triangles.acy.push_back(p.edgeAC.y);
+  triangles.acz.push_back(p.edgeAC.z);
+  triangles.normal.push_back(normal(t));
+  triangles.colour.push_back(t.colour);
+}
+
+void setSphere(Spheres &spheres, uint32_t slot, Sphere const &s) {
+  spheres.centerX[slot] = s.origin.x;
+  spheres.centerY[slot] = s.origin.y;
+  spheres.centerZ[slot] = s.origin.z;
+  spheres.radius[slot] = s.radius;
+  spheres.colour[slot] = s.colour;
+}
+
+void setTriangle(Triangles &triangles, uint32_t slot, Triangle const &t) {
+  auto p = precompute(t);
+  triangles.ax[slot] = p.a.x;
+  triangles.ay[slot] = p.a.y;
+  triangles.az[slot] = p.a.z;
+  triangles.abx[slot] = p.edgeAB.x;
+  triangles.aby[slot] = p.edgeAB.y;
+  triangles.abz[slot] = p.edgeAB.z;
+  triangles.acx[slot] = p.edgeAC.x;
+  triangles.acy[slot] = p.edgeAC.y;
+  triangles.acz[slot] = p.edgeAC.z;
+  triangles.normal[slot] = normal(t);
+  triangles.colour[slot] = t.colour;
+}
+
+AABB sphereBounds(Spheres const &spheres, uint32_t slot) {
+  Vec3f center(spheres.centerX[slot], spheres.centerY[slot],
+               spheres.centerZ[slot]);
+  Vec3f r(spheres.radius[slot], spheres.radius[slot], spheres.radius[slot]);
+  return {center - r, center + r};
+}
+
+AABB triangleBounds(Triangles const &triangles, uint32_t slot) {
+  Vec3f a(triangles.ax[slot], triangles.ay[slot], triangles.az[slot]);
+  Vec3f ab(triangles.abx[slot], triangles.aby[slot], triangles.abz[slot]);
+  Vec3f ac(triangles.acx[slot], triangles.acy[slot], triangles.acz[slot]);
+  return merge(AABB(a, a), merge(AABB(a + ab, a + ab), a + ac));
+}
+
+// leaves are intersected laneCount primitives at a time
+BVHBuildOptions bvhOptions(SceneBuildOptions const &buildOptions) {
+  BVHBuildOptions options;
+  options.maxLeafSize = std::max(options.maxLeafSize, simd::laneCount);
+  options.leafGroupSize = simd::laneCount;
+  options.treeletRounds = buildOptions.treeletRounds;
+  return options;
+}
+
+BVH buildSceneBVH(std::vector<AABB> const &primitiveBounds,
+                  SceneBuildOptions const &buildOptions,
+                  concurrency::ThreadPool &threadPool) {
+  return buildOptions.builder == BVHBuilder::LINEAR
+             ? buildLinearBVH(primitiveBounds, threadPool,
+                              bvhOptions(buildOptions))
+             : buildBVH(primitiveBounds, bvhOptions(buildOptions));
+}
+
+// slots of the primitives from the BVH that laid them out
+std::vector<uint32_t> slotsOf(BVH const &bvh) {
+  std::vector<uint32_t> slots(bvh.primitiveIndices.size());
+  for (uint32_t slot = 0; slot < slots.size(); ++slot)
+    slots[bvh.primitiveIndices[slot]] = slot;
+  return slots;
+}
+
+// values[from[i]] to slot i, padding past from.size() stays
+template <typename T>
+void reorder(std::vector<T> &values, std::vector<uint32_t> const &from) {
+  std::vector<T> reordered(values);
+  for (uint32_t i = 0; i < from.size(); ++i)
+    reordered[i] = values[from[i]];
+  values.swap(reordered);
+}
+
+// primitives handed to a task at once
+constexpr uint32_t blockSize = 1 << 16;
+
+// the bounds of every slot, indexed as when the BVH was built
+template <typename SlotBounds>
+std::vector<AABB> primitiveBounds(BVH const &bvh, SlotBounds slotBounds,
+                                  concurrency::ThreadPool &threadPool) {
+  auto const count = uint32_t(bvh.primitiveIndices.size());
+  std::vector<AABB> result(count);
+  threadPool.parallelFor(
+      (count + blockSize - 1) / blockSize, [&](uint32_t block, unsigned) {
+        uint32_t last = std::min(count, (block + 1) * blockSize);
+        for (uint32_t slot = block * blockSize; slot < last; ++slot)
+          result[bvh.primitiveIndices[slot]] = slotBounds(slot);
+      });
+  return result;
+}
+
+// grids are not refit but built again over the bounds of the slots, in
+// linear time
+void buildGrids(Scene &scene) {
+  auto const accelerator = scene.buildOptions.accelerator;
+  if (accelerator != Accelerator::GRID &&
+      accelerator != Accelerator::TWO_LEVEL_GRID)
+    return;
+
+  std::vector<AABB> spheres(scene.spheres.size());
+  for (uint32_t slot = 0; slot < spheres.size(); ++slot)
+    spheres[slot] = sphereBounds(scene.spheres, slot);
+  std::vector<AABB> triangles(scene.triangles.size());
+  for (uint32_t slot = 0; slot < triangles.size(); ++slot)
+    triangles[slot] = triangleBounds(scene.triangles, slot);
+
+  auto const &options = scene.buildOptions.grid;
+  if (accelerator == Accelerator::GRID) {
+    scene.sphereGrid = buildUniformGrid(spheres, options);
+    scene.triangleGrid = buildUniformGrid(triangles, options);
+  } else {
+    scene.sphereTwoLevelGrid = buildTwoLevelGrid(spheres, options);
+    scene.triangleTwoLevelGrid = buildTwoLevelGrid(triangles, options);
+  }
+}
+
+// closest hit in what single rays traverse, see Accelerator
+template <typename LeafIntersect>
+Hit closestHitIn(Accelerator accelerator, BVH const &bvh,
+                 WideBVH const &wideBVH, UniformGrid const &grid,
+                 TwoLevelGrid const &twoLevelGrid, Ray const &ray,
+                 LeafIntersect intersectLeaf) {
+  switch (accelerator) {
+  case Accelerator::WIDE_BVH:
+    return closestHit(wideBVH, ray, intersectLeaf);
+  case Accelerator::GRID:
+    return closestHit(grid, ray, intersectLeaf);
+  case Accelerator::TWO_LEVEL_GRID:
+    return closestHit(twoLevelGrid, ray, intersectLeaf);
+  default:
+    return closestHit(bvh, ray, intersectLeaf);
+  }
+}
+
+template <typename LeafOccluded>
+bool anyHitIn(Accelerator accelerator, BVH const &bvh, WideBVH const &wideBVH,
+              UniformGrid const &grid, TwoLevelGrid const &twoLevelGrid,
+              Ray const &ray, LeafOccluded occludedLeaf) {
+  switch (accelerator) {
+  case Accelerator::WIDE_BVH:
+    return anyHit(wideBVH, ray, occludedLeaf);
+  case Accelerator::GRID:
+    return anyHit(grid, ray, occludedLeaf);
+  case Accelerator::TWO_LEVEL_GRID:
+    return anyHit(twoLevelGrid, ray, occludedLeaf);
+  default:
+    return anyHit(bvh, ray, occludedLeaf);
+  }
+}
+
+} // namespace
+
+Scene buildScene(SceneDescription description) {
+  // the SAH build does not use the pool
+  concurrency::ThreadPool threadPool(1);
+  return buildScene(std::move(description), SceneBuildOptions(), threadPool);
+}
+
+Scene buildScene(SceneDescription description,
+                 SceneBuildOptions const &buildOptions,
+                 concurrency::ThreadPool &threadPool) {
+  Scene scene;
+  scene.buildOptions = buildOptions;
+
+  std::vector<AABB> sphereBounds;
+  sphereBounds.reserve(description.spheres.size());
+  for (auto const &s : description.spheres)
+    sphereBounds.push_back(bounds(s));
+  scene.sphereBVH = buildSceneBVH(sphereBounds, buildOptions, threadPool);
+
+  std::vector<AABB> triangleBounds;
+  triangleBounds.reserve(description.triangles.size());
+  for (auto const &t : description.triangles)
+    triangleBounds.push_back(bounds(t));
+  scene.triangleBVH = buildSceneBVH(triangleBounds, buildOptions, threadPool);
+
+  // before the layout, collapsing moves the leaves
+  if (buildOptions.accelerator == Accelerator::WIDE_BVH) {
+    scene.sphereWideBVH = collapse(scene.sphereBVH);
+    scene.triangleWideBVH = collapse(scene.triangleBVH);
+  }
+
+  // lay the arrays out in leaf order
+  for (auto index : scene.sphereBVH.primitiveIndices)
+    appendSphere(scene.spheres, description.spheres[index]);
+
+  for (auto index : scene.triangleBVH.primitiveIndices)
+    appendTriangle(scene.triangles, description.triangles[index]);
+
+  padForSIMD(scene.spheres);
+  padForSIMD(scene.triangles);
+  buildGrids(scene);
+
+  scene.sphereSlots = slotsOf(scene.sphereBVH);
+  scene.triangleSlots = slotsOf(scene.triangleBVH);
+
+  auto options = bvhOptions(buildOptions);
+  scene.sphereBVHCost = surfaceAreaCost(scene.sphereBVH, options);
+  scene.triangleBVHCost = surfaceAreaCost(scene.triangleBVH, options);
+
+  scene.planes = std::move(description.planes);
+  scene.meshes = buildMeshInstances(std::move(description.meshInstances));
+
+  return scene;
+}
+
+void updateSphere(Scene &scene, uint32_t index, Sphere const &sphere) {
+  setSphere(scene.spheres, scene.sphereSlots[index], sphere);
+}
+
+void updateTriangle(Scene &scene, uint32_t index, Triangle const &triangle) {
+  setTriangle(scene.triangles, scene.triangleSlots[index], triangle);
+}
+
+void updateMeshInstance(Scene &scene, uint32_t index, Mat4f const &toWorld) {
+  auto &instance = scene.meshes.instances[index];
+  instance = makeMeshInstance(instance.mesh, toWorld, instance.colour);
+}
+
+void refitScene(Scene &scene, concurrency::ThreadPool &threadPool,
+                float rebuildThreshold) {
+  auto const options = bvhOptions(scene.buildOptions);
+  bool const wideBVH = scene.buildOptions.accelerator == Accelerator::WIDE_BVH;
+
+  // refit, or rebuild and move the slots to the new leaf order
+  auto update = [&](BVH &bvh, WideBVH &wide, std::vector<AABB> const &bounds,
+                    float &cost, std::vector<uint32_t> &slots) {
+    refit(bvh, bounds, threadPool);
+    if (!(surfaceAreaCost(bvh, options) > rebuildThreshold * cost)) {
+      if (wideBVH)
+        refit(wide, bounds);
+      return std::vector<uint32_t>();
+    }
+
+    bvh = buildSceneBVH(bounds, scene.buildOptions, threadPool);
+    if (wideBVH)
+      wide = collapse(bvh);
+    cost = surfaceAreaCost(bvh, options);
+
+    std::vector<uint32_t> from(bvh.primitiveIndices.size());
+    for (uint32_t slot = 0; slot < from.size(); ++slot)
+      from[slot] = slots[bvh.primitiveIndices[slot]];
+    slots = slotsOf(bvh);
+    return from;
+  };
+
+  auto &spheres = scene.spheres;
+  auto from = update(scene.sphereBVH, scene.sphereWideBVH,
+                     primitiveBounds(
+                         scene.sphereBVH,
+                         [&](uint32_t slot) { return sphereBounds(spheres, slot); },
+                         threadPool),
+                     scene.sphereBVHCost, scene.sphereSlots);
+  if (!from.empty()) {
+    reorder(spheres.centerX, from);
+    reorder(spheres.centerY, from);
+    reorder(spheres.centerZ, from);
+    reorder(spheres.radius, from);
+    reorder(spheres.colour, from);
+  }
+
+  auto &triangles = scene.triangles;
+  from = update(scene.triangleBVH, scene.triangleWideBVH,
+                primitiveBounds(scene.triangleBVH,
+                                [&](uint32_t slot) {
+                                  return triangleBounds(triangles, slot);
+                                },
+                                threadPool),
+                scene.triangleBVHCost, scene.triangleSlots);
+  if (!from.empty()) {
+    for (auto *array : {&triangles.ax, &triangles.ay, &triangles.az,    //
+                        &triangles.abx, &triangles.aby, &triangles.abz, //
+                        &triangles.acx, &triangles.acy, &triangles.acz})
+      reorder(*array, from);
+    reorder(triangles.normal, from);
+    reorder(triangles.colour, from);
+  }
+
+  buildGrids(scene);
+
+  // instances are few, their bounds come from their mesh's BVH
+  std::vector<AABB> instanceBounds;
+  instanceBounds.reserve(scene.meshes.instances.size());
+  for (auto const &instance : scene.meshes.instances)
+    instanceBounds.push_back(bounds(instance));
+  refit(scene.meshes.bvh, instanceBounds, threadPool);
+}
+
+SceneHit::operator bool() const { return hit.didIntersect; }
+
+void intersectSpheres(Spheres const &spheres, uint32_t first, uint32_t count,
+                      Ray const &ray, Hit &closest, uint32_t &closestIndex) {
+  float const dx = ray.direction.x;
+  float const dy = ray.direction.y;
+  float const dz = ray.direction.z;
+  float const a = dx * dx + dy * dy + dz * dz;
+
+  for (uint32_t i = first; i < first + count; ++i) {
+    float ocx = ray.origin.x - spheres.centerX[i];
+    float ocy = ray.origin.y - spheres.centerY[i];
+    float ocz = ray.origin.z - spheres.centerZ[i];
+
+    float b = dx * ocx + dy * ocy + dz * ocz;
+    float c = ocx * ocx + ocy * ocy + ocz * ocz -
+              spheres.radius[i] * spheres.radius[i];
+
+    float discriminant = b * b - a * c;
+    if (discriminant < 0.f)
+      continue;
+
+    // nearer root in the ray interval, as intersect(Ray, Sphere)
+    float root = std::sqrt(discriminant);
+    float t = (-b - root) / a;
+    if (t <= ray.tMin)
+      t = (-b + root) / a;
+    if (t > ray.tMin && t < closest.rayDepth) {
+      closest.didIntersect = true;
+      closest.rayDepth = t;
+      closestIndex = i;
+    }
+  }
+}
+
+void intersectTriangles(Triangles const &triangles, uint32_t first,
+                        uint32_t count, Ray const &ray, Hit &closest,
+                        uint32_t &closestIndex) {
+  float const dx = ray.direction.x;
+  float const dy = ray.direction.y;
+  float const dz = ray.direction.z;
+
+  for (uint32_t i = first; i < first + count; ++i) {
+    // Moller-Trumbore, see intersect(Ray, PrecomputedTriangle)
+    float px = dy * triangles.acz[i] - dz * triangles.acy[i];
+    float py = dz * triangles.acx[i] - dx * triangles.acz[i];
+    float pz = dx * triangles.acy[i] - dy * triangles.acx[i];
+
+    float det = triangles.abx[i] * px + triangles.aby[i] * py +
+                triangles.abz[i] * pz;
+    if (det == 0.f)
+      continue;
+    float invDet = 1.f / det;
+
+    float sx = ray.origin.x - triangles.ax[i];
+    float sy = ray.origin.y - triangles.ay[i];
+    float sz = ray.origin.z - triangles.az[i];
+
+    float u = (sx * px + sy * py + sz * pz) * invDet;
+    if (u < 0.f || u > 1.f)
+      continue;
+
+    float qx = sy * triangles.abz[i] - sz * triangles.aby[i];
+    float qy = sz * triangles.abx[i] - sx * triangles.abz[i];
+    float qz = sx * triangles.aby[i] - sy * triangles.abx[i];
+
+    float v = (dx * qx + dy * qy + dz * qz) * invDet;
+    if (v < 0.f || u + v > 1.f)
+      continue;
+
+    float t = (triangles.acx[i] * qx + triangles.acy[i] * qy +
+               triangles.acz[i] * qz) *
+              invDet;
+    if (t > ray.tMin && t < closest.rayDepth) {
+      closest.didIntersect = true;
+      closest.rayDepth = t;
+      closest.u = u;
+      closest.v = v;
+      closestIndex = i;
+    }
+  }
+}
+
+SceneHit intersect(Ray const &ray, Scene const &scene) {
+  SceneHit closest;
+  closest.hit.rayDepth = ray.tMax;
+
+  uint32_t index = 0;
+
+  auto intersectSphereLeaf = [&](uint32_t offset, uint32_t count,
+                                 Hit &closest) {
+    intersectSpheresSIMD(scene.spheres, offset, count, ray, closest, index);
+  };
+  auto const accelerator = scene.buildOptions.accelerator;
+  auto sphereHit =
+      closestHitIn(accelerator, scene.sphereBVH, scene.sphereWideBVH,
+                   scene.sphereGrid, scene.sphereTwoLevelGrid, ray,
+                   intersectSphereLeaf);
+  if (sphereHit) {
+    closest.hit = sphereHit;
+    closest.type = PrimitiveType::SPHERE;
+    closest.primitive = index;
+  }
+
+  // each type only looks for hits nearer than the ones found before
+  Ray nearer = ray;
+  nearer.tMax = closest.hit.rayDepth;
+  auto intersectTriangleLeaf = [&](uint32_t offset, uint32_t count,
+                                   Hit &closest) {
+    intersectTrianglesSIMD(scene.triangles, offset, count, nearer, closest,
+                           index);
+  };
+  auto triangleHit =
+      closestHitIn(accelerator, scene.triangleBVH, scene.triangleWideBVH,
+                   scene.triangleGrid, scene.triangleTwoLevelGrid, nearer,
+                   intersectTriangleLeaf);
+  if (triangleHit) {
+    closest.hit = triangleHit;
+    closest.type = PrimitiveType::TRIANGLE;
+    closest.primitive = index;
+  }
+
+  intersectPlanesAndMeshes(ray, scene, closest);
+
+  if (closest)
+    evaluateSurface(closest, ray, scene);
+
+  return closest;
+}
+
+void intersectPlanesAndMeshes(Ray const &ray, Scene const &scene,
+                              SceneHit &closest) {
+  for (uint32_t i = 0; i < scene.planes.size(); ++i) {
+    auto hit = geometry::intersect(ray, scene.planes[i]);
+    if (hit && hit.rayDepth < closest.hit.rayDepth) {
+      closest.hit = hit;
+      closest.type = PrimitiveType::PLANE;
+      closest.primitive = i;
+    }
+  }
+
+  Ray nearer = ray;
+  nearer.tMax = closest.hit.rayDepth;
+  auto meshHit = geometry::intersect(nearer, scene.meshes);
+  if (meshHit) {
+    closest.hit = meshHit.hit;
+    closest.type = PrimitiveType::MESH;
+    closest.primitive = meshHit.triangle;
+    closest.instance = meshHit.instance;
+  }
+}
+
+bool occludedByCached(Ray const &ray, Scene const &scene,
+                      OcclusionCache const &cache) {
+  Hit hit;
+  hit.rayDepth = ray.tMax;
+  uint32_t index;
+
+  switch (cache.type) {
+  case PrimitiveType::SPHERE:
+    intersectSpheres(scene.spheres, cache.index, 1, ray, hit, index);
+    return hit.didIntersect;
+  case PrimitiveType::TRIANGLE:
+    intersectTriangles(scene.triangles, cache.index, 1, ray, hit, index);
+    return hit.didIntersect;
+  case PrimitiveType::PLANE:
+    return bool(geometry::intersect(ray, scene.planes[cache.index]));
+  case PrimitiveType::MESH:
+    return geometry::occludedByTriangle(ray, scene.meshes, cache.index,
+                                        cache.triangle);
+  default:
+    return false;
+  }
+}
+
+bool occluded(Ray const &ray, Scene const &scene, OcclusionCache &cache) {
+  if (occludedByCached(ray, scene, cache))
+    return true;
+
+  uint32_t occluder = 0;
+
+  auto sphereOccluded = [&](uint32_t offset, uint32_t count) {
+    return occludedSpheresSIMD(scene.spheres, offset, count, ray, occluder);
+  };
+  auto const accelerator = scene.buildOptions.accelerator;
+  if (anyHitIn(accelerator, scene.sphereBVH, scene.sphereWideBVH,
+               scene.sphereGrid, scene.sphereTwoLevelGrid, ray,
+               sphereOccluded)) {
+    cache.type = PrimitiveType::SPHERE;
+    cache.index = occluder;
+    return true;
+  }
+
+  auto triangleOccluded = [&](uint32_t offset, uint32_t count) {
+    return occludedTrianglesSIMD(scene.triangles, offset, count, ray,
+                                 occluder);
+  };
+  if (anyHitIn(accelerator, scene.triangleBVH, scene.triangleWideBVH,
+               scene.triangleGrid, scene.triangleTwoLevelGrid, ray,
+               triangleOccluded)) {
+    cache.type = PrimitiveType::TRIANGLE;
+    cache.index = occluder;
+    return true;
+  }
+
+  return occludedByPlanesOrMeshes(ray, scene, cache);
+}
+
+bool occluded(Ray const &ray, Scene const &scene) {
+  OcclusionCache cache;
+  return occluded(ray, scene, cache);
+}
+
+bool occludedByPlanesOrMeshes(Ray const &ray, Scene const &scene,
+                              OcclusionCache &cache) {
+  for (uint32_t i = 0; i < scene.planes.size(); ++i) {
+    if (geometry::intersect(ray, scene.planes[i])) {
+      cache.type = PrimitiveType::PLANE;
+      cache.index = i;
+      return true;
+    }
+  }
+
+  uint32_t instance, slot;
+  if (geometry::occluded(ray, scene.meshes, instance, slot)) {
+    cache.type = PrimitiveType::MESH;
+    cache.index = instance;
+    cache.triangle = slot;
+    return true;
+  }
+
+  return false;
+}
+
+Vec3f colourAt(SceneHit const &hit, Scene const &scene) {
+  switch (hit.type) {
+  case PrimitiveType::SPHERE:
+    return scene.spheres.colour[hit.primitive];
+  case PrimitiveType::TRIANGLE:
+    return scene.triangles.colour[hit.primitive];
+  case PrimitiveType::PLANE:
+    return scene.planes[hit.primitive].colour;
+  case PrimitiveType::MESH:
+    return scene.meshes.instances[hit.instance].colour;
+  default:
+    return {};
+  }
+}
+
+namespace {
+
+// unit geometric normal at point, which lies on the hit primitive
+Vec3f normalAt(SceneHit const &hit, Vec3f const &point, Scene const &scene) {
+  switch (hit.type) {
+  case PrimitiveType::SPHERE: {
+    auto const &spheres = scene.spheres;
+    Vec3f center(spheres.centerX[hit.primitive],
+                 spheres.centerY[hit.primitive],
+                 spheres.centerZ[hit.primitive]);
+    return normalized((point - center) / spheres.radius[hit.primitive]);
+  }
+  case PrimitiveType::TRIANGLE:
+    return scene.triangles.normal[hit.primitive];
+  case PrimitiveType::PLANE:
+    return normalized(scene.planes[hit.primitive].normal);
+  case PrimitiveType::MESH: {
+    InstanceHit instanceHit;
+    instanceHit.hit = hit.hit;
+    instanceHit.instance = hit.instance;
+    instanceHit.triangle = hit.primitive;
+    return geometry::normalAt(instanceHit, scene.meshes);
+  }
+  default:
+    return {};
+  }
+}
+
+} // namespace
+
+void evaluateSurface(SceneHit &hit, Ray const &ray, Scene const &scene) {
+  hit.point = ray.origin + (hit.hit.rayDepth * ray.direction);
+  hit.normal = normalAt(hit, hit.point, scene);
+}
+
+} // namespace raytracing
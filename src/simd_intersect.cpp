@@ -0,0 +1,315 @@
+#include "simd_intersect.hpp"
+
+using namespace geometry;
+
+namespace simd {
+
+namespace {
+
+#ifdef RAYTRACING_SIMD
+
+// first lane set in mask, which must not be empty
+uint32_t firstLane(Float mask) {
+  uint32_t laneBits = bits(mask);
+  uint32_t lane = 0;
+  while (!(laneBits & (1u << lane)))
+    ++lane;
+  return lane;
+}
+
+// picks the nearest lane, lowest slot on ties like the scalar loops
+void reduceClosest(Float bestDepth, Int bestIndex, Hit &closest,
+                   uint32_t &closestIndex, int &lane) {
+  float depths[laneCount];
+  uint32_t indices[laneCount];
+  store(depths, bestDepth);
+  store(indices, bestIndex);
+
+  lane = -1;
+  for (uint32_t i = 0; i < laneCount; ++i) {
+    bool nearer = depths[i] < closest.rayDepth;
+    bool tie = lane >= 0 && depths[i] == closest.rayDepth &&
+               indices[i] < closestIndex;
+    if (nearer || tie) {
+      closest.rayDepth = depths[i];
+      closestIndex = indices[i];
+      lane = int(i);
+    }
+  }
+
+  if (lane >= 0)
+    closest.didIntersect = true;
+}
+
+#endif
+
+} // namespace
+} // namespace simd
+
+namespace raytracing {
+
+#ifdef RAYTRACING_SIMD
+
+void intersectSpheresSIMD(Spheres const &spheres, uint32_t first,
+                          uint32_t count, Ray const &ray, Hit &closest,
+                          uint32_t &closestIndex) {
+  using namespace simd;
+
+  Float const dx = broadcast(ray.direction.x);
+  Float const dy = broadcast(ray.direction.y);
+  Float const dz = broadcast(ray.direction.z);
+  Float const ox = broadcast(ray.origin.x);
+  Float const oy = broadcast(ray.origin.y);
+  Float const oz = broadcast(ray.origin.z);
+  Float const a = dx * dx + dy * dy + dz * dz;
+  Float const zero = broadcast(0.f);
+  Float const tMin = broadcast(ray.tMin);
+
+  Float bestDepth = broadcast(closest.rayDepth);
+  Int bestIndex = laneIndices(0);
+  Float anyHit = zero;
+
+  for (uint32_t i = first; i < first + count; i += laneCount) {
+    Float ocx = ox - load(&spheres.centerX[i]);
+    Float ocy = oy - load(&spheres.centerY[i]);
+    Float ocz = oz - load(&spheres.centerZ[i]);
+    Float r = load(&spheres.radius[i]);
+
+    Float b = dx * ocx + dy * ocy + dz * ocz;
+    Float c = ocx * ocx + ocy * ocy + ocz * ocz - r * r;
+    Float discriminant = b * b - a * c;
+
+    // nearer root in the ray interval, as intersect(Ray, Sphere)
+    Float root = sqrt(max(discriminant, zero));
+    Float tNear = (zero - b - root) / a;
+    Float t = select(tNear > tMin, tNear, (root - b) / a);
+
+    Float hit = activeLanes(first + count - i) & (discriminant >= zero) &
+                (t > tMin) & (t < bestDepth);
+
+    bestDepth = select(hit, t, bestDepth);
+    bestIndex = select(hit, laneIndices(i), bestIndex);
+    anyHit = anyHit | hit;
+  }
+
+  if (!any(anyHit))
+    return;
+
+  int lane;
+  reduceClosest(bestDepth, bestIndex, closest, closestIndex, lane);
+}
+
+void intersectTrianglesSIMD(Triangles const &triangles, uint32_t first,
+                            uint32_t count, Ray const &ray, Hit &closest,
+                            uint32_t &closestIndex) {
+  using namespace simd;
+
+  Float const dx = broadcast(ray.direction.x);
+  Float const dy = broadcast(ray.direction.y);
+  Float const dz = broadcast(ray.direction.z);
+  Float const ox = broadcast(ray.origin.x);
+  Float const oy = broadcast(ray.origin.y);
+  Float const oz = broadcast(ray.origin.z);
+  Float const zero = broadcast(0.f);
+  Float const one = broadcast(1.f);
+  Float const tMin = broadcast(ray.tMin);
+
+  Float bestDepth = broadcast(closest.rayDepth);
+  Float bestU = zero;
+  Float bestV = zero;
+  Int bestIndex = laneIndices(0);
+  Float anyHit = zero;
+
+  for (uint32_t i = first; i < first + count; i += laneCount) {
+    Float abx = load(&triangles.abx[i]);
+    Float aby = load(&triangles.aby[i]);
+    Float abz = load(&triangles.abz[i]);
+    Float acx = load(&triangles.acx[i]);
+    Float acy = load(&triangles.acy[i]);
+    Float acz = load(&triangles.acz[i]);
+
+    // Moller-Trumbore, see intersect(Ray, PrecomputedTriangle)
+    Float px = dy * acz - dz * acy;
+    Float py = dz * acx - dx * acz;
+    Float pz = dx * acy - dy * acx;
+
+    Float det = abx * px + aby * py + abz * pz;
+    Float invDet = one / det;
+
+    Float sx = ox - load(&triangles.ax[i]);
+    Float sy = oy - load(&triangles.ay[i]);
+    Float sz = oz - load(&triangles.az[i]);
+
+    Float u = (sx * px + sy * py + sz * pz) * invDet;
+
+    Float qx = sy * abz - sz * aby;
+    Float qy = sz * abx - sx * abz;
+    Float qz = sx * aby - sy * abx;
+
+    Float v = (dx * qx + dy * qy + dz * qz) * invDet;
+    Float t = (acx * qx + acy * qy + acz * qz) * invDet;
+
+    Float hit = activeLanes(first + count - i) & (det != zero) &
+                (u >= zero) & (u <= one) & (v >= zero) & (u + v <= one) &
+                (t > tMin) & (t < bestDepth);
+
+    bestDepth = select(hit, t, bestDepth);
+    bestU = select(hit, u, bestU);
+    bestV = select(hit, v, bestV);
+    bestIndex = select(hit, laneIndices(i), bestIndex);
+    anyHit = anyHit | hit;
+  }
+
+  if (!any(anyHit))
+    return;
+
+  int lane;
+  reduceClosest(bestDepth, bestIndex, closest, closestIndex, lane);
+  if (lane >= 0) {
+    float us[laneCount];
+    float vs[laneCount];
+    store(us, bestU);
+    store(vs, bestV);
+    closest.u = us[lane];
+    closest.v = vs[lane];
+  }
+}
+
+bool occludedSpheresSIMD(Spheres const &spheres, uint32_t first,
+                         uint32_t count, Ray const &ray, uint32_t &occluder) {
+  using namespace simd;
+
+  Float const dx = broadcast(ray.direction.x);
+  Float const dy = broadcast(ray.direction.y);
+  Float const dz = broadcast(ray.direction.z);
+  Float const ox = broadcast(ray.origin.x);
+  Float const oy = broadcast(ray.origin.y);
+  Float const oz = broadcast(ray.origin.z);
+  Float const a = dx * dx + dy * dy + dz * dz;
+  Float const zero = broadcast(0.f);
+  Float const tMin = broadcast(ray.tMin);
+  Float const tMax = broadcast(ray.tMax);
+
+  for (uint32_t i = first; i < first + count; i += laneCount) {
+    Float ocx = ox - load(&spheres.centerX[i]);
+    Float ocy = oy - load(&spheres.centerY[i]);
+    Float ocz = oz - load(&spheres.centerZ[i]);
+    Float r = load(&spheres.radius[i]);
+
+    Float b = dx * ocx + dy * ocy + dz * ocz;
+    Float c = ocx * ocx + ocy * ocy + ocz * ocz - r * r;
+    Float discriminant = b * b - a * c;
+    Float root = sqrt(max(discriminant, zero));
+    Float tNear = (zero - b - root) / a;
+    Float t = select(tNear > tMin, tNear, (root - b) / a);
+
+    Float hit = activeLanes(first + count - i) & (discriminant >= zero) &
+                (t > tMin) & (t < tMax);
+    if (any(hit)) {
+      occluder = i + firstLane(hit);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool occludedTrianglesSIMD(Triangles const &triangles, uint32_t first,
+                           uint32_t count, Ray const &ray, uint32_t &occluder) {
+  using namespace simd;
+
+  Float const dx = broadcast(ray.direction.x);
+  Float const dy = broadcast(ray.direction.y);
+  Float const dz = broadcast(ray.direction.z);
+  Float const ox = broadcast(ray.origin.x);
+  Float const oy = broadcast(ray.origin.y);
+  Float const oz = broadcast(ray.origin.z);
+  Float const zero = broadcast(0.f);
+  Float const one = broadcast(1.f);
+  Float const tMin = broadcast(ray.tMin);
+  Float const tMax = broadcast(ray.tMax);
+
+  for (uint32_t i = first; i < first + count; i += laneCount) {
+    Float abx = load(&triangles.abx[i]);
+    Float aby = load(&triangles.aby[i]);
+    Float abz = load(&triangles.abz[i]);
+    Float acx = load(&triangles.acx[i]);
+    Float acy = load(&triangles.acy[i]);
+    Float acz = load(&triangles.acz[i]);
+
+    Float px = dy * acz - dz * acy;
+    Float py = dz * acx - dx * acz;
+    Float pz = dx * acy - dy * acx;
+
+    Float det = abx * px + aby * py + abz * pz;
+    Float invDet = one / det;
+
+    Float sx = ox - load(&triangles.ax[i]);
+    Float sy = oy - load(&triangles.ay[i]);
+    Float sz = oz - load(&triangles.az[i]);
+
+    Float u = (sx * px + sy * py + sz * pz) * invDet;
+
+    Float qx = sy * abz - sz * aby;
+    Float qy = sz * abx - sx * abz;
+    Float qz = sx * aby - sy * abx;
+
+    Float v = (dx * qx + dy * qy + dz * qz) * invDet;
+    Float t = (acx * qx + acy * qy + acz * qz) * invDet;
+
+    Float hit = activeLanes(first + count - i) & (det != zero) &
+                (u >= zero) & (u <= one) & (v >= zero) & (u + v <= one) &
+                (t > tMin) & (t < tMax);
+    if (any(hit)) {
+      occluder = i + firstLane(hit);
+      return true;
+    }
+  }
+  return false;
+}
+
+#else
+
+void intersectSpheresSIMD(Spheres const &spheres, uint32_t first,
+                          uint32_t count, Ray const &ray, Hit &closest,
+                          uint32_t &closestIndex) {
+  intersectSpheres(spheres, first, count, ray, closest, closestIndex);
+}
+
+void intersectTrianglesSIMD(Triangles const &triangles, uint32_t first,
+                            uint32_t count, Ray const &ray, Hit &closest,
+                            uint32_t &closestIndex) {
+  intersectTriangles(triangles, first, count, ray, closest, closestIndex);
+}
+
+bool occludedSpheresSIMD(Spheres const &spheres, uint32_t first,
+                         uint32_t count, Ray const &ray, uint32_t &occluder) {
+  Hit closest;
+  closest.rayDepth = ray.tMax;
+  intersectSpheres(spheres, first, count, ray, closest, occluder);
+  return closest.didIntersect;
+}
+
+bool occludedTrianglesSIMD(Triangles const &triangles, uint32_t first,
+                           uint32_t count, Ray const &ray, uint32_t &occluder) {
+  Hit closest;
+  closest.rayDepth = ray.tMax;
+  intersectTriangles(triangles, first, count, ray, closest, occluder);
+  return closest.didIntersect;
+}
+
+#endif
+
+void padForSIMD(Spheres &spheres) {
+  for (auto *array : {&spheres.centerX, &spheres.centerY, &spheres.centerZ,
+                      &spheres.radius})
+    array->insert(array->end(), simd::laneCount - 1, 0.f);
+}
+
+void padForSIMD(Triangles &triangles) {
+  for (auto *array : {&triangles.ax, &triangles.ay, &triangles.az,    //
+                      &triangles.abx, &triangles.aby, &triangles.abz, //
+                      &triangles.acx, &triangles.acy, &triangles.acz})
+    array->insert(array->end(), simd::laneCount - 1, 0.f);
+}
+
+} // namespace raytracing
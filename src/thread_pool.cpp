@@ -0,0 +1,126 @@
+#include "thread_pool.hpp"
+
+namespace concurrency {
+
+unsigned hardwareThreads() {
+  unsigned count = std::thread::hardware_concurrency();
+  return count > 0 ? count : 1;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) : m_remaining(0) {
+  if (threadCount == 0)
+    threadCount = 1;
+
+  for (unsigned i = 0; i < threadCount; ++i)
+    m_queues.emplace_back(new Queue());
+
+  for (unsigned worker = 1; worker < threadCount; ++worker)
+    m_threads.emplace_back(&ThreadPool::workerLoop, this, worker);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+
+  for (auto &thread : m_threads)
+    thread.join();
+}
+
+unsigned ThreadPool::threadCount() const { return unsigned(m_queues.size()); }
+
+void ThreadPool::parallelFor(uint32_t count, Task const &task) {
+  if (count == 0)
+    return;
+
+  // the task is published before any index can be popped, the queue
+  // mutexes order the two
+  m_task = &task;
+  m_remaining = count;
+
+  // contiguous blocks per worker keep neighbouring tasks on one thread until
+  // stealing kicks in
+  auto workers = threadCount();
+  for (unsigned worker = 0; worker < workers; ++worker) {
+    uint32_t begin = uint64_t(count) * worker / workers;
+    uint32_t end = uint64_t(count) * (worker + 1) / workers;
+
+    std::lock_guard<std::mutex> lock(m_queues[worker]->mutex);
+    for (uint32_t i = begin; i < end; ++i)
+      m_queues[worker]->tasks.push_back(i);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_generation;
+  }
+  m_wake.notify_all();
+
+  runTasks(0);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this] { return m_remaining == 0; });
+  m_task = nullptr;
+}
+
+bool ThreadPool::pop(unsigned worker, uint32_t &index) {
+  auto &queue = *m_queues[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty())
+    return false;
+
+  // own queue is worked through front to back so tiles stay in scan order
+  index = queue.tasks.front();
+  queue.tasks.pop_front();
+  return true;
+}
+
+bool ThreadPool::steal(unsigned worker, uint32_t &index) {
+  auto workers = threadCount();
+  for (unsigned i = 1; i < workers; ++i) {
+    auto &victim = *m_queues[(worker + i) % workers];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      // take from the opposite end to the owner
+      index = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::runTasks(unsigned worker) {
+  uint32_t index;
+  while (pop(worker, index) || steal(worker, index)) {
+    (*m_task)(index, worker);
+
+    if (--m_remaining == 0) {
+      // lock so the notification can't slip in before parallelFor waits
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_done.notify_all();
+    }
+  }
+}
+
+void ThreadPool::workerLoop(unsigned worker) {
+  uint64_t seenGeneration = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [&] {
+        return m_stop || m_generation != seenGeneration;
+      });
+      if (m_stop)
+        return;
+      seenGeneration = m_generation;
+    }
+
+    runTasks(worker);
+  }
+}
+
+} // namespace concurrency
@@ -0,0 +1,133 @@
+#include "tonemap.hpp"
+
+#include <algorithm>
+
+#include "random.hpp"
+#include "simd.hpp"
+
+namespace raster {
+
+namespace {
+
+// up to half a step of the 8 bit output either way
+constexpr float halfStep = 1.f / 512;
+
+// rows handed to a task at once
+constexpr int32_t rowBlockSize = 16;
+
+float applyCurve(float c, ToneMapCurve curve) {
+  switch (curve) {
+  case ToneMapCurve::REINHARD:
+    return c / (1.f + c);
+  case ToneMapCurve::ACES:
+    return (c * (2.51f * c + 0.03f)) / (c * (2.43f * c + 0.59f) + 0.14f);
+  default:
+    return c;
+  }
+}
+
+// [0, 1] to 0 - 255, NaN to 0
+unsigned char quantize(float c) {
+  c = std::min(std::max(0.f, c), 1.f);
+  return static_cast<unsigned char>(c * 255.f);
+}
+
+#ifdef RAYTRACING_SIMD
+
+simd::Float applyCurve(simd::Float c, ToneMapCurve curve) {
+  using simd::broadcast;
+  switch (curve) {
+  case ToneMapCurve::REINHARD:
+    return c / (broadcast(1.f) + c);
+  case ToneMapCurve::ACES:
+    return (c * (broadcast(2.51f) * c + broadcast(0.03f))) /
+           (c * (broadcast(2.43f) * c + broadcast(0.59f)) + broadcast(0.14f));
+  default:
+    return c;
+  }
+}
+
+simd::Int quantize(simd::Float c) {
+  // max with 0 first returns 0 for NaN
+  c = simd::min(simd::max(simd::broadcast(0.f), c), simd::broadcast(1.f));
+  return simd::truncate(c * simd::broadcast(255.f));
+}
+
+#endif
+
+} // namespace
+
+// the scalar loop finishes the pixels of a row that don't fill a register;
+// both give the same bytes, the operations are the same and in the same order
+void toneMap(geometry::Grid2<math::Vec3f> const &radiance,
+             geometry::Grid2<RGB> &screen, ToneMapping const &toneMapping,
+             int32_t firstRow, int32_t lastRow) {
+  int32_t const width = screen.width();
+  float const exposure = toneMapping.exposure;
+  ToneMapCurve const curve = toneMapping.curve;
+
+  for (int32_t y = firstRow; y < lastRow; ++y) {
+    math::Vec3f const *in = radiance.data() + radiance.indexOf(0, y);
+    RGB *out = &screen(0, y);
+    uint32_t const rowStart = uint32_t(screen.indexOf(0, y));
+
+    int32_t x = 0;
+#ifdef RAYTRACING_SIMD
+    using simd::laneCount;
+    for (; x + int32_t(laneCount) <= width; x += laneCount) {
+      // channels of the pixels into one register each
+      alignas(32) float channels[3][laneCount];
+      for (uint32_t i = 0; i < laneCount; ++i) {
+        channels[0][i] = in[x + i].x;
+        channels[1][i] = in[x + i].y;
+        channels[2][i] = in[x + i].z;
+      }
+
+      simd::Float dither = simd::broadcast(0.f);
+      if (toneMapping.dither)
+        dither = sampling::randomRange(
+            -halfStep, halfStep, simd::laneIndices(rowStart + uint32_t(x)), 0,
+            sampling::DITHER);
+
+      alignas(32) uint32_t bytes[3][laneCount];
+      for (int c = 0; c < 3; ++c) {
+        simd::Float value =
+            simd::load(channels[c]) * simd::broadcast(exposure);
+        value = applyCurve(value, curve) + dither;
+        simd::store(bytes[c], quantize(value));
+      }
+
+      for (uint32_t i = 0; i < laneCount; ++i)
+        out[x + i] = {uint8_t(bytes[0][i]), uint8_t(bytes[1][i]),
+                      uint8_t(bytes[2][i])};
+    }
+#endif
+
+    for (; x < width; ++x) {
+      float dither = 0.f;
+      if (toneMapping.dither)
+        dither = sampling::randomRange(-halfStep, halfStep,
+                                       rowStart + uint32_t(x), 0,
+                                       sampling::DITHER);
+
+      math::Vec3f const &c = in[x];
+      out[x] = {quantize(applyCurve(c.x * exposure, curve) + dither),
+                quantize(applyCurve(c.y * exposure, curve) + dither),
+                quantize(applyCurve(c.z * exposure, curve) + dither)};
+    }
+  }
+}
+
+void toneMap(geometry::Grid2<math::Vec3f> const &radiance,
+             geometry::Grid2<RGB> &screen, ToneMapping const &toneMapping,
+             concurrency::ThreadPool &threadPool) {
+  int32_t const height = screen.height();
+  uint32_t const blocks = uint32_t((height + rowBlockSize - 1) / rowBlockSize);
+  threadPool.parallelFor(blocks, [&](uint32_t block, unsigned) {
+    int32_t firstRow = int32_t(block) * rowBlockSize;
+    toneMap(radiance, screen, toneMapping, firstRow,
+            std::min(firstRow + rowBlockSize, height));
+  });
+}
+
+} // namespace raster
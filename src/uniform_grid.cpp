@@ -0,0 +1,239 @@
+#include "uniform_grid.hpp"
+
+#include <cmath>
+
+using namespace math;
+
+namespace geometry {
+
+namespace {
+
+constexpr int32_t maxResolution = 512; // per axis
+
+// resolution for density cells per primitive, cubic cells where the box
+// allows; flat boxes get a single layer of cells
+// cells are no smaller than minSide across, primitives spanning many cells
+// would be listed in all of them
+GridShape makeShape(AABB const &bounds, uint32_t primitives, float density,
+                    float minSide) {
+  Vec3f size = extent(bounds);
+  float const largest = std::max(std::max(size.x, size.y), size.z);
+  float const minSize = largest > 0.f ? largest * 1e-3f : 1e-3f;
+  size = Vec3f(std::max(size.x, minSize), std::max(size.y, minSize),
+               std::max(size.z, minSize));
+
+  GridShape shape;
+  shape.bounds = AABB(bounds.min, bounds.min + size);
+  float const cells = std::max(density * float(primitives), 1.f);
+  float const side =
+      std::max(std::cbrt(size.x * size.y * size.z / cells), minSide);
+  for (int axis = 0; axis < 3; ++axis) {
+    float r = std::round(axisComponent(size, axis) / side);
+    shape.resolution[axis] =
+        int32_t(std::min(std::max(r, 1.f), float(maxResolution)));
+  }
+
+  shape.cellSize = Vec3f(size.x / float(shape.resolution[0]),
+                         size.y / float(shape.resolution[1]),
+                         size.z / float(shape.resolution[2]));
+  shape.invCellSize = Vec3f(1.f / shape.cellSize.x, 1.f / shape.cellSize.y,
+                            1.f / shape.cellSize.z);
+  return shape;
+}
+
+AABB cellBounds(GridShape const &shape, int32_t x, int32_t y, int32_t z) {
+  Vec3f min = shape.bounds.min + Vec3f(float(x) * shape.cellSize.x,
+                                       float(y) * shape.cellSize.y,
+                                       float(z) * shape.cellSize.z);
+  return {min, min + shape.cellSize};
+}
+
+// cells a box overlaps, per axis; grown by a little so rounding in the
+// traversal cannot step past a primitive lying on a cell boundary
+void overlappedCells(GridShape const &shape, AABB const &box, int32_t lo[3],
+                     int32_t hi[3]) {
+  for (int axis = 0; axis < 3; ++axis) {
+    float margin = 1e-3f * axisComponent(shape.cellSize, axis);
+    lo[axis] = shape.cellOf(axisComponent(box.min, axis) - margin, axis);
+    hi[axis] = shape.cellOf(axisComponent(box.max, axis) + margin, axis);
+  }
+}
+
+// the primitives overlapping every cell of shape, references of cell i are
+// references[cellStart[i], cellStart[i + 1]) in ascending order; indices
+// are the primitives to bin, all of them if null
+void bin(GridShape const &shape, std::vector<AABB> const &primitiveBounds,
+         uint32_t const *indices, uint32_t count,
+         std::vector<uint32_t> &cellStart, std::vector<uint32_t> &references) {
+  cellStart.assign(shape.cellCount() + 1, 0);
+
+  // count, then place, a counting sort by cell
+  for (int pass = 0; pass < 2; ++pass) {
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t primitive = indices ? indices[i] : i;
+      int32_t lo[3], hi[3];
+      overlappedCells(shape, primitiveBounds[primitive], lo, hi);
+      for (int32_t z = lo[2]; z <= hi[2]; ++z)
+        for (int32_t y = lo[1]; y <= hi[1]; ++y)
+          for (int32_t x = lo[0]; x <= hi[0]; ++x) {
+            uint32_t cell = shape.cellIndex(x, y, z);
+            if (pass == 0)
+              ++cellStart[cell + 1];
+            else
+              references[cellStart[cell]++] = primitive;
+          }
+    }
+
+    if (pass == 0) {
+      for (size_t cell = 1; cell < cellStart.size(); ++cell)
+        cellStart[cell] += cellStart[cell - 1];
+      references.resize(cellStart.back());
+    } else {
+      // placing moved every start to the next cell's
+      for (size_t cell = cellStart.size() - 1; cell > 0; --cell)
+        cellStart[cell] = cellStart[cell - 1];
+      cellStart[0] = 0;
+    }
+  }
+}
+
+// appends the start of every cell to cellStart and its references as ranges
+// of consecutive primitives to ranges
+void appendRanges(std::vector<uint32_t> const &binnedStart,
+                  std::vector<uint32_t> const &references,
+                  std::vector<uint32_t> &cellStart,
+                  std::vector<GridRange> &ranges) {
+  for (size_t cell = 0; cell + 1 < binnedStart.size(); ++cell) {
+    cellStart.push_back(uint32_t(ranges.size()));
+    for (uint32_t i = binnedStart[cell]; i < binnedStart[cell + 1]; ++i) {
+      if (i > binnedStart[cell] &&
+          ranges.back().first + ranges.back().count == references[i])
+        ++ranges.back().count;
+      else
+        ranges.push_back({references[i], 1});
+    }
+  }
+}
+
+AABB boundsOf(std::vector<AABB> const &primitiveBounds) {
+  AABB result;
+  for (auto const &box : primitiveBounds)
+    result = merge(result, box);
+  return result;
+}
+
+// the mean size of the primitives, see makeShape
+float meanSize(std::vector<AABB> const &primitiveBounds) {
+  double sum = 0.0;
+  for (auto const &box : primitiveBounds) {
+    Vec3f size = extent(box);
+    sum += size.x + size.y + size.z;
+  }
+  return float(sum / (3.0 * primitiveBounds.size()));
+}
+
+} // namespace
+
+uint32_t GridShape::cellCount() const {
+  return uint32_t(resolution[0]) * uint32_t(resolution[1]) *
+         uint32_t(resolution[2]);
+}
+
+uint32_t GridShape::cellIndex(int32_t x, int32_t y, int32_t z) const {
+  return uint32_t(x) +
+         uint32_t(resolution[0]) * (uint32_t(y) + uint32_t(resolution[1]) *
+                                                      uint32_t(z));
+}
+
+int32_t GridShape::cellOf(float coordinate, int axis) const {
+  float cell = (coordinate - axisComponent(bounds.min, axis)) *
+               axisComponent(invCellSize, axis);
+  // NaN ends up in cell 0
+  return int32_t(
+      std::max(0.f, std::min(cell, float(resolution[axis] - 1))));
+}
+
+UniformGrid buildUniformGrid(std::vector<AABB> const &primitiveBounds,
+                             GridBuildOptions const &options) {
+  UniformGrid grid;
+  auto const count = uint32_t(primitiveBounds.size());
+  if (count == 0)
+    return grid;
+
+  grid.shape = makeShape(boundsOf(primitiveBounds), count, options.density,
+                         meanSize(primitiveBounds));
+
+  std::vector<uint32_t> binnedStart, references;
+  bin(grid.shape, primitiveBounds, nullptr, count, binnedStart, references);
+  grid.cellStart.reserve(binnedStart.size());
+  appendRanges(binnedStart, references, grid.cellStart, grid.ranges);
+  grid.cellStart.push_back(uint32_t(grid.ranges.size()));
+  return grid;
+}
+
+TwoLevelGrid buildTwoLevelGrid(std::vector<AABB> const &primitiveBounds,
+                               GridBuildOptions const &options) {
+  TwoLevelGrid grid;
+  auto const count = uint32_t(primitiveBounds.size());
+  if (count == 0)
+    return grid;
+
+  float const minSide = meanSize(primitiveBounds);
+  grid.shape = makeShape(boundsOf(primitiveBounds), count, options.topDensity,
+                         minSide);
+
+  std::vector<uint32_t> topStart, topReferences;
+  bin(grid.shape, primitiveBounds, nullptr, count, topStart, topReferences);
+
+  // every top level cell gets a grid for the primitives overlapping it
+  grid.cellShapes.reserve(grid.shape.cellCount());
+  grid.firstCell.reserve(grid.shape.cellCount() + 1);
+  std::vector<uint32_t> binnedStart, references;
+  for (int32_t z = 0; z < grid.shape.resolution[2]; ++z)
+    for (int32_t y = 0; y < grid.shape.resolution[1]; ++y)
+      for (int32_t x = 0; x < grid.shape.resolution[0]; ++x) {
+        uint32_t cell = grid.shape.cellIndex(x, y, z);
+        uint32_t first = topStart[cell];
+        uint32_t cellCount = topStart[cell + 1] - first;
+
+        GridShape shape = makeShape(cellBounds(grid.shape, x, y, z),
+                                    cellCount, options.density, minSide);
+        bin(shape, primitiveBounds, topReferences.data() + first, cellCount,
+            binnedStart, references);
+
+        grid.firstCell.push_back(uint32_t(grid.cellStart.size()));
+        appendRanges(binnedStart, references, grid.cellStart, grid.ranges);
+        grid.cellShapes.push_back(shape);
+      }
+
+  grid.firstCell.push_back(uint32_t(grid.cellStart.size()));
+  grid.cellStart.push_back(uint32_t(grid.ranges.size()));
+  return grid;
+}
+
+bool clip(GridShape const &shape, Ray const &ray, Vec3f const &invDirection,
+          float tMin, float tMax, float &tEnter, float &tExit) {
+  tEnter = tMin;
+  tExit = tMax;
+  for (int axis = 0; axis < 3; ++axis) {
+    float origin = axisComponent(ray.origin, axis);
+    float min = axisComponent(shape.bounds.min, axis);
+    float max = axisComponent(shape.bounds.max, axis);
+
+    // parallel to the slab, 0 * infinity would not compare
+    if (axisComponent(ray.direction, axis) == 0.f) {
+      if (origin < min || origin > max)
+        return false;
+      continue;
+    }
+
+    float inv = axisComponent(invDirection, axis);
+    float t0 = (min - origin) * inv;
+    float t1 = (max - origin) * inv;
+    tEnter = std::max(tEnter, std::min(t0, t1));
+    tExit = std::min(tExit, std::max(t0, t1));
+  }
+  return tEnter <= tExit;
+}
+
+} // namespace geometry
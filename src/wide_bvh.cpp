@@ -0,0 +1,298 @@
+#include "wide_bvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace geometry {
+
+namespace {
+
+constexpr uint32_t maxLeafCount = 255; // what WideBVHNode::count holds
+
+// 2^(exponent - 127)
+float gridStep(uint8_t exponent) {
+  uint32_t bits = uint32_t(exponent) << 23;
+  float step;
+  std::memcpy(&step, &bits, sizeof step);
+  return step;
+}
+
+// smallest power of two step with which 255 steps cover extent
+uint8_t gridExponent(float extent) {
+  if (!(extent > 0.f))
+    return 1;
+  int exponent;
+  std::frexp(extent / 255.f, &exponent);
+  // frexp gives extent / 255 = m * 2^exponent with m in [0.5, 1)
+  return uint8_t(std::min(std::max(exponent + 127, 1), 254));
+}
+
+// the same arithmetic as the traversal, a product of an 8 bit integer and a
+// power of two is exact
+float decode(float origin, uint8_t q, float step) {
+  return origin + float(q) * step;
+}
+
+// grid coordinates of the children along one axis, rounded outwards; false
+// if the step is too small for 255 of them to reach the far end
+bool quantizeAxis(WideBVHNode &node, AABB const *childBounds, int axis) {
+  float const origin = axisComponent(node.origin, axis);
+  float const step = gridStep(node.exponent[axis]);
+
+  for (uint32_t i = 0; i < node.childCount; ++i) {
+    float lo = axisComponent(childBounds[i].min, axis);
+    float hi = axisComponent(childBounds[i].max, axis);
+
+    auto q = uint8_t(std::min(std::max(std::floor((lo - origin) / step), 0.f),
+                              255.f));
+    while (q > 0 && decode(origin, q, step) > lo)
+      --q;
+    node.lo[axis][i] = q;
+
+    q = uint8_t(
+        std::min(std::max(std::ceil((hi - origin) / step), 0.f), 255.f));
+    while (q < 255 && decode(origin, q, step) < hi)
+      ++q;
+    if (decode(origin, q, step) < hi)
+      return false;
+    node.hi[axis][i] = q;
+  }
+
+  return true;
+}
+
+void quantize(WideBVHNode &node, AABB const *childBounds) {
+  AABB bounds;
+  for (uint32_t i = 0; i < node.childCount; ++i)
+    bounds = merge(bounds, childBounds[i]);
+
+  node.origin = bounds.min;
+  math::Vec3f size = extent(bounds);
+  for (int axis = 0; axis < 3; ++axis) {
+    node.exponent[axis] = gridExponent(axisComponent(size, axis));
+    while (!quantizeAxis(node, childBounds, axis))
+      ++node.exponent[axis];
+  }
+}
+
+constexpr uint32_t none = ~0u;
+
+struct Collapser {
+  BVH &bvh;
+  WideBVH &wide;
+  std::vector<uint32_t> primitiveIndices; // in the new leaf order
+  uint32_t nextPrimitive;
+
+  // a BVH node, or a piece of a BVH leaf too large for one child
+  struct Item {
+    AABB bounds;
+    uint32_t node;  // none for a piece
+    uint32_t first; // first primitive of a leaf or a piece, before collapsing
+    uint32_t count; // primitives of a leaf or a piece
+  };
+
+  Item item(uint32_t node) const {
+    BVHNode const &binary = bvh.nodes[node];
+    return {binary.bounds, node, binary.offset, binary.count};
+  }
+
+  bool isInterior(Item const &item) const {
+    return item.node != none && !bvh.nodes[item.node].isLeaf();
+  }
+
+  // becomes a leaf child, everything else a node
+  bool isLeaf(Item const &item) const {
+    return !isInterior(item) && item.count <= maxLeafCount;
+  }
+
+  // moves the primitives of a leaf to the end of the new order
+  uint32_t place(Item const &item) {
+    uint32_t first = nextPrimitive;
+    for (uint32_t i = item.first; i < item.first + item.count; ++i)
+      primitiveIndices[nextPrimitive++] = bvh.primitiveIndices[i];
+    return first;
+  }
+
+  // fills nodes[index] with the children item expands to, then their nodes;
+  // a node places its leaves before the subtrees of its children, so every
+  // subtree, and with it every leaf split into pieces, stays contiguous
+  void fill(uint32_t index, Item const &root) {
+    Item items[wideBVHWidth];
+    uint32_t itemCount = 0;
+
+    if (isInterior(root)) {
+      // the largest interior item makes room for its children
+      items[itemCount++] = root;
+      while (itemCount < wideBVHWidth) {
+        int largest = -1;
+        float largestArea = -1.f;
+        for (uint32_t i = 0; i < itemCount; ++i) {
+          float area = surfaceArea(items[i].bounds);
+          if (isInterior(items[i]) && area > largestArea) {
+            largestArea = area;
+            largest = int(i);
+          }
+        }
+        if (largest < 0)
+          break;
+
+        uint32_t expanded = items[largest].node;
+        items[largest] = item(expanded + 1);
+        items[itemCount++] = item(bvh.nodes[expanded].offset);
+      }
+    } else if (root.count > maxLeafCount) {
+      // all of its pieces end up in this subtree
+      if (root.node != none)
+        bvh.nodes[root.node].offset = nextPrimitive;
+      uint32_t const pieceSize = (root.count + wideBVHWidth - 1) / wideBVHWidth;
+      for (uint32_t i = root.first; i < root.first + root.count;
+           i += pieceSize)
+        items[itemCount++] = {root.bounds, none, i,
+                              std::min(pieceSize, root.first + root.count - i)};
+    } else {
+      // only the root of a BVH that is a single leaf
+      items[itemCount++] = root;
+    }
+
+    WideBVHNode node = {};
+    node.childCount = uint8_t(itemCount);
+    node.firstPrimitive = nextPrimitive;
+    AABB childBounds[wideBVHWidth];
+    uint32_t interiorCount = 0;
+    for (uint32_t i = 0; i < itemCount; ++i) {
+      childBounds[i] = items[i].bounds;
+      if (!isLeaf(items[i])) {
+        ++interiorCount;
+        continue;
+      }
+      node.count[i] = uint8_t(items[i].count);
+      uint32_t first = place(items[i]);
+      if (items[i].node != none)
+        bvh.nodes[items[i].node].offset = first;
+    }
+    quantize(node, childBounds);
+
+    node.firstChild = uint32_t(wide.nodes.size());
+    wide.nodes.resize(wide.nodes.size() + interiorCount);
+    wide.nodes[index] = node;
+
+    uint32_t child = node.firstChild;
+    for (uint32_t i = 0; i < itemCount; ++i)
+      if (!isLeaf(items[i]))
+        fill(child++, items[i]);
+  }
+};
+
+} // namespace
+
+AABB WideBVHNode::childBounds(uint32_t i) const {
+  AABB bounds;
+  for (int axis = 0; axis < 3; ++axis) {
+    float origin = axisComponent(this->origin, axis);
+    float step = gridStep(exponent[axis]);
+    float lo = decode(origin, this->lo[axis][i], step);
+    float hi = decode(origin, this->hi[axis][i], step);
+    if (axis == 0) {
+      bounds.min.x = lo;
+      bounds.max.x = hi;
+    } else if (axis == 1) {
+      bounds.min.y = lo;
+      bounds.max.y = hi;
+    } else {
+      bounds.min.z = lo;
+      bounds.max.z = hi;
+    }
+  }
+  return bounds;
+}
+
+WideBVH collapse(BVH &bvh) {
+  WideBVH wide;
+  if (bvh.isEmpty())
+    return wide;
+
+  wide.rootBounds = bvh.bounds();
+  wide.nodes.reserve(bvh.nodes.size() / (wideBVHWidth - 1) + 1);
+  wide.nodes.emplace_back();
+
+  Collapser collapser{bvh, wide,
+                      std::vector<uint32_t>(bvh.primitiveIndices.size()), 0};
+  collapser.fill(0, collapser.item(0));
+
+  bvh.primitiveIndices.swap(collapser.primitiveIndices);
+  wide.primitiveIndices = bvh.primitiveIndices;
+  wide.nodes.shrink_to_fit();
+  return wide;
+}
+
+void refit(WideBVH &bvh, std::vector<AABB> const &primitiveBounds) {
+  if (bvh.isEmpty())
+    return;
+
+  // children come after their parent
+  std::vector<AABB> nodeBounds(bvh.nodes.size());
+  for (uint32_t index = uint32_t(bvh.nodes.size()); index-- > 0;) {
+    WideBVHNode &node = bvh.nodes[index];
+    AABB childBounds[wideBVHWidth];
+    uint32_t nextChild = node.firstChild;
+    uint32_t nextPrimitive = node.firstPrimitive;
+    for (uint32_t i = 0; i < node.childCount; ++i) {
+      if (node.count[i] == 0) {
+        childBounds[i] = nodeBounds[nextChild++];
+        continue;
+      }
+      for (uint32_t p = 0; p < node.count[i]; ++p)
+        childBounds[i] =
+            merge(childBounds[i],
+                  primitiveBounds[bvh.primitiveIndices[nextPrimitive++]]);
+    }
+
+    quantize(node, childBounds);
+    for (uint32_t i = 0; i < node.childCount; ++i)
+      nodeBounds[index] = merge(nodeBounds[index], childBounds[i]);
+  }
+
+  bvh.rootBounds = nodeBounds[0];
+}
+
+uint32_t intersectChildren(WideBVHNode const &node, math::Vec3f const &origin,
+                           math::Vec3f const &invDirection, float tMin,
+                           float tMax, float *tNear) {
+  uint32_t const used = (1u << node.childCount) - 1;
+
+#ifdef RAYTRACING_SIMD
+  using namespace simd;
+  static_assert(wideBVHWidth == laneCount, "a register of children");
+
+  Float enter[3], exit[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    Float base = broadcast(axisComponent(node.origin, axis));
+    Float step = broadcast(gridStep(node.exponent[axis]));
+    Float o = broadcast(axisComponent(origin, axis));
+    Float inv = broadcast(axisComponent(invDirection, axis));
+
+    Float lo = base + toFloat(loadBytes(node.lo[axis])) * step;
+    Float hi = base + toFloat(loadBytes(node.hi[axis])) * step;
+    Float t0 = (lo - o) * inv;
+    Float t1 = (hi - o) * inv;
+    enter[axis] = min(t0, t1);
+    exit[axis] = max(t0, t1);
+  }
+
+  // as intersect(AABB, ...)
+  Float tEnter = max(max(enter[0], enter[1]), max(enter[2], broadcast(tMin)));
+  Float tExit = min(min(exit[0], exit[1]), min(exit[2], broadcast(tMax)));
+  store(tNear, tEnter);
+  return bits(tEnter <= tExit) & used;
+#else
+  uint32_t hits = 0;
+  for (uint32_t i = 0; i < node.childCount; ++i)
+    if (intersect(node.childBounds(i), origin, invDirection, tMin, tMax,
+                  tNear[i]))
+      hits |= 1u << i;
+  return hits & used;
+#endif
+}
+
+} // namespace geometry